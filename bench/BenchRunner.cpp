@@ -0,0 +1,77 @@
+#include "BenchRunner.h"
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+BenchRunner::BenchRunner(const QStringList &filters)
+    : m_filters(filters)
+{
+}
+
+bool BenchRunner::isEnabled(const QString &name) const
+{
+    if (m_filters.isEmpty())
+        return true;
+    for (const QString &filter : m_filters) {
+        if (name.contains(filter))
+            return true;
+    }
+    return false;
+}
+
+void BenchRunner::record(const QString &name, std::vector<qint64> samplesNs, const QJsonObject &extra)
+{
+    if (samplesNs.empty() || !isEnabled(name))
+        return;
+
+    std::sort(samplesNs.begin(), samplesNs.end());
+    const size_t n = samplesNs.size();
+    double sum = 0.0;
+    for (qint64 ns : samplesNs)
+        sum += double(ns);
+    const size_t p95 = std::min(n - 1, size_t(std::ceil(0.95 * double(n))) - 1);
+
+    QJsonObject result = extra;
+    result.insert("name", name);
+    result.insert("unit", "ns");
+    result.insert("iterations", qint64(n));
+    result.insert("min", samplesNs.front());
+    result.insert("median", samplesNs[n / 2]);
+    result.insert("mean", sum / double(n));
+    result.insert("p95", samplesNs[p95]);
+    result.insert("max", samplesNs.back());
+    m_results.append(result);
+
+    // Ход прогона — в stderr, чтобы stdout оставался под JSON
+    std::fprintf(stderr, "%-32s median %12.1f us  p95 %12.1f us  (n=%zu)\n",
+                 qPrintable(name), double(samplesNs[n / 2]) / 1000.0,
+                 double(samplesNs[p95]) / 1000.0, n);
+}
+
+QJsonObject BenchRunner::toJson() const
+{
+    QJsonObject root;
+    root.insert("meta", m_meta);
+    root.insert("results", m_results);
+    return root;
+}
+
+bool BenchRunner::writeJson(const QString &filePath) const
+{
+    const QByteArray json = QJsonDocument(toJson()).toJson(QJsonDocument::Indented);
+    if (filePath == "-") {
+        QTextStream(stdout) << json;
+        return true;
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "BenchRunner: cannot write" << filePath;
+        return false;
+    }
+    return file.write(json) == json.size();
+}
@@ -0,0 +1,63 @@
+// BenchRunner.h
+#ifndef BENCHRUNNER_H
+#define BENCHRUNNER_H
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+// Сбор замеров piano_bench. Замер — серия времён одной операции в нс;
+// в отчёт идут число повторов, минимум, медиана, среднее, p95 и максимум,
+// плюс поля самого замера (пропускная способность, число потоков...).
+// Отчёт — JSON: сведения о сборке и машине и массив results, по которому
+// сравниваются прогоны разных сборок.
+class BenchRunner {
+public:
+    // Замер выполняется, если его имя содержит хотя бы одну из подстрок
+    // filters; пустой список — все замеры
+    explicit BenchRunner(const QStringList &filters = QStringList());
+
+    bool isEnabled(const QString &name) const;
+
+    // warmup холостых вызовов f(), затем iterations замеренных
+    template <typename F>
+    void run(const QString &name, int iterations, F &&f, int warmup = 1,
+             const QJsonObject &extra = QJsonObject());
+    // Серия, которую замер собрал сам
+    void record(const QString &name, std::vector<qint64> samplesNs,
+                const QJsonObject &extra = QJsonObject());
+
+    void setMeta(const QString &key, const QJsonValue &value) { m_meta.insert(key, value); }
+    QJsonObject toJson() const;
+    // "-" — в stdout
+    bool writeJson(const QString &filePath) const;
+
+private:
+    QStringList m_filters;
+    QJsonObject m_meta;
+    QJsonArray m_results;
+};
+
+template <typename F>
+void BenchRunner::run(const QString &name, int iterations, F &&f, int warmup, const QJsonObject &extra)
+{
+    if (!isEnabled(name))
+        return;
+    for (int i = 0; i < warmup; ++i)
+        f();
+
+    std::vector<qint64> samples;
+    samples.reserve(size_t(iterations));
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; ++i) {
+        timer.start();
+        f();
+        samples.push_back(timer.nsecsElapsed());
+    }
+    record(name, std::move(samples), extra);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include "SyntheticMidi.h"
+#include <QDebug>
+#include <QFile>
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Event {
+    quint32 tick;
+    quint8  order;     // при равном тике: 0 (note-off, педаль, мета) раньше 1 (note-on)
+    quint8  bytes[8];
+    quint8  length;
+};
+
+Event makeEvent(quint32 tick, quint8 order, std::initializer_list<quint8> bytes)
+{
+    Event ev{ tick, order, {}, quint8(bytes.size()) };
+    std::copy(bytes.begin(), bytes.end(), ev.bytes);
+    return ev;
+}
+
+void appendVlq(QByteArray &out, quint32 value)
+{
+    quint8 buffer[5];
+    int n = 0;
+    buffer[n++] = value & 0x7F;
+    while (value >>= 7)
+        buffer[n++] = quint8(0x80 | (value & 0x7F));
+    while (n > 0)
+        out.append(char(buffer[--n]));
+}
+
+void appendBigEndian(QByteArray &out, quint32 value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+        out.append(char((value >> (8 * i)) & 0xFF));
+}
+
+void appendTrack(QByteArray &out, std::vector<Event> &events)
+{
+    std::stable_sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.tick != b.tick ? a.tick < b.tick : a.order < b.order;
+    });
+
+    QByteArray data;
+    quint32 last = 0;
+    for (const Event &ev : events) {
+        appendVlq(data, ev.tick - last);
+        data.append(reinterpret_cast<const char *>(ev.bytes), ev.length);
+        last = ev.tick;
+    }
+    data.append("\x00\xFF\x2F\x00", 4);
+
+    out.append("MTrk", 4);
+    appendBigEndian(out, quint32(data.size()), 4);
+    out.append(data);
+}
+
+} // namespace
+
+SyntheticMidi::Params SyntheticMidi::effective(const Params &params)
+{
+    Params p = params;
+    p.trackCount = qBound(1, params.trackCount, MaxTracks);
+    p.ppq = qMax(24, params.ppq);
+    p.polyphony = qBound(1, params.polyphony, 88 / p.trackCount);
+    return p;
+}
+
+bool SyntheticMidi::validate(const Params &params)
+{
+    if (params.trackCount < 1 || params.trackCount > MaxTracks) {
+        qWarning() << "SyntheticMidi: trackCount" << params.trackCount
+                   << "is out of range, expected 1 to" << MaxTracks;
+        return false;
+    }
+    return true;
+}
+
+QByteArray SyntheticMidi::generate(const Params &params)
+{
+    // Только сырой выход mt19937: распределения стандартной библиотеки
+    // на разных платформах дают разные числа
+    std::mt19937 rng(params.seed);
+    auto between = [&rng](int lo, int hi) { return lo + int(rng() % quint32(hi - lo + 1)); };
+
+    const Params p = effective(params);
+    const int trackCount = p.trackCount;
+    const int ppq = p.ppq;
+    const int bandWidth = 88 / trackCount;
+    const int polyphony = p.polyphony;
+
+    std::vector<std::vector<Event>> tracks(static_cast<size_t>(trackCount));
+    quint32 songEnd = 0;
+    for (int k = 0; k < trackCount; ++k) {
+        std::vector<Event> &events = tracks[k];
+        const quint8 channel = quint8(k < 9 ? k : k + 1);   // 10-й канал — ударные
+        const int lowPitch = 21 + k * bandWidth;
+        const int highPitch = lowPitch + bandWidth - 1;
+        int notesLeft = params.noteCount / trackCount + (k < params.noteCount % trackCount ? 1 : 0);
+        events.reserve(size_t(2 * notesLeft + 64));
+
+        quint32 tick = 0;
+        while (notesLeft > 0) {
+            // Аккорд из разных высот своего диапазона
+            std::array<bool, 128> taken{};
+            const int chord = qMin(polyphony, notesLeft);
+            for (int i = 0; i < chord; ++i) {
+                int pitch = between(lowPitch, highPitch);
+                while (taken[pitch])
+                    pitch = pitch == highPitch ? lowPitch : pitch + 1;
+                taken[pitch] = true;
+                const quint32 length = quint32(between(ppq / 8, 2 * ppq));
+                events.push_back(makeEvent(tick, 1, { quint8(0x90 | channel), quint8(pitch),
+                                                      quint8(between(40, 110)) }));
+                events.push_back(makeEvent(tick + length, 0, { quint8(0x80 | channel), quint8(pitch), 0 }));
+                songEnd = qMax(songEnd, tick + length);
+            }
+            notesLeft -= chord;
+            tick += quint32(between(ppq / 8, ppq / 2));
+        }
+
+        // Педаль: нажата весь такт, снимается перед следующим
+        const quint32 bar = quint32(4 * ppq);
+        for (quint32 t = 0; t < tick; t += bar) {
+            events.push_back(makeEvent(t, 0, { quint8(0xB0 | channel), 64, 127 }));
+            events.push_back(makeEvent(t + bar - 1, 0, { quint8(0xB0 | channel), 64, 0 }));
+        }
+    }
+
+    // Дорожка 0: имя и темп — 120 BPM в начале и tempoChanges смен от 60 до 180
+    std::vector<Event> conductor;
+    conductor.push_back(makeEvent(0, 0, { 0xFF, 0x03, 0x05, 'B', 'e', 'n', 'c', 'h' }));
+    auto tempoEvent = [](quint32 tick, quint32 usPerQuarter) {
+        return makeEvent(tick, 0, { 0xFF, 0x51, 0x03, quint8(usPerQuarter >> 16),
+                                    quint8(usPerQuarter >> 8), quint8(usPerQuarter) });
+    };
+    conductor.push_back(tempoEvent(0, 500000));
+    for (int i = 1; i <= params.tempoChanges; ++i) {
+        const quint32 tick = quint32(quint64(songEnd) * quint64(i) / quint64(params.tempoChanges + 1));
+        conductor.push_back(tempoEvent(tick, quint32(60000000 / between(60, 180))));
+    }
+
+    QByteArray out;
+    out.append("MThd", 4);
+    appendBigEndian(out, 6, 4);
+    appendBigEndian(out, 1, 2);
+    appendBigEndian(out, quint32(trackCount + 1), 2);
+    appendBigEndian(out, quint32(ppq), 2);
+    appendTrack(out, conductor);
+    for (std::vector<Event> &events : tracks)
+        appendTrack(out, events);
+    return out;
+}
+
+bool SyntheticMidi::writeFile(const QString &filePath, const Params &params)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "SyntheticMidi: cannot write" << filePath;
+        return false;
+    }
+    const QByteArray data = generate(params);
+    if (file.write(data) != data.size()) {
+        qWarning() << "SyntheticMidi: cannot write" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
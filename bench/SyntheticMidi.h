@@ -0,0 +1,41 @@
+// SyntheticMidi.h
+#ifndef SYNTHETICMIDI_H
+#define SYNTHETICMIDI_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+// Детерминированный генератор SMF для замеров. Формат 1: дорожка 0 —
+// имя песни и смены темпа, дальше trackCount дорожек с нотами. Каждая
+// дорожка — своя «рука»: свой канал и свой диапазон высот, аккорды
+// по polyphony нот, педаль раз в такт. Один и тот же seed даёт
+// байт в байт тот же файл на любой платформе (std::mt19937 без
+// распределений стандартной библиотеки).
+class SyntheticMidi {
+public:
+    // Каналов 16, но 10-й — ударные
+    static constexpr int MaxTracks = 15;
+
+    struct Params {
+        int noteCount = 100000;
+        int polyphony = 4;      // нот в аккорде
+        int tempoChanges = 16;  // равномерно по песне
+        int trackCount = 2;     // дорожек с нотами, 1..MaxTracks
+        int ppq = 480;
+        quint32 seed = 1;
+    };
+
+    // Параметры, с которыми generate() построит файл на самом деле:
+    // polyphony не шире диапазона дорожки, ppq не меньше 24
+    static Params effective(const Params &params);
+    // false — trackCount вне 1..MaxTracks (qWarning с причиной)
+    static bool validate(const Params &params);
+
+    // Невалидный trackCount приводится к ближайшему допустимому
+    static QByteArray generate(const Params &params);
+    // false — файл не записан (qWarning с причиной)
+    static bool writeFile(const QString &filePath, const Params &params);
+};
+
+#endif
@@ -0,0 +1,603 @@
+// piano_bench: замеры горячих путей без окна и без звуковой карты.
+// Песня генерируется SyntheticMidi (или берётся --midi), виджеты рисуются
+// в QImage на платформе offscreen, результат — JSON (см. BenchRunner).
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QStandardPaths>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include "BenchRunner.h"
+#include "MidiInput.h"
+#include "MidiParser.h"
+#include "MidiPlayer.h"
+#include "PerformanceGrader.h"
+#include "PianoKeyboardWidget.h"
+#include "PianoRollWidget.h"
+#include "RollRasterizer.h"
+#include "Song.h"
+#include "SongCache.h"
+#include "SongOverviewWidget.h"
+#include "SpscRing.h"
+#include "SynthEngine.h"
+#include "SyntheticMidi.h"
+
+namespace {
+
+constexpr int RollWidth = 1280;
+constexpr int RollHeight = 720;
+constexpr int KeyboardHeight = 120;
+constexpr qint64 FrameMs = 16;   // шаг времени между кадрами ролла
+
+SongPtr loadSong(const QString &filePath, bool useCache)
+{
+    MidiParser parser;
+    parser.setUseCache(useCache);
+    if (!parser.parseFile(filePath))
+        return nullptr;
+    QVector<Song::Track> tracks;
+    for (const QString &name : parser.getTrackNames())
+        tracks.append(Song::Track{ name });
+    return Song::create(filePath, parser.takeNotes(), parser.getTempoMap(), parser.getControls(),
+                        parser.getDuration(), tracks, parser.getFormat(), parser.getParseStats(), true);
+}
+
+// Одни и те же позиции в каждом прогоне
+std::vector<qint64> randomPositions(qint64 durationMs, int count, quint32 seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<qint64> positions(static_cast<size_t>(count));
+    for (qint64 &p : positions)
+        p = qint64(rng() % quint32(qMax<qint64>(durationMs, 1)));
+    return positions;
+}
+
+// Игра ученика по нотам песни в формате записи MidiInput::takeRecording
+// (timeNs — от начала песни): разброс ±120 мс, каждая 20-я нота
+// пропущена, каждая 30-я — соседняя клавиша
+std::vector<MidiEvent> simulatedPerformance(const NoteStore &notes, quint32 seed)
+{
+    std::mt19937 rng(seed);
+    std::vector<MidiEvent> events;
+    events.reserve(size_t(notes.size()));
+    for (int i = 0; i < notes.size(); ++i) {
+        const quint32 roll = rng() % 60;
+        if (roll % 20 == 0)
+            continue;
+        const int pitch = notes.pitch(i) + (roll == 1 ? 1 : 0);
+        const qint64 ms = qMax<qint64>(0, qint64(notes.startTime(i)) + qint64(rng() % 241) - 120);
+        events.push_back(MidiEvent::noteOn(ms * 1000000, pitch, notes.velocity(i)));
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const MidiEvent &a, const MidiEvent &b) { return a.timeNs < b.timeNs; });
+    return events;
+}
+
+// Виджет, который рисуется только в QImage: без окна на экране,
+// но с настоящей геометрией и событиями изменения размера
+void showOffscreen(QWidget &widget, int width, int height)
+{
+    widget.setAttribute(Qt::WA_DontShowOnScreen);
+    widget.resize(width, height);
+    widget.show();
+    QCoreApplication::processEvents();
+}
+
+// Разбор корпуса: холодный (SongCache выключен) и из кэша, по каждому
+// файлу и в сумме. Итерация суммарного замера — весь корпус подряд,
+// так что «parse/cold» и «parse/cached» сравнимы между прогонами с тем
+// же корпусом; по файлу — «parse/cold/<имя>».
+void benchParseCorpus(BenchRunner &runner, const QString &mode, const QStringList &files,
+                      int iterations, bool useCache)
+{
+    const QString total = QString("parse/%1").arg(mode);
+    std::vector<qint64> sums(size_t(iterations), 0);
+    qint64 totalBytes = 0;
+    qint64 totalNotes = 0;
+    for (const QString &filePath : files) {
+        const QString name = total + "/" + QFileInfo(filePath).fileName();
+        if (!runner.isEnabled(name) && !runner.isEnabled(total))
+            continue;
+
+        // Холостой разбор: прогрев, а для кэша — его запись
+        MidiParser first;
+        first.setUseCache(useCache);
+        if (!first.parseFile(filePath)) {
+            qWarning() << "piano_bench: cannot parse" << filePath;
+            continue;
+        }
+        const qint64 bytes = QFileInfo(filePath).size();
+        const int notes = first.getNotes().size();
+        totalBytes += bytes;
+        totalNotes += notes;
+
+        std::vector<qint64> samples;
+        samples.reserve(size_t(iterations));
+        QElapsedTimer timer;
+        for (int i = 0; i < iterations; ++i) {
+            timer.start();
+            MidiParser parser;
+            parser.setUseCache(useCache);
+            parser.parseFile(filePath);
+            samples.push_back(timer.nsecsElapsed());
+            sums[size_t(i)] += samples.back();
+        }
+        if (runner.isEnabled(name))
+            runner.record(name, std::move(samples), QJsonObject{ { "bytes", bytes }, { "notes", notes } });
+    }
+
+    if (totalBytes > 0 && runner.isEnabled(total)) {
+        runner.record(total, std::move(sums), QJsonObject{
+            { "files", int(files.size()) },
+            { "bytes", totalBytes },
+            { "notes", totalNotes },
+        });
+    }
+}
+
+void benchParse(BenchRunner &runner, const QString &filePath, const QStringList &corpus)
+{
+    benchParseCorpus(runner, "cold", corpus, 5, false);
+    benchParseCorpus(runner, "cached", corpus, 20, true);
+
+    if (!runner.isEnabled("song/create"))
+        return;
+    // Расписание, точки перемотки, карта плотности и дорожки поверх готовых нот
+    MidiParser warm;
+    warm.parseFile(filePath);
+    runner.run("song/create", 10, [&]() {
+        NoteStore notes = warm.getNotes();   // копия кэшированных нот делит отображение
+        Song::create(filePath, std::move(notes), warm.getTempoMap(), warm.getControls(),
+                     warm.getDuration(), QVector<Song::Track>(), warm.getFormat(),
+                     warm.getParseStats(), true);
+    });
+}
+
+// Файлы корпуса: каталоги раскрываются в *.mid / *.midi по имени
+QStringList corpusFiles(const QStringList &paths)
+{
+    QStringList files;
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (!info.isDir()) {
+            files << path;
+            continue;
+        }
+        const QFileInfoList entries = QDir(path).entryInfoList({ "*.mid", "*.midi" },
+                                                               QDir::Files, QDir::Name);
+        for (const QFileInfo &entry : entries)
+            files << entry.filePath();
+    }
+    return files;
+}
+
+// count синтетических файлов от noteCount / count до noteCount нот,
+// каждый со своим seed
+QStringList syntheticCorpus(const QTemporaryDir &dir, const SyntheticMidi::Params &params, int count)
+{
+    QStringList files;
+    for (int i = 1; i <= count; ++i) {
+        SyntheticMidi::Params p = params;
+        p.noteCount = qMax(1, int(qint64(params.noteCount) * i / count));
+        p.seed = params.seed + quint32(i);
+        const QString filePath = dir.filePath(QString("corpus-%1.mid").arg(i, 3, 10, QChar('0')));
+        if (SyntheticMidi::writeFile(filePath, p))
+            files << filePath;
+    }
+    return files;
+}
+
+void benchSeek(BenchRunner &runner, const SongPtr &song)
+{
+    const std::vector<qint64> positions = randomPositions(song->durationMs(), 2000, 17);
+    size_t next = 0;
+    NoteEventCursor cursor;
+    ControllerState state;
+    runner.run("seek/checkpoint", int(positions.size()), [&]() {
+        const quint32 ms = quint32(positions[next++ % positions.size()]);
+        cursor.seek(song->schedule(), song->notes(), song->seekIndex(), ms);
+        state = song->controllersAt(ms);
+    });
+}
+
+void benchPlayer(BenchRunner &runner, const SongPtr &song)
+{
+    // Без синтезатора: замеряется сам плеер и его секвенсор
+    MidiPlayer player;
+    player.setSong(song);
+
+    // Перемотка вместе с восстановлением нажатых клавиш (resyncKeyState)
+    const std::vector<qint64> positions = randomPositions(song->durationMs(), 500, 29);
+    size_t next = 0;
+    runner.run("player/setPosition", int(positions.size()), [&]() {
+        player.setPosition(positions[next++ % positions.size()]);
+    });
+}
+
+void benchTimerTick(BenchRunner &runner, const SongPtr &song)
+{
+    if (!runner.isEnabled("player/timerTick") && !runner.isEnabled("player/setTrackMasks"))
+        return;
+
+    MidiPlayer player;
+    player.setSong(song);
+    player.setPosition(song->durationMs() / 4);
+    player.setSpeedPercent(200);
+    player.play();
+
+    // Кадр плеера во время игры: разбор кольца GUI-событий и снимок клавиш.
+    // Между кадрами — реальная пауза, чтобы секвенсор успел раздать события.
+    const int sleepMs = 4;
+    std::vector<qint64> samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < 500; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+        timer.start();
+        QMetaObject::invokeMethod(&player, "onTimerTick", Qt::DirectConnection);
+        samples.push_back(timer.nsecsElapsed());
+    }
+    runner.record("player/timerTick", std::move(samples),
+                  QJsonObject{ { "sleepMs", sleepMs }, { "speedPercent", 200 } });
+
+    // Выключение и включение дорожки на ходу
+    const quint64 present = song->notes().presentTracks();
+    if (qPopulationCount(present) > 1) {
+        const quint64 firstTrack = present & (~present + 1);
+        int i = 0;
+        runner.run("player/setTrackMasks", 200, [&]() {
+            const quint64 mask = (i++ & 1) ? NoteStore::AllTracks : ~firstTrack;
+            player.setTrackMasks(mask, mask);
+        });
+    }
+    player.stop();
+}
+
+void benchRing(BenchRunner &runner)
+{
+    if (!runner.isEnabled("ring/spsc"))
+        return;
+
+    // Писатель и читатель в разных потоках; полный буфер — писатель ждёт
+    constexpr int EventsPerRound = 1 << 20;
+    std::vector<qint64> samples;
+    for (int round = 0; round < 6; ++round) {
+        SpscRing<MidiEvent> ring(4096);
+        QElapsedTimer timer;
+        timer.start();
+        std::thread reader([&ring]() {
+            MidiEvent ev;
+            for (int received = 0; received < EventsPerRound;) {
+                if (ring.pop(ev))
+                    ++received;
+            }
+        });
+        for (int i = 0; i < EventsPerRound; ++i) {
+            const MidiEvent ev = MidiEvent::noteOn(i, i & 127, 100);
+            while (!ring.push(ev)) {}
+        }
+        reader.join();
+        if (round > 0)   // первый круг — прогрев
+            samples.push_back(timer.nsecsElapsed());
+    }
+    runner.record("ring/spsc", std::move(samples), QJsonObject{ { "eventsPerIteration", EventsPerRound } });
+}
+
+void benchInput(BenchRunner &runner)
+{
+    if (!runner.isEnabled("input/loopback"))
+        return;
+
+    // Нажатие через loopback-вход: поток ввода, кольцо и пробуждение
+    // GUI-потока до сигнала eventReceived
+    MidiInput input;
+    LoopbackMidiInput *loopback = input.openLoopback();
+    if (!loopback)
+        return;
+    bool received = false;
+    QObject::connect(&input, &MidiInput::eventReceived, [&received](const MidiInputEvent &) {
+        received = true;
+    });
+
+    int i = 0;
+    runner.run("input/loopback", 1000, [&]() {
+        received = false;
+        loopback->inject(MidiEvent::noteOn(0, 21 + i++ % 88, 100));
+        while (!received)
+            QCoreApplication::processEvents();
+    }, 20);
+}
+
+void benchGrading(BenchRunner &runner, const SongPtr &song)
+{
+    if (!runner.isEnabled("grade/replay") && !runner.isEnabled("grade/noteOn"))
+        return;
+
+    const std::vector<MidiEvent> performance = simulatedPerformance(song->notes(), 11);
+    PerformanceGrader grader;
+    grader.setSong(song);
+    const qint64 endMs = song->durationMs() + grader.tolerances().windowMs + 1;
+    auto replay = [&]() {
+        grader.restart(0);
+        for (const MidiEvent &e : performance)
+            grader.noteOn(e.data1, e.timeNs / 1000000);
+        grader.advance(endMs);
+    };
+
+    // Прогон до замера — заодно итог оценки для отчёта
+    replay();
+    const PerformanceGrader::Stats stats = grader.stats();
+    runner.run("grade/replay", 20, replay, 1, QJsonObject{
+        { "events", int(performance.size()) },
+        { "accuracy", stats.accuracy() },
+        { "hit", stats.hit },
+        { "missed", stats.missed },
+        { "wrong", stats.wrong },
+    });
+
+    // Цена одного нажатия: время пачки из Chunk нажатий / Chunk
+    if (!runner.isEnabled("grade/noteOn"))
+        return;
+    constexpr int Chunk = 64;
+    std::vector<qint64> samples;
+    samples.reserve(performance.size() / Chunk + 1);
+    grader.restart(0);
+    QElapsedTimer timer;
+    for (size_t first = 0; first + Chunk <= performance.size(); first += Chunk) {
+        timer.start();
+        for (size_t i = first; i < first + Chunk; ++i)
+            grader.noteOn(performance[i].data1, performance[i].timeNs / 1000000);
+        samples.push_back(timer.nsecsElapsed() / Chunk);
+    }
+    runner.record("grade/noteOn", std::move(samples), QJsonObject{ { "eventsPerSample", 1 } });
+}
+
+void benchSynth(BenchRunner &runner)
+{
+    constexpr int Frames = 256;
+    std::vector<float> out(2 * Frames);
+    for (int voices : { 1, 8, 32, SynthEngine::MaxVoices }) {
+        const QString name = QString("synth/voices_%1").arg(voices);
+        if (!runner.isEnabled(name))
+            continue;
+        // Новый движок на каждую серию: голоса прошлой не мешают
+        SynthEngine synth(48000);
+        for (int i = 0; i < voices; ++i)
+            synth.noteOn(21 + i, 100);
+        runner.run(name, 400, [&]() { synth.render(out.data(), Frames); }, 8,
+                   QJsonObject{ { "voices", voices }, { "frames", Frames }, { "sampleRate", 48000 } });
+    }
+}
+
+void benchRasterizer(BenchRunner &runner, const SongPtr &song)
+{
+    // Ролл во весь экран: клавиши 1920 / 88, 8 секунд по высоте
+    const QSize size(1920, 1080);
+    std::array<int, 128> keyX{};
+    std::array<int, 128> keyWidth{};
+    for (int pitch = 21; pitch <= 108; ++pitch) {
+        keyX[pitch] = (pitch - 21) * size.width() / 88;
+        keyWidth[pitch] = (pitch - 20) * size.width() / 88 - keyX[pitch];
+    }
+
+    RollRasterizer::Params params;
+    params.notes    = &song->notes();
+    params.keyX     = &keyX;
+    params.keyWidth = &keyWidth;
+    params.pxPerMs  = double(size.height()) / 8000.0;
+    params.topPx    = std::llround(double(song->durationMs() / 2 + 8000) * params.pxPerMs);
+    params.color    = qPremultiply(qRgb(0, 188, 212));
+
+    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    RollRasterizer rasterizer;
+    const int maxThreads = QThreadPool::globalInstance()->maxThreadCount() + 1;
+    for (int threads = 1;; threads = qMin(threads * 2, maxThreads)) {
+        rasterizer.setMaxThreads(threads);
+        runner.run(QString("raster/threads_%1").arg(threads), 30, [&]() {
+            image.fill(Qt::transparent);
+            rasterizer.render(image, params);
+        }, 2, QJsonObject{ { "threads", threads }, { "width", size.width() }, { "height", size.height() } });
+        if (threads == maxThreads)
+            break;
+    }
+}
+
+void benchWidgets(BenchRunner &runner, const SongPtr &song)
+{
+    PianoKeyboardWidget keyboard;
+    showOffscreen(keyboard, RollWidth, KeyboardHeight);
+    PianoRollWidget roll;
+    roll.setKeyboard(&keyboard);
+    roll.setSong(song);
+    showOffscreen(roll, RollWidth, RollHeight);
+
+    const QJsonObject rollSize{ { "width", RollWidth }, { "height", RollHeight } };
+    QImage rollImage(roll.size(), QImage::Format_ARGB32_Premultiplied);
+    const qint64 start = song->durationMs() / 2;
+
+    // Прокрутка с шагом кадра 60 Гц: тайлы в основном из кэша
+    qint64 t = start;
+    runner.run("roll/frame", 600, [&]() {
+        roll.setCurrentTime(t += FrameMs);
+        roll.render(&rollImage);
+    }, 10, rollSize);
+
+    // Тот же кадр с HUD производительности: разница — цена HUD
+    roll.setHudVisible(true);
+    runner.run("roll/frame_hud", 600, [&]() {
+        roll.setCurrentTime(t += FrameMs);
+        roll.render(&rollImage);
+    }, 10, rollSize);
+    roll.setHudVisible(false);
+
+    // Каждый кадр — с пустым кэшем тайлов (смена песни)
+    runner.run("roll/frame_cold", 20, [&]() {
+        roll.setSong(song);
+        roll.render(&rollImage);
+    }, 1, rollSize);
+
+    // Одна дорожка скрыта: тайлы по нотам видимых дорожек
+    const quint64 present = song->notes().presentTracks();
+    if (qPopulationCount(present) > 1) {
+        roll.setVisibleTracks(~(present & (~present + 1)));
+        runner.run("roll/frame_cold_track_hidden", 20, [&]() {
+            roll.setSong(song);
+            roll.render(&rollImage);
+        }, 1, rollSize);
+        roll.setVisibleTracks(NoteStore::AllTracks);
+    }
+
+    // Клавиатура: на каждый кадр меняется аккорд
+    QImage keyboardImage(keyboard.size(), QImage::Format_ARGB32_Premultiplied);
+    KeyStateFrame previous;
+    int frame = 0;
+    runner.run("keyboard/frame", 600, [&]() {
+        KeyStateFrame state;
+        for (int i = 0; i < 6; ++i)
+            state.press(21 + (frame * 7 + i * 13) % 88, 100);
+        ++frame;
+        state.diffFrom(previous);
+        previous = state;
+        keyboard.applyKeyState(state);
+        keyboard.render(&keyboardImage);
+    }, 10, QJsonObject{ { "width", RollWidth }, { "height", KeyboardHeight } });
+
+    // Обзор песни: построение картинки и кадр с линией позиции
+    SongOverviewWidget overview;
+    showOffscreen(overview, RollWidth, 40);
+    QImage overviewImage(overview.size(), QImage::Format_ARGB32_Premultiplied);
+    runner.run("overview/build", 20, [&]() {
+        overview.setSong(song);
+        overview.render(&overviewImage);
+    });
+    t = start;
+    runner.run("overview/frame", 600, [&]() {
+        overview.setPosition(t += FrameMs);
+        overview.render(&overviewImage);
+    }, 10);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // Без дисплея: виджеты рисуются только в QImage
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    app.setApplicationName("piano_bench");
+    // Кэш песен — во временном каталоге Qt, а не в кэше пользователя
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineParser cli;
+    cli.setApplicationDescription("Замеры горячих путей Piano Platform, результат в JSON");
+    cli.addHelpOption();
+    const SyntheticMidi::Params defaults;
+    QCommandLineOption notesOption("notes", "Нот в синтетической песне.", "count", QString::number(defaults.noteCount));
+    QCommandLineOption polyphonyOption("polyphony", "Нот в аккорде.", "count", QString::number(defaults.polyphony));
+    QCommandLineOption tempoOption("tempo-changes", "Смен темпа.", "count", QString::number(defaults.tempoChanges));
+    QCommandLineOption tracksOption("tracks", "Дорожек с нотами.", "count", QString::number(defaults.trackCount));
+    QCommandLineOption seedOption("seed", "Зерно генератора.", "seed", QString::number(defaults.seed));
+    QCommandLineOption midiOption("midi", "Готовый MIDI-файл вместо синтетического.", "file");
+    QCommandLineOption corpusOption("corpus", "Корпус для замеров разбора: файл или каталог (можно несколько раз).", "path");
+    QCommandLineOption corpusSizeOption("corpus-synthetic", "Корпус из count синтетических файлов разного размера.", "count");
+    QCommandLineOption outputOption({ "o", "output" }, "Файл результатов JSON, '-' — stdout.", "file", "piano_bench.json");
+    QCommandLineOption filterOption({ "f", "filter" }, "Только замеры, имя которых содержит подстроку (можно несколько раз).", "text");
+    cli.addOptions({ notesOption, polyphonyOption, tempoOption, tracksOption, seedOption,
+                     midiOption, corpusOption, corpusSizeOption, outputOption, filterOption });
+    cli.process(app);
+
+    SyntheticMidi::Params midi;
+    midi.noteCount    = cli.value(notesOption).toInt();
+    midi.polyphony    = cli.value(polyphonyOption).toInt();
+    midi.tempoChanges = cli.value(tempoOption).toInt();
+    midi.trackCount   = cli.value(tracksOption).toInt();
+    midi.seed         = cli.value(seedOption).toUInt();
+    if (!SyntheticMidi::validate(midi))
+        return 1;
+
+    QTemporaryDir dir;
+    QString filePath = cli.value(midiOption);
+    if (filePath.isEmpty()) {
+        filePath = dir.filePath("synthetic.mid");
+        if (!dir.isValid() || !SyntheticMidi::writeFile(filePath, midi))
+            return 1;
+    }
+
+    const SongPtr song = loadSong(filePath, false);
+    if (!song) {
+        qWarning() << "piano_bench: cannot parse" << filePath;
+        return 1;
+    }
+
+    BenchRunner runner(cli.values(filterOption));
+    runner.setMeta("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    runner.setMeta("qt", QString(qVersion()));
+    runner.setMeta("os", QSysInfo::prettyProductName());
+    runner.setMeta("cpu", QSysInfo::currentCpuArchitecture());
+    runner.setMeta("threads", QThread::idealThreadCount());
+#ifdef NDEBUG
+    runner.setMeta("build", "release");
+#else
+    runner.setMeta("build", "debug");
+#endif
+    runner.setMeta("song", QJsonObject{
+        { "file", cli.isSet(midiOption) ? QFileInfo(filePath).fileName() : QString("synthetic") },
+        { "bytes", QFileInfo(filePath).size() },
+        { "notes", song->notes().size() },
+        { "durationMs", song->durationMs() },
+        { "tracks", int(qPopulationCount(song->notes().presentTracks())) },
+    });
+    if (!cli.isSet(midiOption)) {
+        // То, с чем файл построен на самом деле, а не что просили
+        const SyntheticMidi::Params used = SyntheticMidi::effective(midi);
+        runner.setMeta("generator", QJsonObject{
+            { "notes", used.noteCount },
+            { "polyphony", used.polyphony },
+            { "tempoChanges", used.tempoChanges },
+            { "tracks", used.trackCount },
+            { "ppq", used.ppq },
+            { "seed", qint64(used.seed) },
+        });
+    }
+
+    // Без корпуса разбор меряется на самой песне
+    QStringList corpus = corpusFiles(cli.values(corpusOption));
+    if (cli.isSet(corpusSizeOption))
+        corpus += syntheticCorpus(dir, midi, qMax(1, cli.value(corpusSizeOption).toInt()));
+    if (corpus.isEmpty())
+        corpus << filePath;
+    runner.setMeta("corpus", QJsonObject{
+        { "files", int(corpus.size()) },
+        { "synthetic", cli.isSet(corpusSizeOption) ? cli.value(corpusSizeOption).toInt() : 0 },
+    });
+
+    benchParse(runner, filePath, corpus);
+    benchSeek(runner, song);
+    benchPlayer(runner, song);
+    benchTimerTick(runner, song);
+    benchRing(runner);
+    benchInput(runner);
+    benchGrading(runner, song);
+    benchSynth(runner);
+    benchRasterizer(runner, song);
+    benchWidgets(runner, song);
+
+    QFile::remove(SongCache::cacheFilePath(filePath));
+    for (const QString &path : corpus)
+        QFile::remove(SongCache::cacheFilePath(path));
+    return runner.writeJson(cli.value(outputOption)) ? 0 : 1;
+}
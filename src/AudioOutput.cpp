@@ -0,0 +1,134 @@
+#include "AudioOutput.h"
+#include "Trace.h"
+#include <QAudioDevice>
+#include <QAudioSink>
+#include <QMediaDevices>
+#include <QDebug>
+#include <algorithm>
+
+SynthAudioDevice::SynthAudioDevice(SynthEngine *synth, const QAudioFormat &format, QObject *parent)
+    : QIODevice(parent),
+      m_synth(synth),
+      m_format(format)
+{
+    if (m_format.sampleFormat() != QAudioFormat::Float)
+        m_scratch.resize(size_t(ScratchFrames) * 2);
+}
+
+qint64 SynthAudioDevice::bytesAvailable() const
+{
+    // Генератор бесконечен: всегда «есть» хотя бы секунда звука
+    return qint64(m_format.sampleRate()) * m_format.bytesPerFrame() + QIODevice::bytesAvailable();
+}
+
+qint64 SynthAudioDevice::readData(char *data, qint64 maxlen)
+{
+    // Поток вывода заводит QAudioSink — первый вызов на нём и есть его старт
+    static thread_local const bool named = (Trace::setThreadName("audio"), true);
+    Q_UNUSED(named);
+    PIANO_TRACE_ZONE("SynthAudioDevice::readData");
+    const int bytesPerFrame = m_format.bytesPerFrame();
+    if (bytesPerFrame <= 0)
+        return 0;
+    const int frames = int(maxlen / bytesPerFrame);
+    if (frames <= 0)
+        return 0;
+
+    if (m_format.sampleFormat() == QAudioFormat::Float) {
+        m_synth->render(reinterpret_cast<float *>(data), frames);
+        return qint64(frames) * bytesPerFrame;
+    }
+
+    // Int16: рендерим кусками через заранее выделенный буфер
+    qint16 *out = reinterpret_cast<qint16 *>(data);
+    int done = 0;
+    while (done < frames) {
+        const int n = std::min(ScratchFrames, frames - done);
+        m_synth->render(m_scratch.data(), n);
+        for (int i = 0; i < n * 2; ++i)
+            out[2 * done + i] = qint16(m_scratch[i] * 32767.0f);
+        done += n;
+    }
+    return qint64(frames) * bytesPerFrame;
+}
+
+qint64 SynthAudioDevice::writeData(const char *data, qint64 len)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(len);
+    return -1;
+}
+
+AudioOutput::AudioOutput(QObject *parent)
+    : QObject(parent),
+      m_synth(std::make_unique<SynthEngine>())
+{
+}
+
+AudioOutput::~AudioOutput()
+{
+    stop();
+}
+
+bool AudioOutput::start()
+{
+    if (m_sink)
+        return true;
+
+    const QAudioDevice device = QMediaDevices::defaultAudioOutput();
+    if (device.isNull()) {
+        qWarning() << "AudioOutput: no audio output device";
+        return false;
+    }
+
+    QAudioFormat format;
+    format.setSampleRate(48000);
+    format.setChannelCount(2);
+    format.setSampleFormat(QAudioFormat::Float);
+    if (!device.isFormatSupported(format)) {
+        format.setSampleRate(device.preferredFormat().sampleRate());
+        format.setSampleFormat(QAudioFormat::Int16);
+        if (!device.isFormatSupported(format)) {
+            qWarning() << "AudioOutput: no supported stereo format on" << device.description();
+            return false;
+        }
+    }
+
+    m_synth->setSampleRate(format.sampleRate());
+
+    // Кольцо трассы для потока вывода — заранее, здесь: на нём самом
+    // setThreadName только заберёт готовое
+    Trace::reserveRing();
+    m_device = new SynthAudioDevice(m_synth.get(), format, this);
+    m_device->open(QIODevice::ReadOnly);
+
+    m_sink = new QAudioSink(device, format, this);
+    // ~20 ms буфера: компромисс между задержкой и риском опустошения
+    m_sink->setBufferSize(qsizetype(format.bytesPerFrame()) * format.sampleRate() / 50);
+    m_sink->start(m_device);
+
+    // Секвенсор отдаёт ноты заранее на весь буфер (с запасом), чтобы
+    // синтезатор успел поставить каждую на её отсчёт внутри блока
+    const qint64 bufferUs = qint64(m_sink->bufferSize()) * 1000000
+                          / (qint64(format.bytesPerFrame()) * format.sampleRate());
+    m_synth->setLookaheadUs(bufferUs + 5000);
+
+    qDebug() << "AudioOutput:" << device.description()
+             << "rate" << format.sampleRate()
+             << "float" << (format.sampleFormat() == QAudioFormat::Float);
+    return true;
+}
+
+void AudioOutput::stop()
+{
+    if (m_sink) {
+        m_sink->stop();
+        delete m_sink;
+        m_sink = nullptr;
+    }
+    if (m_device) {
+        m_device->close();
+        delete m_device;
+        m_device = nullptr;
+    }
+}
@@ -0,0 +1,54 @@
+// AudioOutput.h
+#ifndef AUDIOOUTPUT_H
+#define AUDIOOUTPUT_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QAudioFormat>
+#include <memory>
+#include <vector>
+#include "SynthEngine.h"
+
+class QAudioSink;
+
+// Источник для QAudioSink в pull-режиме: каждый readData() рендерит
+// синтезатор прямо в буфер устройства. Промежуточный буфер нужен только
+// если устройство не принимает float (тогда конвертируем в Int16).
+class SynthAudioDevice : public QIODevice {
+    Q_OBJECT
+public:
+    SynthAudioDevice(SynthEngine *synth, const QAudioFormat &format, QObject *parent = nullptr);
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    static constexpr int ScratchFrames = 4096;
+
+    SynthEngine *m_synth;
+    QAudioFormat m_format;
+    std::vector<float> m_scratch;   // только для Int16
+};
+
+class AudioOutput : public QObject {
+    Q_OBJECT
+public:
+    explicit AudioOutput(QObject *parent = nullptr);
+    ~AudioOutput();
+
+    bool start();
+    void stop();
+
+    SynthEngine *synth() const { return m_synth.get(); }
+
+private:
+    std::unique_ptr<SynthEngine> m_synth;
+    QAudioSink *m_sink = nullptr;
+    SynthAudioDevice *m_device = nullptr;
+};
+
+#endif
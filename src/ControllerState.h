@@ -0,0 +1,81 @@
+// ControllerState.h
+#ifndef CONTROLLERSTATE_H
+#define CONTROLLERSTATE_H
+
+#include <QtGlobal>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+// Событие контроллера из файла. Храним только то, что задаёт состояние
+// канала и поэтому восстанавливается при перемотке: громкость (CC7),
+// expression (CC11), педаль (CC64), сброс контроллеров (CC121)
+// и смену программы (псевдоконтроллер Program).
+struct ControlEvent {
+    enum : quint8 {
+        Volume     = 7,
+        Expression = 11,
+        Sustain    = 64,
+        ResetAll   = 121,
+        Program    = 128   // вне диапазона CC: value — номер программы
+    };
+
+    quint32 timeMs = 0;
+    quint8  channel = 0;
+    quint8  controller = 0;
+    quint8  value = 0;
+    quint8  reserved = 0;
+
+    static bool isTracked(int controller)
+    {
+        return controller == Volume || controller == Expression
+            || controller == Sustain || controller == ResetAll;
+    }
+};
+
+// Упорядочены по времени; в файле кэша лежат как есть
+using ControlEventList = std::vector<ControlEvent>;
+
+// Первое событие позже timeMs
+inline int controlUpperBound(const ControlEventList &events, quint32 timeMs)
+{
+    auto it = std::upper_bound(events.begin(), events.end(), timeMs,
+                               [](quint32 t, const ControlEvent &ev) { return t < ev.timeMs; });
+    return int(it - events.begin());
+}
+
+// Состояние контроллеров одного канала (значения по умолчанию — GM)
+struct ChannelState {
+    quint8 program = 0;
+    quint8 volume = 100;
+    quint8 expression = 127;
+    quint8 sustain = 0;
+
+    bool sustainOn() const { return sustain >= 64; }
+
+    void apply(int controller, int value)
+    {
+        switch (controller) {
+        case ControlEvent::Volume:     volume = quint8(value); break;
+        case ControlEvent::Expression: expression = quint8(value); break;
+        case ControlEvent::Sustain:    sustain = quint8(value); break;
+        case ControlEvent::Program:    program = quint8(value); break;
+        case ControlEvent::ResetAll:
+            // RP-015: громкость и программа сбросом не затрагиваются
+            expression = 127;
+            sustain = 0;
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+// Состояние всех 16 каналов на момент песни
+struct ControllerState {
+    std::array<ChannelState, 16> channels;
+
+    void apply(const ControlEvent &ev) { channels[ev.channel & 0x0F].apply(ev.controller, ev.value); }
+};
+
+#endif
@@ -0,0 +1,237 @@
+#include "DensityPyramid.h"
+#include <QtAlgorithms>
+#include <algorithm>
+
+void DensityPyramid::build(const NoteStore &notes, qint64 durationMs)
+{
+    m_levels.clear();
+    m_startPrefix.clear();
+    m_sounding.clear();
+    m_present = notes.presentTracks();
+    m_groupOffsets.clear();
+    m_groupStarts.clear();
+    m_groupEnds.clear();
+    if (notes.isEmpty())
+        return;
+
+    const quint64 spanMs = quint64(qMax<qint64>(durationMs, notes.endOfLastNote())) + 1;
+    const quint64 maxBins = quint64(qBound(MinBaseBins, notes.size() / NotesPerBin, MaxBaseBins));
+    m_baseBinMs = qMax<quint32>(MinBinMs, quint32((spanMs + maxBins - 1) / maxBins));
+    const int bins = int((spanMs + m_baseBinMs - 1) / m_baseBinMs);
+
+    // Корзин на каждом уровне: уровень L — корзины по 2^L корзин уровня 0
+    std::vector<int> levelBins(1, bins);
+    while (levelBins.back() > 1)
+        levelBins.push_back((levelBins.back() + 1) / 2);
+    const int levels = int(levelBins.size());
+    m_levels.resize(size_t(levels));
+    for (int level = 0; level < levels; ++level)
+        m_levels[size_t(level)].assign(size_t(levelBins[size_t(level)]) * 128, Cell());
+
+    // Нота — отрезок корзин уровня 0 [first, last]
+    const int count = notes.size();
+    auto binsOf = [this, &notes, bins](int i, int &first, int &last) {
+        const quint32 start = notes.startTime(i);
+        const quint32 end = qMax(notes.endTime(i), start + 1);
+        first = int(start / m_baseBinMs);
+        last = qMin(bins - 1, int((end - 1) / m_baseBinMs));
+    };
+
+    // Самая громкая velocity: отрезок ноты раскладывается на O(log) целых
+    // корзин разных уровней (как в дереве отрезков), метка ставится в них.
+    // Проход сверху вниз доводит метки предков до уровня 0; дальше
+    // крупная корзина — максимум по своим половинам.
+    //
+    // Число нот — без перебора корзин каждой ноты. Уровень 0 —
+    // разностный массив: +1 в корзине старта, -1 после корзины конца,
+    // префиксная сумма по корзинам. Крупная корзина c задевается нотами,
+    // звучащими в её первой половине, и нотами, начавшимися во второй:
+    // count'(c) = count(2c) + starts(2c + 1). Счётчики — с насыщением:
+    // ячейке всё равно хватает 255. Всего O(нот * log + ячеек).
+    const quint8 *pitches = notes.pitches();
+    const quint8 *velocities = notes.velocities();
+    auto saturatedAdd = [](quint16 &counter, int value) {
+        counter = quint16(qMin(0xFFFF, int(counter) + value));
+    };
+    std::vector<quint16> starts(size_t(bins) * 128, 0);
+    std::vector<quint16> ends(size_t(bins) * 128, 0);
+    m_startPrefix.assign(size_t(bins) + 1, 0);
+    for (int i = 0; i < count; ++i) {
+        const quint8 pitch = pitches[i];
+        const quint8 velocity = velocities[i];
+        int first, last;
+        binsOf(i, first, last);
+        saturatedAdd(starts[size_t(first) * 128 + pitch], 1);
+        saturatedAdd(ends[size_t(last) * 128 + pitch], 1);
+        ++m_startPrefix[size_t(first) + 1];
+
+        int lo = first;
+        int hi = last + 1;
+        for (int level = 0; lo < hi; ++level, lo >>= 1, hi >>= 1) {
+            Cell *cells = m_levels[size_t(level)].data();
+            if (lo & 1) {
+                quint8 &v = cells[size_t(lo++) * 128 + pitch].maxVelocity;
+                v = std::max(v, velocity);
+            }
+            if (hi & 1) {
+                quint8 &v = cells[size_t(--hi) * 128 + pitch].maxVelocity;
+                v = std::max(v, velocity);
+            }
+        }
+    }
+    for (int b = 0; b < bins; ++b)
+        m_startPrefix[size_t(b) + 1] += m_startPrefix[b];
+
+    // Метки предков — вниз до уровня 1; уровень 0 берёт их в своём проходе
+    for (int level = levels - 2; level >= 1; --level) {
+        const Cell *coarse = m_levels[size_t(level) + 1].data();
+        Cell *fine = m_levels[size_t(level)].data();
+        for (size_t c = 0; c < m_levels[size_t(level)].size(); ++c)
+            fine[c].maxVelocity = std::max(fine[c].maxVelocity, coarse[(c / 256) * 128 + c % 128].maxVelocity);
+    }
+
+    m_sounding.assign(size_t(bins), 0);
+    qint32 running[128] = {};
+    Cell *base = m_levels[0].data();
+    const Cell *parent = levels > 1 ? m_levels[1].data() : nullptr;
+    for (int b = 0; b < bins; ++b) {
+        const size_t row = size_t(b) * 128;
+        const Cell *up = parent ? parent + size_t(b / 2) * 128 : nullptr;
+        quint32 sounding = 0;
+        for (int pitch = 0; pitch < 128; ++pitch) {
+            running[pitch] += starts[row + pitch];
+            Cell &cell = base[row + pitch];
+            cell.count = quint8(qBound(0, running[pitch], 255));
+            if (up)
+                cell.maxVelocity = std::max(cell.maxVelocity, up[pitch].maxVelocity);
+            sounding += quint32(qMax(0, running[pitch]));
+            running[pitch] -= ends[row + pitch];
+        }
+        m_sounding[size_t(b)] = sounding;
+    }
+    ends = std::vector<quint16>();
+
+    // Уровни вверх; starts пересчитываются на месте — ячейка c читает 2c и 2c + 1
+    for (int level = 1; level < levels; ++level) {
+        const int fineBins = levelBins[size_t(level) - 1];
+        const Cell *fine = m_levels[size_t(level) - 1].data();
+        Cell *coarse = m_levels[size_t(level)].data();
+        for (int c = 0; c < levelBins[size_t(level)]; ++c) {
+            const size_t dst = size_t(c) * 128;
+            const size_t lo = size_t(2 * c) * 128;
+            const bool pair = 2 * c + 1 < fineBins;
+            for (int pitch = 0; pitch < 128; ++pitch) {
+                const Cell &left = fine[lo + pitch];
+                const int secondStarts = pair ? starts[lo + 128 + pitch] : 0;
+                const quint8 secondVelocity = pair ? fine[lo + 128 + pitch].maxVelocity : 0;
+                coarse[dst + pitch].count = quint8(qMin(255, left.count + secondStarts));
+                coarse[dst + pitch].maxVelocity = std::max(left.maxVelocity, secondVelocity);
+                quint16 merged = starts[lo + pitch];
+                saturatedAdd(merged, secondStarts);
+                starts[dst + pitch] = merged;
+            }
+        }
+    }
+
+    if (qPopulationCount(m_present) < 2)
+        return;
+
+    // Группы (дорожка, высота) раскладываются подсчётом; ноты идут по
+    // возрастанию старта, так что старты в группе уже упорядочены
+    const int groups = NoteStore::MaxTracks * 128;
+    const quint8 *tracks = notes.tracks();
+    m_groupOffsets.assign(size_t(groups) + 1, 0);
+    for (int i = 0; i < notes.size(); ++i)
+        ++m_groupOffsets[size_t(tracks[i]) * 128 + pitches[i] + 1];
+    for (int g = 0; g < groups; ++g)
+        m_groupOffsets[size_t(g) + 1] += m_groupOffsets[size_t(g)];
+
+    std::vector<quint32> fill(m_groupOffsets.begin(), m_groupOffsets.end() - 1);
+    m_groupStarts.resize(size_t(notes.size()));
+    m_groupEnds.resize(size_t(notes.size()));
+    for (int i = 0; i < notes.size(); ++i) {
+        const quint32 slot = fill[size_t(tracks[i]) * 128 + pitches[i]]++;
+        m_groupStarts[slot] = notes.startTime(i);
+        m_groupEnds[slot] = qMax(notes.endTime(i), notes.startTime(i) + 1);
+    }
+    for (int g = 0; g < groups; ++g)
+        std::sort(m_groupEnds.begin() + m_groupOffsets[size_t(g)], m_groupEnds.begin() + m_groupOffsets[size_t(g) + 1]);
+}
+
+int DensityPyramid::levelForBinMs(double maxBinMs) const
+{
+    for (int level = levelCount() - 1; level > 0; --level) {
+        if (double(binMs(level)) <= maxBinMs)
+            return level;
+    }
+    return 0;
+}
+
+qint64 DensityPyramid::noteEstimate(quint32 t0Ms, quint32 t1Ms) const
+{
+    if (m_sounding.empty())
+        return 0;
+    const int last = int(m_sounding.size()) - 1;
+    const int first = qMin(last, int(t0Ms / m_baseBinMs));
+    const int end = qMax(first, qMin(last, int(t1Ms / m_baseBinMs)));
+    return qint64(m_sounding[first]) + m_startPrefix[size_t(end) + 1] - m_startPrefix[size_t(first) + 1];
+}
+
+qint64 DensityPyramid::noteEstimate(TrackMask mask, quint32 t0Ms, quint32 t1Ms) const
+{
+    if (coversAll(mask))
+        return noteEstimate(t0Ms, t1Ms);
+    if (m_groupOffsets.empty() || (mask & m_present) == 0)
+        return 0;
+
+    qint64 count = 0;
+    for (TrackMask bits = mask & m_present; bits != 0; bits &= bits - 1) {
+        const int track = int(qCountTrailingZeroBits(bits));
+        for (int pitch = 0; pitch < 128; ++pitch)
+            count += groupOverlapCount(track * 128 + pitch, t0Ms, t1Ms + 1);
+    }
+    return count;
+}
+
+void DensityPyramid::maskedBin(TrackMask mask, int level, int index, Cell *out) const
+{
+    const Cell *all = bin(level, index);
+    if (coversAll(mask)) {
+        std::copy(all, all + 128, out);
+        return;
+    }
+    std::fill(out, out + 128, Cell());
+    if (m_groupOffsets.empty())
+        return;
+
+    const quint32 t0 = binMs(level) * quint32(index);
+    const quint32 t1 = t0 + binMs(level);
+    for (int pitch = 0; pitch < 128; ++pitch) {
+        if (all[pitch].count == 0)
+            continue;
+        int count = 0;
+        for (TrackMask bits = mask & m_present; bits != 0; bits &= bits - 1) {
+            const int track = int(qCountTrailingZeroBits(bits));
+            count += groupOverlapCount(track * 128 + pitch, t0, t1);
+        }
+        if (count > 0) {
+            out[pitch].count = quint8(qMin(255, count));
+            out[pitch].maxVelocity = all[pitch].maxVelocity;
+        }
+    }
+}
+
+int DensityPyramid::groupOverlapCount(int group, quint32 t0Ms, quint32 t1Ms) const
+{
+    const size_t first = m_groupOffsets[size_t(group)];
+    const size_t last = m_groupOffsets[size_t(group) + 1];
+    if (first == last)
+        return 0;
+    // Задевают окно ноты со стартом < t1Ms без тех, что кончились к t0Ms
+    // (такие начались раньше t1Ms, так что вычитание корректно)
+    const quint32 *starts = m_groupStarts.data();
+    const quint32 *ends = m_groupEnds.data();
+    const quint32 *startsEnd = std::lower_bound(starts + first, starts + last, t1Ms);
+    const quint32 *endsEnd = std::upper_bound(ends + first, ends + last, t0Ms);
+    return int((startsEnd - (starts + first)) - (endsEnd - (ends + first)));
+}
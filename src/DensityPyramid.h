@@ -0,0 +1,80 @@
+// DensityPyramid.h
+#ifndef DENSITYPYRAMID_H
+#define DENSITYPYRAMID_H
+
+#include <QtGlobal>
+#include <vector>
+#include "NoteStore.h"
+
+// Многоуровневая карта плотности нот: время разбито на корзины, в каждой
+// на каждую высоту — сколько нот в ней звучит и самая громкая velocity.
+// Уровень 0 — самые мелкие корзины, каждый следующий вдвое крупнее.
+// Строится после разбора за O(нот * log + ячеек): длинная нота стоит
+// столько же, сколько короткая.
+//
+// По ней ролл рисует места, где нот больше, чем пикселей, а обзор песни
+// рисуется целиком за время, не зависящее от числа нот.
+//
+// Для части дорожек (ролл со скрытой рукой) уровни не дублируются: у песни
+// из нескольких дорожек на каждую пару (дорожка, высота) хранятся
+// отсортированные старты и концы её нот — 8 байт на ноту. Число нот в
+// любом окне по ним считается двумя двоичными поисками, velocity берётся
+// из общей ячейки.
+class DensityPyramid {
+public:
+    using TrackMask = NoteStore::TrackMask;
+
+    struct Cell {
+        quint8 count = 0;         // звучащих нот, с насыщением на 255
+        quint8 maxVelocity = 0;
+    };
+
+    // Корзин на уровне 0 — порядка числа нот / NotesPerBin, в пределах
+    // [MinBaseBins, MaxBaseBins], и не короче MinBinMs: плотным файлам —
+    // мелкие корзины, обычным — немного памяти
+    static constexpr int     MinBaseBins = 4096;
+    static constexpr int     MaxBaseBins = 65536;
+    static constexpr int     NotesPerBin = 8;
+    static constexpr quint32 MinBinMs    = 8;
+
+    void build(const NoteStore &notes, qint64 durationMs);
+
+    bool isEmpty() const { return m_levels.empty(); }
+    int levelCount() const { return int(m_levels.size()); }
+    quint32 binMs(int level) const { return m_baseBinMs << level; }
+    int binCount(int level) const { return int(m_levels[level].size() / 128); }
+    // 128 ячеек корзины, по высоте
+    const Cell *bin(int level, int index) const { return m_levels[level].data() + size_t(index) * 128; }
+
+    // Самый крупный уровень с корзиной не длиннее maxBinMs (0, если таких нет)
+    int levelForBinMs(double maxBinMs) const;
+    // Оценка числа нот, задевающих [t0Ms, t1Ms]: начавшиеся в окне
+    // плюс звучащие в его первой корзине. O(1).
+    qint64 noteEstimate(quint32 t0Ms, quint32 t1Ms) const;
+    // То же для дорожек mask. Все дорожки — как выше, иначе точное число
+    // за O(дорожек * высот * log)
+    qint64 noteEstimate(TrackMask mask, quint32 t0Ms, quint32 t1Ms) const;
+
+    // mask пропускает все дорожки с нотами
+    bool coversAll(TrackMask mask) const { return (mask & m_present) == m_present; }
+    // 128 ячеек корзины для дорожек mask в out: count — нот этих дорожек,
+    // maxVelocity — из общей ячейки. Все дорожки — копия bin().
+    void maskedBin(TrackMask mask, int level, int index, Cell *out) const;
+
+private:
+    // Нот дорожки track высоты pitch, задевающих [t0Ms, t1Ms)
+    int groupOverlapCount(int group, quint32 t0Ms, quint32 t1Ms) const;
+
+    quint32 m_baseBinMs = MinBinMs;
+    std::vector<std::vector<Cell>> m_levels;
+    std::vector<quint32> m_startPrefix;   // нот, начавшихся до корзины i уровня 0
+    std::vector<quint32> m_sounding;      // звучащих нот в корзине уровня 0, все высоты
+
+    // Группы track * 128 + pitch; пусто, если дорожка одна
+    TrackMask m_present = 0;
+    std::vector<quint32> m_groupOffsets;   // MaxTracks * 128 + 1 границ
+    std::vector<quint32> m_groupStarts;    // старты нот группы, по возрастанию
+    std::vector<quint32> m_groupEnds;      // концы нот группы, по возрастанию
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "FramePacer.h"
+#include <QScreen>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+qint64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+FramePacer::FramePacer(QObject *parent)
+    : QObject(parent)
+{
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, &FramePacer::onTimeout);
+}
+
+void FramePacer::setScreen(QScreen *screen)
+{
+    if (screen == m_screen)
+        return;
+    disconnect(m_screenConnection);
+    m_screen = screen;
+    if (!m_screen)
+        return;
+
+    setRefreshRate(m_screen->refreshRate());
+    m_screenConnection = connect(m_screen, &QScreen::refreshRateChanged, this,
+                                 [this](qreal hz) { setRefreshRate(hz); });
+}
+
+void FramePacer::setRefreshRate(double hz)
+{
+    // Некоторые платформы сообщают 0 — считаем 60 Гц
+    m_refreshHz = hz >= 20.0 ? hz : 60.0;
+    m_periodNs = qint64(1.0e9 / m_refreshHz);
+}
+
+void FramePacer::start()
+{
+    if (m_timer->isActive())
+        return;
+    const qint64 now = steadyNowNs();
+    m_lastFrameNs = 0;
+    m_nextFrameNs = now;
+    m_timer->start(0);
+}
+
+void FramePacer::stop()
+{
+    m_timer->stop();
+}
+
+void FramePacer::scheduleNext(qint64 nowNs)
+{
+    // Следующий узел сетки; если проспали несколько — сразу на ближайший
+    m_nextFrameNs += m_periodNs;
+    if (m_nextFrameNs <= nowNs)
+        m_nextFrameNs += ((nowNs - m_nextFrameNs) / m_periodNs + 1) * m_periodNs;
+
+    const qint64 waitNs = m_nextFrameNs - steadyNowNs();
+    m_timer->start(int(qMax<qint64>(0, (waitNs + 999999) / 1000000)));
+}
+
+void FramePacer::onTimeout()
+{
+    const qint64 now = steadyNowNs();
+
+    if (m_lastFrameNs > 0) {
+        const qint64 interval = now - m_lastFrameNs;
+        const double intervalMs = double(interval) / 1.0e6;
+        m_stats.lastIntervalMs = intervalMs;
+        ++m_stats.histogram[qBound(0, int(intervalMs), HistogramBuckets - 1)];
+        if (interval * 2 > m_periodNs * 3)
+            ++m_stats.late;
+        m_stats.missed += qMax<qint64>(0, std::llround(double(interval) / double(m_periodNs)) - 1);
+    }
+    m_lastFrameNs = now;
+    ++m_stats.frames;
+
+    emit frame(now);
+    scheduleNext(now);
+}
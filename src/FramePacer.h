@@ -0,0 +1,69 @@
+// FramePacer.h
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <QObject>
+#include <QTimer>
+#include <array>
+
+class QScreen;
+
+// Источник кадров с частотой обновления экрана. Кадры выдаются по сетке
+// period = 1 / refreshRate (таймер перезаводится на каждый следующий
+// узел сетки, а не тикает с округлённым интервалом), опоздания и
+// пропущенные узлы считаются, интервалы между кадрами собираются в
+// гистограмму по 1 ms.
+//
+// Это приближение к vsync, а не синхронизация с ним: сетка своя, от
+// steady_clock, и фаза её с обратным ходом луча не связана — совпадает
+// только частота. Ролл — растровый QWidget, у него нет frameSwapped, а
+// QWindow::requestUpdate на X11 сам идёт от таймера. Поэтому кадр может
+// лечь на экран на период позже расчётного, и разброс интервалов в
+// гистограмме — это точность таймера, а не момент показа.
+class FramePacer : public QObject {
+    Q_OBJECT
+public:
+    static constexpr int HistogramBuckets = 40;   // последняя — «40 ms и больше»
+
+    struct Stats {
+        qint64 frames = 0;
+        qint64 late   = 0;   // интервал больше 1.5 периода
+        qint64 missed = 0;   // пропущенные узлы сетки
+        double lastIntervalMs = 0.0;
+        std::array<qint64, HistogramBuckets> histogram{};
+    };
+
+    explicit FramePacer(QObject *parent = nullptr);
+
+    // Частота берётся с экрана и отслеживается при её смене
+    void setScreen(QScreen *screen);
+    double refreshRate() const { return m_refreshHz; }
+
+    void start();
+    void stop();
+    bool isActive() const { return m_timer->isActive(); }
+
+    const Stats &stats() const { return m_stats; }
+    void resetStats() { m_stats = Stats(); }
+
+signals:
+    void frame(qint64 nowNs);   // steady_clock
+
+private slots:
+    void onTimeout();
+
+private:
+    void setRefreshRate(double hz);
+    void scheduleNext(qint64 nowNs);
+
+    QTimer *m_timer;
+    QScreen *m_screen = nullptr;
+    QMetaObject::Connection m_screenConnection;
+    double m_refreshHz = 60.0;
+    qint64 m_periodNs = 16666667;
+    qint64 m_nextFrameNs = 0;
+    qint64 m_lastFrameNs = 0;
+    Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// KeyStateFrame.h
+#ifndef KEYSTATEFRAME_H
+#define KEYSTATEFRAME_H
+
+#include <QtGlobal>
+#include <QtAlgorithms>
+#include <array>
+
+// Снимок состояния клавиш за кадр: 128-битная маска нажатых, velocity и
+// канал по каждой клавише и маска изменившихся с предыдущего снимка.
+// MidiPlayer публикует его раз в кадр — одним сигналом на все ноты.
+struct KeyStateFrame {
+    std::array<quint64, 2> pressed{};
+    std::array<quint64, 2> changed{};
+    std::array<quint8, 128> velocity{};
+    std::array<quint8, 128> channel{};
+    qint64 positionMs = 0;
+
+    bool isPressed(int note) const { return (pressed[note >> 6] >> (note & 63)) & 1u; }
+    bool isChanged(int note) const { return (changed[note >> 6] >> (note & 63)) & 1u; }
+    bool hasChanges() const { return (changed[0] | changed[1]) != 0; }
+    bool isEmpty() const { return (pressed[0] | pressed[1]) == 0; }
+
+    void press(int note, int vel, int ch = 0)
+    {
+        pressed[note >> 6] |= quint64(1) << (note & 63);
+        velocity[note] = quint8(vel);
+        channel[note] = quint8(ch);
+    }
+    void release(int note)
+    {
+        pressed[note >> 6] &= ~(quint64(1) << (note & 63));
+    }
+    void releaseAll() { pressed = {}; }
+
+    // changed = разница с предыдущим опубликованным снимком
+    void diffFrom(const KeyStateFrame &previous)
+    {
+        changed[0] = pressed[0] ^ previous.pressed[0];
+        changed[1] = pressed[1] ^ previous.pressed[1];
+    }
+
+    // f(note) для каждой установленной в mask клавиши, по возрастанию
+    template <typename F>
+    static void forEachBit(const std::array<quint64, 2> &mask, F &&f)
+    {
+        for (int word = 0; word < 2; ++word) {
+            quint64 bits = mask[word];
+            while (bits) {
+                f(word * 64 + int(qCountTrailingZeroBits(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+    template <typename F>
+    void forEachPressed(F &&f) const { forEachBit(pressed, f); }
+    template <typename F>
+    void forEachChanged(F &&f) const { forEachBit(changed, f); }
+};
+
+#endif
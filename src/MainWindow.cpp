@@ -5,13 +5,38 @@
 #include <QSlider>
 #include <QLabel>
 #include <QSpinBox>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <QDateTime>
+#include <QDir>
+#include <QShortcut>
+#include <QStandardPaths>
+#include "Trace.h"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
 {
     midiPlayer = new MidiPlayer(this);
 
+    // Создаётся после плеера: дочерние объекты удаляются в порядке
+    // создания, так что поток секвенсора остановится раньше синтезатора.
+    audioOutput = new AudioOutput(this);
+    midiPlayer->setSynth(audioOutput->synth());
+    audioOutput->start();
+
+    // MIDI-клавиатура ученика; без неё остаются мышь и воспроизведение
+    midiInput = new MidiInput(this);
+    midiInput->setSynth(audioOutput->synth());
+    midiInput->openSystem();
+
+    // Кадры ролла — с частотой экрана, пока идёт воспроизведение
+    framePacer = new FramePacer(this);
+    // Разбор файлов — в фоне, окно не замирает
+    songLoader = new SongLoader(this);
+
     setupUI();
+    framePacer->setScreen(screen());
+    pianoRoll->setFramePacer(framePacer);
 
     QString style = R"(
         QMainWindow {
@@ -128,8 +153,17 @@ void MainWindow::setupUI() {
     QLabel *lblFileLabel = new QLabel("Текущий файл:", this);
     lblFileName = new QLabel("Не загружен", this);
     lblFileName->setStyleSheet("color: #7f8c8d;");
+    progressLoad = new QProgressBar(this);
+    progressLoad->setRange(0, 100);
+    progressLoad->setMaximumWidth(200);
+    progressLoad->setVisible(false);
+    btnCancelLoad = new QPushButton("Отмена", this);
+    btnCancelLoad->setToolTip("Прервать загрузку файла");
+    btnCancelLoad->setVisible(false);
     fileLayout->addWidget(lblFileLabel);
     fileLayout->addWidget(lblFileName);
+    fileLayout->addWidget(progressLoad);
+    fileLayout->addWidget(btnCancelLoad);
     fileLayout->addStretch();
     mainLayout->addLayout(fileLayout);
     
@@ -182,21 +216,35 @@ void MainWindow::setupUI() {
     // Добавляем панель в основной layout
     mainLayout->addWidget(controlPanel);
 
+    // Обзор всей песни под слайдером: щелчок — перемотка
+    songOverview = new SongOverviewWidget(this);
+    songOverview->setFixedHeight(40);
+    mainLayout->addWidget(songOverview);
+
     
     // === ТЕМПО ===
     QHBoxLayout *tempoLayout = new QHBoxLayout();
     
-    QLabel *lblTempoLabel = new QLabel("Темпо (BPM):", this);
+    // Скорость — в процентах от темпа файла; BPM берётся из карты темпа
+    QLabel *lblTempoLabel = new QLabel("Скорость:", this);
     sliderTempo = new QSlider(Qt::Horizontal, this);
-    sliderTempo->setRange(50, 200);
-    sliderTempo->setValue(120);
+    sliderTempo->setRange(25, 200);
+    sliderTempo->setValue(100);
     sliderTempo->setMaximumWidth(200);
-    lblTempo = new QLabel("120", this);
-    lblTempo->setMaximumWidth(50);
+    lblTempo = new QLabel("100%", this);
+    lblTempo->setMinimumWidth(130);
     
     tempoLayout->addWidget(lblTempoLabel);
     tempoLayout->addWidget(sliderTempo);
     tempoLayout->addWidget(lblTempo);
+
+    chkSmoothScroll = new QCheckBox("Плавная прокрутка", this);
+    chkSmoothScroll->setToolTip("Перерисовывать ролл с частотой экрана");
+    chkSmoothScroll->setChecked(true);
+    chkFrameHistogram = new QCheckBox("Гистограмма кадров", this);
+    tempoLayout->addSpacing(16);
+    tempoLayout->addWidget(chkSmoothScroll);
+    tempoLayout->addWidget(chkFrameHistogram);
     tempoLayout->addStretch();
     
     mainLayout->addLayout(tempoLayout);
@@ -214,12 +262,24 @@ void MainWindow::setupUI() {
         "Celesta"
     });
     cbInstruments->setMaximumWidth(200);
+
+    btnLoadSoundFont = new QPushButton("🎼 SoundFont…", this);
+    btnLoadSoundFont->setToolTip("Загрузить банк SF2: инструменты будут звучать сэмплами");
     
     instrumentLayout->addWidget(lblInstrumentLabel);
     instrumentLayout->addWidget(cbInstruments);
+    instrumentLayout->addWidget(btnLoadSoundFont);
     instrumentLayout->addStretch();
     
     mainLayout->addLayout(instrumentLayout);
+
+    // === ДОРОЖКИ === (заполняется при загрузке песни, видна от двух дорожек)
+    trackPanel = new QWidget(this);
+    trackLayout = new QHBoxLayout(trackPanel);
+    trackLayout->setContentsMargins(0, 0, 0, 0);
+    trackLayout->setSpacing(12);
+    trackPanel->setVisible(false);
+    mainLayout->addWidget(trackPanel);
     
     // === PIANO ROLL ===
     pianoRoll = new PianoRollWidget(this);
@@ -237,9 +297,14 @@ void MainWindow::setupUI() {
     pianoRoll->setKeyboard(pianoWidget);
 
     // === СТАТУС БАР ===
-    QLabel *statusLabel = new QLabel("Готово", this);
-    statusLabel->setStyleSheet("color: #27ae60; padding: 5px;");
-    mainLayout->addWidget(statusLabel);
+    lblStatus = new QLabel("Готово", this);
+    lblStatus->setStyleSheet("color: #27ae60; padding: 5px;");
+    mainLayout->addWidget(lblStatus);
+
+    // Время кадра ролла и память банка меняются постоянно — обновляем раз в секунду
+    statusTimer = new QTimer(this);
+    statusTimer->setInterval(1000);
+    statusTimer->start();
     
     mainLayout->addStretch();
 }
@@ -250,35 +315,93 @@ void MainWindow::connectSignals() {
     connect(btnPause, &QPushButton::clicked, this, &MainWindow::onPause);
     connect(btnStop, &QPushButton::clicked, this, &MainWindow::onStop);
     
-    connect(sliderTempo, &QSlider::valueChanged, this, &MainWindow::onTempoChanged);
+    connect(sliderTempo, &QSlider::valueChanged, this, &MainWindow::onSpeedChanged);
+    connect(cbInstruments, &QComboBox::currentIndexChanged, this, &MainWindow::onInstrumentChanged);
+    connect(btnLoadSoundFont, &QPushButton::clicked, this, &MainWindow::onLoadSoundFont);
+    connect(statusTimer, &QTimer::timeout, this, &MainWindow::onUpdateStatus);
     connect(sliderPosition, &QSlider::sliderMoved, this, &MainWindow::onSliderMoved);
+    connect(songOverview, &SongOverviewWidget::seekRequested, midiPlayer, &MidiPlayer::setPosition);
+    connect(midiPlayer, &MidiPlayer::positionChanged, songOverview, &SongOverviewWidget::setPosition);
     
+    // Фоновая загрузка: сначала начало песни, потом вся
+    connect(btnCancelLoad, &QPushButton::clicked, songLoader, &SongLoader::cancel);
+    connect(songLoader, &SongLoader::progress, progressLoad, &QProgressBar::setValue);
+    connect(songLoader, &SongLoader::prefixReady, this, &MainWindow::onSongPrefixReady);
+    connect(songLoader, &SongLoader::loaded, this, &MainWindow::onSongLoaded);
+    connect(songLoader, &SongLoader::failed, this, [this](const QString &filePath) {
+        onSongLoadFinished();
+        lblFileName->setText("Ошибка при загрузке MIDI файла: " + QFileInfo(filePath).fileName());
+    });
+    connect(songLoader, &SongLoader::canceled, this, &MainWindow::onSongLoadFinished);
+
     // Сигналы от плеера
     connect(midiPlayer, &MidiPlayer::positionChanged, this, &MainWindow::onPositionChanged);
     connect(midiPlayer, &MidiPlayer::durationChanged, this, &MainWindow::onDurationChanged);
 
-    connect(midiPlayer, &MidiPlayer::noteOn,
-            pianoWidget, &PianoKeyboardWidget::pressKey);
-    connect(midiPlayer, &MidiPlayer::noteOff,
-            pianoWidget, &PianoKeyboardWidget::releaseKey);
-}
+    // Плавная прокрутка: позиция ролла экстраполируется на каждый кадр экрана
+    connect(midiPlayer, &MidiPlayer::clockChanged, pianoRoll, &PianoRollWidget::setPlaybackClock);
+    connect(framePacer, &FramePacer::frame, pianoRoll, &PianoRollWidget::advanceFrame);
+    connect(chkSmoothScroll, &QCheckBox::toggled, this, &MainWindow::onSmoothScrollToggled);
+    connect(chkFrameHistogram, &QCheckBox::toggled, pianoRoll, &PianoRollWidget::setHistogramVisible);
+    connect(midiPlayer, &MidiPlayer::playbackStarted, this, [this]() {
+        m_playing = true;
+        onSmoothScrollToggled(chkSmoothScroll->isChecked());
+    });
+    // Часы к этому моменту уже остановлены — последний кадр берём из якоря
+    connect(midiPlayer, &MidiPlayer::playbackPaused, this, [this]() {
+        m_playing = false;
+        framePacer->stop();
+        pianoRoll->advanceFrame(0);
+    });
+    connect(midiPlayer, &MidiPlayer::playbackStopped, this, [this]() {
+        m_playing = false;
+        framePacer->stop();
+        pianoRoll->advanceFrame(0);
+    });
 
-void MainWindow::onResyncNotes(qint64 position)
-{
-    // 1. Сбросить все клавиши
-    for (int note = 21; note <= 108; ++note) {
-        pianoWidget->releaseKey(note);
-    }
+    // Перемотка и стоп — новая попытка с этого места
+    connect(midiPlayer, &MidiPlayer::seeked, this, [this](qint64 position) {
+        m_grader.restart(position);
+    });
+
+    // Состояние клавиш приходит раз в кадр одним снимком
+    connect(midiPlayer, &MidiPlayer::keyStateChanged,
+            pianoWidget, &PianoKeyboardWidget::applyKeyState);
+    connect(midiPlayer, &MidiPlayer::keyStateChanged,
+            pianoRoll, &PianoRollWidget::applyKeyState);
+
+    // Игра мышью по клавиатуре — прямо в синтезатор
+    connect(pianoWidget, &PianoKeyboardWidget::userNoteOn, this, [this](int note, int velocity) {
+        audioOutput->synth()->liveNoteOn(note, velocity);
+    });
+    connect(pianoWidget, &PianoKeyboardWidget::userNoteOff, this, [this](int note) {
+        audioOutput->synth()->liveNoteOff(note);
+    });
 
-    // 2. Включить те, что должны звучать сейчас
-    const auto &notes = midiPlayer->getNotes();
-    for (const auto &n : notes) {
-        qint64 start = n.startTime;
-        qint64 end   = n.startTime + n.duration;
-        if (position >= start && position < end) {
-            pianoWidget->pressKey(n.pitch);
+    // MIDI-вход: позиция песни для меток, клавиши и оценка. Звук (ноты и
+    // педаль) поток ввода отдаёт синтезатору сам, мимо цикла GUI
+    connect(midiPlayer, &MidiPlayer::clockChanged, midiInput, &MidiInput::setPlaybackClock);
+    connect(midiInput, &MidiInput::eventReceived, this, [this](const MidiInputEvent &input) {
+        const MidiEvent &e = input.event;
+        if (e.type == MidiEvent::NoteOn) {
+            pianoWidget->pressLiveKey(e.data1, e.timeNs);
+            // На паузе ученик просто пробует клавиши — не оцениваем
+            if (m_playing)
+                m_grader.noteOn(e.data1, input.positionMs);
+        } else if (e.type == MidiEvent::NoteOff) {
+            pianoWidget->releaseLiveKey(e.data1, e.timeNs);
         }
-    }
+    });
+
+    // Запись трассы: первое нажатие включает, второе сохраняет JSON
+    QShortcut *traceShortcut = new QShortcut(QKeySequence("Ctrl+Shift+T"), this);
+    connect(traceShortcut, &QShortcut::activated, this, &MainWindow::onToggleTracing);
+
+    // HUD производительности поверх ролла
+    QShortcut *hudShortcut = new QShortcut(QKeySequence(Qt::Key_F3), this);
+    connect(hudShortcut, &QShortcut::activated, this, [this]() {
+        pianoRoll->setHudVisible(!pianoRoll->isHudVisible());
+    });
 }
 
 void MainWindow::onOpenMidiFile() {
@@ -286,15 +409,141 @@ void MainWindow::onOpenMidiFile() {
         "Открыть MIDI файл", "",
         "MIDI Files (*.mid *.midi);;All Files (*)");
     
-    if (!fileName.isEmpty()) {
-        if (midiPlayer->loadFile(fileName)) {
-            lblFileName->setText(QFileInfo(fileName).fileName());
-            btnPlay->setEnabled(true);
-            sliderPosition->setEnabled(true);
+    if (fileName.isEmpty())
+        return;
+
+    lblFileName->setText(QFileInfo(fileName).fileName() + " — загрузка…");
+    progressLoad->setValue(0);
+    progressLoad->setVisible(true);
+    btnCancelLoad->setVisible(true);
+    songLoader->load(fileName);
+}
+
+void MainWindow::onSongPrefixReady(const SongPtr &song)
+{
+    // Начало песни уже можно смотреть и играть, хвост догрузится
+    midiPlayer->setSong(song);
+    m_grader.setSong(song);
+    pianoRoll->setSong(song);
+    songOverview->setSong(song);
+    updateTrackPanel(song);
+    btnPlay->setEnabled(true);
+    sliderPosition->setEnabled(true);
+}
+
+void MainWindow::onSongLoaded(const SongPtr &song)
+{
+    // Сначала песня (дочитанное начало подменяется на ходу), потом интерфейс
+    midiPlayer->setSong(song);
+    // Дочитанный хвост того же файла: оценки начала переносятся на новые
+    // индексы нот. Песня сразу из кэша — новая попытка с начала.
+    const SongPtr &graded = m_grader.song();
+    if (graded && graded->filePath() == song->filePath())
+        m_grader.replaceSong(song);
+    else
+        m_grader.setSong(song);
+    onSongLoadFinished();
+    pianoRoll->setSong(song);
+    songOverview->setSong(song);
+    updateTrackPanel(song);
+    btnPlay->setEnabled(midiPlayer->isLoaded());
+    sliderPosition->setEnabled(midiPlayer->isLoaded());
+
+    lblFileName->setText(QString("%1 — нот: %2, разбор %3 мс%4")
+        .arg(song->title())
+        .arg(song->notes().size())
+        .arg(double(song->parseStats().elapsedNs) / 1.0e6, 0, 'f', 1)
+        .arg(song->parseStats().fromCache ? " (из кэша)" : ""));
+    prefetchSoundFont();
+}
+
+void MainWindow::updateTrackPanel(const SongPtr &song)
+{
+    // Дочитанный хвост той же песни обычно не добавляет дорожек —
+    // тогда панель и выбранные галочки остаются как есть
+    const quint64 present = song->notes().presentTracks();
+    if (present == m_panelTracks && song->filePath() == m_panelFilePath)
+        return;
+    m_panelTracks = present;
+    m_panelFilePath = song->filePath();
+
+    trackToggles.clear();
+    while (QLayoutItem *item = trackLayout->takeAt(0)) {
+        delete item->widget();
+        delete item;
+    }
+
+    // Новая песня начинается со всех дорожек
+    midiPlayer->setTrackMasks(NoteStore::AllTracks, NoteStore::AllTracks);
+    pianoRoll->setVisibleTracks(NoteStore::AllTracks);
+    m_grader.setTrackMask(NoteStore::AllTracks);
+
+    trackPanel->setVisible(qPopulationCount(present) > 1);
+    if (!trackPanel->isVisible())
+        return;
+
+    trackLayout->addWidget(new QLabel("Дорожки:", trackPanel));
+    for (int track = 0; track < song->tracks().size(); ++track) {
+        if (!(present >> track & 1u))
+            continue;
+        const Song::Track &info = song->tracks()[track];
+        QString name;
+        if (song->format() == 0)
+            name = QString("Канал %1").arg(track + 1);
+        else
+            name = info.name.isEmpty() ? QString("Дорожка %1").arg(track + 1) : info.name;
+
+        QWidget *box = new QWidget(trackPanel);
+        box->setToolTip(QString("%1 — нот: %2").arg(name).arg(info.noteCount));
+        QVBoxLayout *boxLayout = new QVBoxLayout(box);
+        boxLayout->setContentsMargins(0, 0, 0, 0);
+        boxLayout->setSpacing(0);
+        boxLayout->addWidget(new QLabel(name, box));
+
+        TrackToggles toggles{ track,
+                              new QCheckBox("Показ", box),
+                              new QCheckBox("Звук", box),
+                              new QCheckBox("Авто", box) };
+        toggles.autoplay->setToolTip("Клавиши нажимаются сами; без галочки партию играете вы");
+        for (QCheckBox *check : { toggles.visible, toggles.audible, toggles.autoplay }) {
+            check->setChecked(true);
+            boxLayout->addWidget(check);
+            connect(check, &QCheckBox::toggled, this, &MainWindow::onTrackTogglesChanged);
         }
+        trackToggles.push_back(toggles);
+        trackLayout->addWidget(box);
+    }
+    trackLayout->addStretch();
+}
+
+void MainWindow::onTrackTogglesChanged()
+{
+    // Дорожки без галочек на панели (в том числе без нот) остаются включены
+    quint64 visible = NoteStore::AllTracks;
+    quint64 audible = NoteStore::AllTracks;
+    quint64 autoplay = NoteStore::AllTracks;
+    for (const TrackToggles &t : trackToggles) {
+        const quint64 bit = quint64(1) << t.track;
+        if (!t.visible->isChecked())
+            visible &= ~bit;
+        if (!t.audible->isChecked())
+            audible &= ~bit;
+        if (!t.autoplay->isChecked())
+            autoplay &= ~bit;
     }
+    midiPlayer->setTrackMasks(audible, autoplay);
+    pianoRoll->setVisibleTracks(visible);
+    // Ученик играет дорожки без автоигры; если автоигра у всех — оцениваются все
+    m_grader.setTrackMask(autoplay == NoteStore::AllTracks ? NoteStore::AllTracks : ~autoplay);
+}
 
-    pianoRoll->setNotes(midiPlayer->getNotes());
+void MainWindow::onSongLoadFinished()
+{
+    progressLoad->setVisible(false);
+    btnCancelLoad->setVisible(false);
+    midiPlayer->abandonTail();
+    if (!midiPlayer->isLoaded())
+        lblFileName->setText("Не загружен");
 }
 
 void MainWindow::onPlay() {
@@ -319,7 +568,6 @@ void MainWindow::onStop() {
 void MainWindow::onSliderMoved(int position)
 {
     midiPlayer->setPosition(position);
-    onResyncNotes(position);
 }
 
 void MainWindow::onPositionChanged(qint64 position) {
@@ -335,7 +583,12 @@ void MainWindow::onPositionChanged(qint64 position) {
         .arg(minutes, 2, 10, QChar('0'))
         .arg(seconds, 2, 10, QChar('0')));
 
-    pianoRoll->setCurrentTime(position);
+    // С FramePacer ролл сам берёт позицию из часов на каждом кадре
+    if (!framePacer->isActive())
+        pianoRoll->setCurrentTime(position);
+
+    updateTempoLabel(position);
+    m_grader.advance(position);
 }
 
 void MainWindow::onDurationChanged(qint64 duration) {
@@ -344,12 +597,145 @@ void MainWindow::onDurationChanged(qint64 duration) {
     seconds = seconds % 60;
     
     sliderPosition->setRange(0, duration);
+    updateTempoLabel(0);
     lblDuration->setText(QString("%1:%2")
         .arg(minutes, 2, 10, QChar('0'))
         .arg(seconds, 2, 10, QChar('0')));
 }
 
-void MainWindow::onTempoChanged(int value) {
-    lblTempo->setText(QString::number(value));
-    midiPlayer->setTempo(value);
+void MainWindow::onSpeedChanged(int percent) {
+    midiPlayer->setSpeedPercent(percent);
+    updateTempoLabel(sliderPosition->value());
+}
+
+void MainWindow::updateTempoLabel(qint64 positionMs)
+{
+    // Карта темпа — бинарный поиск по отрезкам, можно звать на каждом тике
+    const double bpm = midiPlayer->effectiveBpmAt(positionMs);
+    QString text = QString("%1%").arg(midiPlayer->speedPercent());
+    if (bpm > 0.0)
+        text += QString(" (%1 BPM)").arg(bpm, 0, 'f', 1);
+    lblTempo->setText(text);
+}
+
+void MainWindow::onInstrumentChanged(int index) {
+    // Порядок пунктов cbInstruments совпадает с SynthEngine::Instrument
+    audioOutput->synth()->setInstrument(index);
+    prefetchSoundFont();
+}
+
+void MainWindow::onSmoothScrollToggled(bool enabled)
+{
+    if (enabled && m_playing) {
+        framePacer->resetStats();
+        framePacer->start();
+    } else {
+        framePacer->stop();
+    }
+}
+
+void MainWindow::onLoadSoundFont()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+        "Открыть SoundFont", "",
+        "SoundFont 2 (*.sf2);;All Files (*)");
+    if (fileName.isEmpty())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto font = std::make_shared<SoundFont>();
+    QString error;
+    if (!font->load(fileName, &error)) {
+        qWarning() << "SoundFont:" << error;
+        lblStatus->setText("Не удалось загрузить SoundFont: " + error);
+        return;
+    }
+
+    m_soundFont = font;
+    audioOutput->synth()->setSoundFont(font);
+    m_soundFontLoadMs = timer.elapsed();
+
+    prefetchSoundFont();
+    onUpdateStatus();
+}
+
+void MainWindow::prefetchSoundFont()
+{
+    if (!m_soundFont)
+        return;
+    // Подкачиваем только зоны, которые понадобятся нотам текущей песни
+    const int preset = audioOutput->synth()->soundFontPreset(cbInstruments->currentIndex());
+    m_soundFont->prefetchForNotes(preset, midiPlayer->song()->notes());
+}
+
+void MainWindow::onUpdateStatus()
+{
+    const PianoRollWidget::FrameStats &frame = pianoRoll->frameStats();
+    QString text = QString("Кадр ролла: %1 мс (среднее %2, макс %3), тайлов по плотности %4, обзор %5 мкс")
+        .arg(frame.lastMs, 0, 'f', 2)
+        .arg(frame.meanMs, 0, 'f', 2)
+        .arg(frame.maxMs, 0, 'f', 2)
+        .arg(frame.densityTiles)
+        .arg(double(songOverview->lastPaintNs()) / 1000.0, 0, 'f', 1);
+    if (!m_traceStatus.isEmpty())
+        text += " | " + m_traceStatus;
+    const PerformanceGrader::Stats &grading = m_grader.stats();
+    if (grading.accuracy() >= 0.0) {
+        text += QString(" | Игра: %1% (вовремя %2, рано %3, поздно %4, пропущено %5, мимо %6), сдвиг %7 мс")
+            .arg(grading.accuracy() * 100.0, 0, 'f', 1)
+            .arg(grading.hit)
+            .arg(grading.early)
+            .arg(grading.late)
+            .arg(grading.missed)
+            .arg(grading.wrong)
+            .arg(grading.meanDeviationMs(), 0, 'f', 0);
+    }
+    if (midiInput->isOpen()) {
+        const QStringList sources = midiInput->sources();
+        text += QString(" | MIDI-вход %1: %2")
+            .arg(midiInput->backendName())
+            .arg(sources.isEmpty() ? QString("нет устройств") : sources.join(", "));
+    }
+
+    if (!m_soundFont) {
+        lblStatus->setText(text);
+        return;
+    }
+
+    const SynthEngine *synth = audioOutput->synth();
+    const int preset = synth->soundFontPreset(cbInstruments->currentIndex());
+    text += QString(" | %1 [%2] — в памяти %3 из %4 МБ, загрузка %5 мс")
+        .arg(m_soundFont->fileName())
+        .arg(preset >= 0 ? m_soundFont->preset(preset).name : QString("—"))
+        .arg(double(m_soundFont->residentSampleBytes()) / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(double(m_soundFont->mappedBytes()) / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(m_soundFontLoadMs);
+
+    // Время до первого звука = загрузка банка + задержка первой ноты
+    const qint64 firstUs = synth->firstSoundLatencyUs();
+    if (firstUs >= 0)
+        text += QString(", первый звук +%1 мс").arg(double(firstUs) / 1000.0, 0, 'f', 2);
+    lblStatus->setText(text);
+}
+
+void MainWindow::onToggleTracing()
+{
+    if (!Trace::isEnabled()) {
+        Trace::clear();
+        Trace::setEnabled(true);
+        m_traceStatus = "идёт запись трассы (Ctrl+Shift+T — сохранить)";
+        onUpdateStatus();
+        return;
+    }
+
+    Trace::setEnabled(false);
+    const QString filePath = QDir(QStandardPaths::writableLocation(QStandardPaths::TempLocation))
+        .filePath(QString("piano-trace-%1.json")
+                      .arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss")));
+    m_traceStatus = Trace::writeChromeJson(filePath)
+        ? "трасса сохранена: " + filePath
+        : "не удалось сохранить трассу: " + filePath;
+    onUpdateStatus();
 }
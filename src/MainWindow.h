@@ -6,9 +6,22 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QComboBox>
+#include <QCheckBox>
+#include <QHBoxLayout>
+#include <QProgressBar>
+#include <QTimer>
+#include <memory>
+#include <vector>
 #include "MidiPlayer.h"
+#include "AudioOutput.h"
+#include "MidiInput.h"
+#include "PerformanceGrader.h"
 #include "PianoKeyboardWidget.h"
 #include "PianoRollWidget.h"
+#include "SongOverviewWidget.h"
+#include "FramePacer.h"
+#include "SongLoader.h"
+#include "SoundFont.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -25,23 +38,44 @@ private slots:
     void onSliderMoved(int position);
     void onPositionChanged(qint64 position);
     void onDurationChanged(qint64 duration);
-    void onTempoChanged(int value);
-    void onResyncNotes(qint64 position);
+    void onSpeedChanged(int percent);
+    void onInstrumentChanged(int index);
+    void onLoadSoundFont();
+    void onUpdateStatus();
+    void onSmoothScrollToggled(bool enabled);
+    void onSongPrefixReady(const SongPtr &song);
+    void onSongLoaded(const SongPtr &song);
+    void onSongLoadFinished();
+    void onTrackTogglesChanged();
+    void onToggleTracing();
 
 private:
     void setupUI();
     void connectSignals();
+    void prefetchSoundFont();
+    void updateTempoLabel(qint64 positionMs);
+    void updateTrackPanel(const SongPtr &song);
 
     MidiPlayer *midiPlayer;
+    AudioOutput *audioOutput;
+    MidiInput *midiInput;
+    FramePacer *framePacer;
+    SongLoader *songLoader;
+    bool m_playing = false;
+    PerformanceGrader m_grader;   // игра с MIDI-входа против нот песни
 
     PianoKeyboardWidget *pianoWidget;
     PianoRollWidget     *pianoRoll;
+    SongOverviewWidget  *songOverview;
     
     // UI элементы
     QPushButton *btnOpenFile;
     QPushButton *btnPlay;
     QPushButton *btnPause;
     QPushButton *btnStop;
+    QPushButton *btnLoadSoundFont;
+    QPushButton *btnCancelLoad;
+    QProgressBar *progressLoad;
     
     QSlider *sliderPosition;
     QSlider *sliderTempo;
@@ -51,6 +85,28 @@ private:
     QLabel *lblFileName;
     QLabel *lblTempo;
     QComboBox *cbInstruments;
+    QCheckBox *chkSmoothScroll;
+    QCheckBox *chkFrameHistogram;
+    QLabel *lblStatus;
+
+    // Дорожки песни: показывать в ролле, озвучивать, играть автоматически
+    struct TrackToggles {
+        int track;
+        QCheckBox *visible;
+        QCheckBox *audible;
+        QCheckBox *autoplay;
+    };
+    QWidget *trackPanel;
+    QHBoxLayout *trackLayout;
+    std::vector<TrackToggles> trackToggles;
+    quint64 m_panelTracks = 0;   // песня и дорожки, под которые построена панель
+    QString m_panelFilePath;
+    QTimer *statusTimer;
+
+    std::shared_ptr<SoundFont> m_soundFont;
+    qint64 m_soundFontLoadMs = 0;
+
+    QString m_traceStatus;   // запись трассы: идёт или куда сохранена
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,87 @@
+#include "Metrics.h"
+#include <chrono>
+#include <cstdio>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_MACOS)
+#include <mach/mach.h>
+#elif defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+std::array<std::atomic<qint64>, Metrics::CounterCount> Metrics::s_counters{};
+std::array<std::array<std::atomic<qint64>, Metrics::BucketCount>, Metrics::HistogramCount> Metrics::s_histograms{};
+
+Metrics::Snapshot Metrics::snapshot()
+{
+    Snapshot snap;
+    snap.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch()).count();
+    for (int i = 0; i < CounterCount; ++i)
+        snap.counters[i] = s_counters[i].load(std::memory_order_relaxed);
+    for (int h = 0; h < HistogramCount; ++h) {
+        for (int b = 0; b < BucketCount; ++b)
+            snap.histograms[h][b] = s_histograms[h][b].load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+qint64 Metrics::samples(const Snapshot &from, const Snapshot &to, Histogram histogram)
+{
+    qint64 total = 0;
+    for (int b = 0; b < BucketCount; ++b)
+        total += to.histograms[histogram][b] - from.histograms[histogram][b];
+    return total;
+}
+
+double Metrics::percentile(const Snapshot &from, const Snapshot &to, Histogram histogram, double q)
+{
+    const qint64 total = samples(from, to, histogram);
+    if (total <= 0)
+        return -1.0;
+
+    // Номер значения (с 1), на котором стоит перцентиль
+    const qint64 rank = qBound<qint64>(1, qint64(q * double(total) + 0.999999), total);
+    qint64 seen = 0;
+    for (int b = 0; b < BucketCount; ++b) {
+        seen += to.histograms[histogram][b] - from.histograms[histogram][b];
+        if (seen >= rank) {
+            const qint64 lower = bucketLowerBound(b);
+            const qint64 upper = b + 1 < BucketCount ? bucketLowerBound(b + 1) : lower * 2;
+            return double(lower + upper - 1) / 2.0;
+        }
+    }
+    return double(bucketLowerBound(BucketCount - 1));
+}
+
+qint64 Metrics::processResidentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return qint64(counters.WorkingSetSize);
+#elif defined(Q_OS_MACOS)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, task_info_t(&info), &count) != KERN_SUCCESS)
+        return -1;
+    return qint64(info.resident_size);
+#elif defined(Q_OS_LINUX)
+    // /proc/self/statm: размер и резидентная часть в страницах
+    FILE *file = std::fopen("/proc/self/statm", "r");
+    if (!file)
+        return -1;
+    long pages = 0;
+    long resident = 0;
+    const int fields = std::fscanf(file, "%ld %ld", &pages, &resident);
+    std::fclose(file);
+    if (fields != 2)
+        return -1;
+    return qint64(resident) * qint64(sysconf(_SC_PAGESIZE));
+#else
+    return -1;
+#endif
+}
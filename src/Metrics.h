@@ -0,0 +1,103 @@
+// Metrics.h
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtGlobal>
+#include <QtAlgorithms>
+#include <array>
+#include <atomic>
+
+// Общий реестр счётчиков производительности. Пишут плеер, секвенсор,
+// синтезатор (из аудио-потока) и ролл — relaxed-атомиками, без
+// блокировок и аллокаций; читает HUD (PerfHud) и замеры.
+//
+// Счётчики двух видов: накопительные (add — кадры, тики) и текущие
+// значения (set — голоса, глубина очереди). Гистограммы — время в мкс
+// по лог-линейным корзинам: 4 корзины на октаву, погрешность перцентиля
+// до 12%. Читатель снимает Snapshot и считает частоты и перцентили по
+// разнице двух снимков — за окно, которое выбирает сам.
+class Metrics {
+public:
+    enum Counter {
+        RollFrames,          // отрисованных кадров ролла
+        VisibleNotes,        // нот в окне ролла (оценка по карте плотности)
+        SequencerTicks,      // раздач секвенсора по расписанию
+        ActiveVoices,        // звучащих голосов синтезатора
+        AudioQueueDepth,     // событий в очереди синтезатора после блока
+        GuiQueueDepth,       // событий секвенсора к кадру плеера
+        ResidentBytes,       // RSS процесса
+        InputEvents,         // принятых событий MIDI-входа
+        CounterCount
+    };
+
+    enum Histogram {
+        RollFrameUs,         // отрисовка кадра ролла
+        SequencerLatenessUs, // опоздание раздачи секвенсора
+        AudioRenderUs,       // блок синтезатора в аудио-колбэке
+        InputToGuiUs,        // MIDI-вход: от приёма до разбора в GUI
+        InputToScreenUs,     // MIDI-вход: от приёма до отрисовки клавиши
+        HistogramCount
+    };
+
+    static constexpr int BucketCount = 64;   // последняя — всё от ~115 ms
+
+    struct Snapshot {
+        qint64 timeNs = 0;   // steady_clock
+        std::array<qint64, CounterCount> counters{};
+        std::array<std::array<qint64, BucketCount>, HistogramCount> histograms{};
+    };
+
+    static void add(Counter counter, qint64 delta = 1)
+    {
+        s_counters[counter].fetch_add(delta, std::memory_order_relaxed);
+    }
+    static void set(Counter counter, qint64 value)
+    {
+        s_counters[counter].store(value, std::memory_order_relaxed);
+    }
+    static qint64 value(Counter counter)
+    {
+        return s_counters[counter].load(std::memory_order_relaxed);
+    }
+    static void record(Histogram histogram, qint64 us)
+    {
+        s_histograms[histogram][bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static Snapshot snapshot();
+    // Перцентиль q (0..1) значений, записанных между from и to, в мкс
+    // (середина корзины); -1 — записей не было
+    static double percentile(const Snapshot &from, const Snapshot &to, Histogram histogram, double q);
+    static qint64 samples(const Snapshot &from, const Snapshot &to, Histogram histogram);
+
+    // RSS процесса в байтах; -1 — платформа не поддерживается
+    static qint64 processResidentBytes();
+
+    static int bucketOf(qint64 us);
+    static qint64 bucketLowerBound(int bucket);
+
+private:
+    static std::array<std::atomic<qint64>, CounterCount> s_counters;
+    static std::array<std::array<std::atomic<qint64>, BucketCount>, HistogramCount> s_histograms;
+};
+
+inline int Metrics::bucketOf(qint64 us)
+{
+    // 0..3 — по корзине на микросекунду; дальше октава [2^e, 2^(e+1))
+    // делится на 4 равные корзины
+    if (us < 4)
+        return us < 0 ? 0 : int(us);
+    const int e = 63 - int(qCountLeadingZeroBits(quint64(us)));
+    const int bucket = 4 + (e - 2) * 4 + int((us >> (e - 2)) & 3);
+    return bucket < BucketCount ? bucket : BucketCount - 1;
+}
+
+inline qint64 Metrics::bucketLowerBound(int bucket)
+{
+    if (bucket < 4)
+        return bucket;
+    const int e = (bucket - 4) / 4 + 2;
+    return qint64(4 + (bucket - 4) % 4) << (e - 2);
+}
+
+#endif
@@ -0,0 +1,45 @@
+// MidiEvent.h
+#ifndef MIDIEVENT_H
+#define MIDIEVENT_H
+
+#include <QtGlobal>
+#include "SpscRing.h"
+
+// Событие с меткой времени для передачи между потоками через SpscRing.
+// timeNs — момент steady_clock (наносекунды от его эпохи), когда событие
+// должно прозвучать/отобразиться; 0 — «как можно скорее».
+struct MidiEvent {
+    enum Type : quint8 {
+        NoteOff,
+        NoteOn,
+        Control,    // data1 — номер контроллера, data2 — значение
+        Program     // data1 — номер программы
+    };
+
+    qint64 timeNs = 0;
+    quint8 type = NoteOff;
+    quint8 channel = 0;
+    quint8 data1 = 0;   // высота ноты или номер контроллера
+    quint8 data2 = 0;   // velocity или значение
+
+    static MidiEvent noteOn(qint64 timeNs, int pitch, int velocity, int channel = 0)
+    {
+        return { timeNs, NoteOn, quint8(channel & 0x0F), quint8(pitch & 0x7F), quint8(velocity & 0x7F) };
+    }
+    static MidiEvent noteOff(qint64 timeNs, int pitch, int channel = 0)
+    {
+        return { timeNs, NoteOff, quint8(channel & 0x0F), quint8(pitch & 0x7F), 0 };
+    }
+    static MidiEvent control(qint64 timeNs, int controller, int value, int channel = 0)
+    {
+        return { timeNs, Control, quint8(channel & 0x0F), quint8(controller & 0x7F), quint8(value & 0x7F) };
+    }
+    static MidiEvent program(qint64 timeNs, int program, int channel = 0)
+    {
+        return { timeNs, Program, quint8(channel & 0x0F), quint8(program & 0x7F), 0 };
+    }
+};
+
+using MidiEventRing = SpscRing<MidiEvent>;
+
+#endif
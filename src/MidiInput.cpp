@@ -0,0 +1,463 @@
+#include "MidiInput.h"
+#include "Metrics.h"
+#include "SynthEngine.h"
+#include "Trace.h"
+#include <QDebug>
+#include <QMetaObject>
+#include <algorithm>
+#include <chrono>
+
+#ifdef __LINUX_ALSA__
+#include <alsa/asoundlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+qint64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef __LINUX_ALSA__
+
+// Вход через ALSA sequencer: свой порт «Input», к которому подключаются
+// все внешние источники. Ядро уже ставит события в очередь клиента —
+// поток только ждёт poll() и разбирает их пачкой, без промежуточных
+// буферов. Устройства, подключённые после открытия, ловятся по
+// объявлениям системного порта.
+//
+// Порт ставит на входящие события метку реального времени своей очереди:
+// ядро записывает её в момент приёма, так что задержка пробуждения потока
+// в метку не попадает. В steady_clock метки переводятся раз на пачку —
+// по текущему времени очереди.
+class AlsaMidiInput : public MidiInputBackend {
+public:
+    ~AlsaMidiInput() override
+    {
+        if (m_status)
+            snd_seq_queue_status_free(m_status);
+        if (m_seq)
+            snd_seq_close(m_seq);
+        for (int fd : m_wakePipe) {
+            if (fd >= 0)
+                ::close(fd);
+        }
+    }
+
+    QString name() const override { return QString("ALSA"); }
+
+    bool open() override
+    {
+        // Дуплекс: запуск очереди — это событие, отправляемое ядру
+        int err = snd_seq_open(&m_seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK);
+        if (err < 0) {
+            m_seq = nullptr;
+            qWarning() << "ALSA: не удалось открыть sequencer:" << snd_strerror(err);
+            return false;
+        }
+        snd_seq_set_client_name(m_seq, "Piano Platform");
+        m_client = snd_seq_client_id(m_seq);
+
+        m_queue = snd_seq_alloc_named_queue(m_seq, "Piano Platform input");
+        if (m_queue < 0) {
+            qWarning() << "ALSA: не удалось создать очередь:" << snd_strerror(m_queue);
+            return false;
+        }
+        snd_seq_start_queue(m_seq, m_queue, nullptr);
+        snd_seq_drain_output(m_seq);
+        err = snd_seq_queue_status_malloc(&m_status);
+        if (err < 0) {
+            m_status = nullptr;
+            qWarning() << "ALSA: не удалось выделить статус очереди:" << snd_strerror(err);
+            return false;
+        }
+
+        snd_seq_port_info_t *portInfo;
+        snd_seq_port_info_alloca(&portInfo);
+        snd_seq_port_info_set_name(portInfo, "Input");
+        snd_seq_port_info_set_capability(portInfo, SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE);
+        snd_seq_port_info_set_type(portInfo, SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        snd_seq_port_info_set_timestamping(portInfo, 1);
+        snd_seq_port_info_set_timestamp_real(portInfo, 1);
+        snd_seq_port_info_set_timestamp_queue(portInfo, m_queue);
+        err = snd_seq_create_port(m_seq, portInfo);
+        if (err < 0) {
+            qWarning() << "ALSA: не удалось создать порт:" << snd_strerror(err);
+            return false;
+        }
+        m_port = snd_seq_port_info_get_port(portInfo);
+        if (::pipe(m_wakePipe) < 0) {
+            qWarning() << "ALSA: не удалось создать pipe пробуждения";
+            m_wakePipe[0] = m_wakePipe[1] = -1;
+            return false;
+        }
+        ::fcntl(m_wakePipe[0], F_SETFL, O_NONBLOCK);
+        ::fcntl(m_wakePipe[1], F_SETFL, O_NONBLOCK);
+
+        // Объявления о новых портах; без него горячее подключение не увидим
+        snd_seq_connect_from(m_seq, m_port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE);
+        connectAll();
+
+        const int count = snd_seq_poll_descriptors_count(m_seq, POLLIN);
+        m_fds.resize(size_t(count) + 1);
+        snd_seq_poll_descriptors(m_seq, m_fds.data(), unsigned(count), POLLIN);
+        m_fds[size_t(count)] = { m_wakePipe[0], POLLIN, 0 };
+        return true;
+    }
+
+    int read(MidiEvent *out, int capacity, int timeoutMs) override
+    {
+        int count = drainQueue(out, capacity);
+        if (count > 0)
+            return count;
+
+        for (pollfd &fd : m_fds)
+            fd.revents = 0;
+        if (::poll(m_fds.data(), nfds_t(m_fds.size()), timeoutMs) <= 0)
+            return 0;
+        if (m_fds.back().revents & POLLIN) {
+            char buffer[16];
+            while (::read(m_wakePipe[0], buffer, sizeof(buffer)) > 0) {
+            }
+        }
+        return drainQueue(out, capacity);
+    }
+
+    void wake() override
+    {
+        if (m_wakePipe[1] >= 0) {
+            const char byte = 0;
+            [[maybe_unused]] const ssize_t written = ::write(m_wakePipe[1], &byte, 1);
+        }
+    }
+
+    QStringList sources() const override
+    {
+        std::lock_guard<std::mutex> lock(m_sourcesMutex);
+        return m_sources;
+    }
+
+private:
+    // Подписаться на все читаемые порты, кроме системных, своих и Midi Through
+    void connectAll()
+    {
+        snd_seq_client_info_t *client;
+        snd_seq_port_info_t *port;
+        snd_seq_client_info_alloca(&client);
+        snd_seq_port_info_alloca(&port);
+
+        snd_seq_client_info_set_client(client, -1);
+        while (snd_seq_query_next_client(m_seq, client) >= 0) {
+            const int clientId = snd_seq_client_info_get_client(client);
+            snd_seq_port_info_set_client(port, clientId);
+            snd_seq_port_info_set_port(port, -1);
+            while (snd_seq_query_next_port(m_seq, port) >= 0)
+                connectPort(port);
+        }
+    }
+
+    void connectPort(const snd_seq_port_info_t *port)
+    {
+        const snd_seq_addr_t *addr = snd_seq_port_info_get_addr(port);
+        const unsigned caps = snd_seq_port_info_get_capability(port);
+        const unsigned required = SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ;
+        if (addr->client == SND_SEQ_CLIENT_SYSTEM || addr->client == m_client
+            || (caps & required) != required || (caps & SND_SEQ_PORT_CAP_NO_EXPORT))
+            return;
+        const QString portName = QString::fromLocal8Bit(snd_seq_port_info_get_name(port));
+        if (portName.startsWith(QString("Midi Through")))
+            return;
+        if (snd_seq_connect_from(m_seq, m_port, addr->client, addr->port) < 0)
+            return;
+        std::lock_guard<std::mutex> lock(m_sourcesMutex);
+        if (!m_sources.contains(portName))
+            m_sources.append(portName);
+    }
+
+    void onPortStart(const snd_seq_addr_t &addr)
+    {
+        snd_seq_port_info_t *port;
+        snd_seq_port_info_alloca(&port);
+        if (snd_seq_get_any_port_info(m_seq, addr.client, addr.port, port) >= 0)
+            connectPort(port);
+    }
+
+    // Смещение steady_clock относительно реального времени очереди: время
+    // очереди читаем между двумя замерами steady_clock и берём середину
+    bool queueToSteadyNs(qint64 *offsetNs)
+    {
+        const qint64 beforeNs = steadyNowNs();
+        if (snd_seq_get_queue_status(m_seq, m_queue, m_status) < 0)
+            return false;
+        const qint64 afterNs = steadyNowNs();
+        const snd_seq_real_time_t *queueTime = snd_seq_queue_status_get_real_time(m_status);
+        const qint64 queueNs = qint64(queueTime->tv_sec) * 1000000000 + qint64(queueTime->tv_nsec);
+        *offsetNs = beforeNs + (afterNs - beforeNs) / 2 - queueNs;
+        return true;
+    }
+
+    int drainQueue(MidiEvent *out, int capacity)
+    {
+        int count = 0;
+        bool haveOffset = false;
+        qint64 offsetNs = 0;
+        while (count < capacity) {
+            snd_seq_event_t *ev = nullptr;
+            const int err = snd_seq_event_input(m_seq, &ev);
+            if (err == -ENOSPC) {
+                // Очередь ядра переполнилась — часть событий потеряна
+                qWarning() << "ALSA: переполнение входной очереди sequencer";
+                continue;
+            }
+            if (err < 0 || !ev)
+                break;
+
+            const int ch = ev->data.note.channel;
+            switch (ev->type) {
+            case SND_SEQ_EVENT_NOTEON:
+                out[count++] = ev->data.note.velocity > 0
+                                   ? MidiEvent::noteOn(0, ev->data.note.note, ev->data.note.velocity, ch)
+                                   : MidiEvent::noteOff(0, ev->data.note.note, ch);
+                break;
+            case SND_SEQ_EVENT_NOTEOFF:
+                out[count++] = MidiEvent::noteOff(0, ev->data.note.note, ch);
+                break;
+            case SND_SEQ_EVENT_CONTROLLER:
+                out[count++] = MidiEvent::control(0, int(ev->data.control.param), ev->data.control.value,
+                                                  ev->data.control.channel);
+                break;
+            case SND_SEQ_EVENT_PGMCHANGE:
+                out[count++] = MidiEvent::program(0, ev->data.control.value, ev->data.control.channel);
+                break;
+            case SND_SEQ_EVENT_PORT_START:
+                onPortStart(ev->data.addr);
+                continue;
+            default:
+                continue;
+            }
+
+            // Метка приёма от ядра; без неё (или без времени очереди) поток
+            // ввода поставит своё время
+            if (snd_seq_ev_is_real(ev)) {
+                if (!haveOffset)
+                    haveOffset = queueToSteadyNs(&offsetNs);
+                if (haveOffset) {
+                    const qint64 queueNs = qint64(ev->time.time.tv_sec) * 1000000000
+                                         + qint64(ev->time.time.tv_nsec);
+                    out[count - 1].timeNs = queueNs + offsetNs;
+                }
+            }
+        }
+        return count;
+    }
+
+    snd_seq_t *m_seq = nullptr;
+    int m_client = -1;
+    int m_port = -1;
+    int m_queue = -1;
+    snd_seq_queue_status_t *m_status = nullptr;
+    int m_wakePipe[2] = { -1, -1 };
+    std::vector<pollfd> m_fds;
+    mutable std::mutex m_sourcesMutex;   // sources() зовут из GUI
+    QStringList m_sources;
+};
+
+#endif
+
+} // namespace
+
+// LoopbackMidiInput
+
+int LoopbackMidiInput::read(MidiEvent *out, int capacity, int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const qint64 deadlineNs = steadyNowNs() + qint64(timeoutMs) * 1000000;
+    for (;;) {
+        const qint64 nowNs = steadyNowNs();
+        int count = 0;
+        while (count < capacity && !m_pending.empty() && m_pending.front().timeNs <= nowNs) {
+            out[count++] = m_pending.front();
+            m_pending.pop_front();
+        }
+        if (count > 0 || m_woken || nowNs >= deadlineNs) {
+            m_woken = false;
+            return count;
+        }
+        const qint64 waitUntilNs = m_pending.empty() ? deadlineNs
+                                                     : std::min(deadlineNs, m_pending.front().timeNs);
+        m_cond.wait_for(lock, std::chrono::nanoseconds(waitUntilNs - nowNs));
+    }
+}
+
+void LoopbackMidiInput::wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_woken = true;
+    }
+    m_cond.notify_all();
+}
+
+void LoopbackMidiInput::inject(const MidiEvent &event)
+{
+    schedule(event, steadyNowNs());
+}
+
+void LoopbackMidiInput::replay(const std::vector<MidiEvent> &events)
+{
+    const qint64 startNs = steadyNowNs();
+    for (const MidiEvent &event : events)
+        schedule(event, startNs + event.timeNs);
+}
+
+void LoopbackMidiInput::schedule(const MidiEvent &event, qint64 dueNs)
+{
+    MidiEvent due = event;
+    due.timeNs = dueNs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // upper_bound: события с одним сроком выдаются в порядке подачи
+        auto it = std::upper_bound(m_pending.begin(), m_pending.end(), dueNs,
+                                   [](qint64 ns, const MidiEvent &e) { return ns < e.timeNs; });
+        m_pending.insert(it, due);
+    }
+    m_cond.notify_all();
+}
+
+// MidiInput
+
+MidiInput::MidiInput(QObject *parent)
+    : QObject(parent)
+{
+}
+
+MidiInput::~MidiInput()
+{
+    stop();
+}
+
+bool MidiInput::openSystem()
+{
+#ifdef __LINUX_ALSA__
+    return start(std::make_unique<AlsaMidiInput>());
+#else
+    qWarning() << "MIDI-вход: системный бэкенд для этой платформы не реализован";
+    return false;
+#endif
+}
+
+LoopbackMidiInput *MidiInput::openLoopback()
+{
+    auto backend = std::make_unique<LoopbackMidiInput>();
+    LoopbackMidiInput *loopback = backend.get();
+    return start(std::move(backend)) ? loopback : nullptr;
+}
+
+bool MidiInput::start(std::unique_ptr<MidiInputBackend> backend)
+{
+    stop();
+    if (!backend || !backend->open())
+        return false;
+    m_backend = std::move(backend);
+    m_quit.store(false, std::memory_order_relaxed);
+    m_thread = std::thread(&MidiInput::run, this);
+    return true;
+}
+
+void MidiInput::stop()
+{
+    if (m_thread.joinable()) {
+        m_quit.store(true, std::memory_order_relaxed);
+        m_backend->wake();
+        m_thread.join();
+    }
+    m_backend.reset();
+    // Недоставленное от прежнего бэкенда не нужно; флаг сбрасываем, иначе
+    // после нового start() поток решит, что GUI уже разбужен
+    MidiInputEvent stale;
+    while (m_events.pop(stale)) {
+    }
+    m_drainPending.store(false, std::memory_order_relaxed);
+}
+
+void MidiInput::setPlaybackClock(const PlaybackClock &clock)
+{
+    std::lock_guard<std::mutex> lock(m_clockMutex);
+    m_clock = clock;
+}
+
+void MidiInput::setRecording(bool enabled)
+{
+    m_recording = enabled;
+}
+
+std::vector<MidiEvent> MidiInput::takeRecording()
+{
+    std::vector<MidiEvent> recorded;
+    recorded.swap(m_recorded);
+    if (!recorded.empty()) {
+        const qint64 startNs = recorded.front().timeNs;
+        for (MidiEvent &event : recorded)
+            event.timeNs -= startNs;
+    }
+    return recorded;
+}
+
+void MidiInput::run()
+{
+    Trace::setThreadName("midi input");
+    MidiEvent batch[BatchSize];
+
+    while (!m_quit.load(std::memory_order_relaxed)) {
+        const int count = m_backend->read(batch, BatchSize, PollTimeoutMs);
+        if (count <= 0)
+            continue;
+
+        PIANO_TRACE_ZONE("MidiInput::receive");
+        // Метка бэкенда — момент приёма; если её нет (или она из будущего),
+        // берём время пробуждения, одно на пачку
+        const qint64 nowNs = steadyNowNs();
+        PlaybackClock clock;
+        {
+            std::lock_guard<std::mutex> lock(m_clockMutex);
+            clock = m_clock;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            MidiInputEvent input;
+            input.event = batch[i];
+            if (input.event.timeNs <= 0 || input.event.timeNs > nowNs)
+                input.event.timeNs = nowNs;
+            input.positionMs = clock.positionMsAt(input.event.timeNs);
+            // Звук — первым; переполнение колец считают их overflowCount()
+            if (m_synth)
+                m_synth->inputEvent(input.event);
+            m_events.push(input);
+        }
+        Metrics::add(Metrics::InputEvents, count);
+
+        // Будим GUI один раз, пока он не забрал прошлую пачку
+        if (!m_drainPending.exchange(true, std::memory_order_acq_rel))
+            QMetaObject::invokeMethod(this, [this] { drain(); }, Qt::QueuedConnection);
+    }
+}
+
+void MidiInput::drain()
+{
+    PIANO_TRACE_ZONE("MidiInput::drain");
+    // Сбрасываем до чтения: событие, пришедшее во время разбора, разбудит заново
+    m_drainPending.store(false, std::memory_order_release);
+
+    const qint64 nowNs = steadyNowNs();
+    MidiInputEvent input;
+    while (m_events.pop(input)) {
+        Metrics::record(Metrics::InputToGuiUs, (nowNs - input.event.timeNs) / 1000);
+        if (m_recording)
+            m_recorded.push_back(input.event);
+        emit eventReceived(input);
+    }
+}
@@ -0,0 +1,135 @@
+// MidiInput.h
+#ifndef MIDIINPUT_H
+#define MIDIINPUT_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MidiEvent.h"
+#include "PlaybackClock.h"
+#include "SpscRing.h"
+
+class SynthEngine;
+
+// Событие с клавиатуры ученика. event.timeNs — момент приёма
+// (steady_clock): метка бэкенда, а без неё — пробуждение потока ввода;
+// positionMs — позиция песни по часам воспроизведения в этот момент.
+struct MidiInputEvent {
+    MidiEvent event;
+    qint64 positionMs = 0;
+};
+
+// Источник событий для потока ввода. read() ждёт не дольше timeoutMs и
+// возвращает число событий, записанных в out. timeNs — момент приёма в
+// steady_clock, если бэкенд его знает, иначе 0: тогда метку ставит поток.
+// wake() прерывает ожидание в read() из другого потока.
+class MidiInputBackend {
+public:
+    virtual ~MidiInputBackend() = default;
+    virtual QString name() const = 0;
+    virtual bool open() = 0;   // false — qWarning с причиной
+    virtual int read(MidiEvent *out, int capacity, int timeoutMs) = 0;
+    virtual void wake() = 0;
+    // Подключённые устройства, если бэкенд их различает
+    virtual QStringList sources() const { return QStringList(); }
+};
+
+// Вход без железа: события подаются из программы. inject() — «нажато
+// сейчас», replay() — записанная игра с исходными интервалами между
+// событиями (MidiInput::takeRecording). Подходит для замеров и для
+// проверки оценки игры без клавиатуры.
+class LoopbackMidiInput : public MidiInputBackend {
+public:
+    QString name() const override { return QString("Loopback"); }
+    bool open() override { return true; }
+    int read(MidiEvent *out, int capacity, int timeoutMs) override;
+    void wake() override;
+
+    void inject(const MidiEvent &event);
+    // event.timeNs — смещение от начала воспроизведения, нс
+    void replay(const std::vector<MidiEvent> &events);
+
+private:
+    void schedule(const MidiEvent &event, qint64 dueNs);
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<MidiEvent> m_pending;   // timeNs — момент выдачи, по возрастанию
+    bool m_woken = false;
+};
+
+// Живой MIDI-вход. Поток ввода ждёт события бэкенда, дополняет их
+// меткой времени (если её не поставил бэкенд) и позицией песни и сразу
+// отдаёт синтезатору (SynthEngine::inputEvent — звук не ждёт цикла GUI),
+// а через SpscRing — в поток GUI: на пачку событий одно пробуждение
+// (queued-вызов drain), дальше сигнал eventReceived для клавиатуры,
+// оценки и прочих слушателей.
+//
+// Задержка считается по метке приёма: до разбора в GUI
+// (Metrics::InputToGuiUs) и до отрисовки клавиши
+// (Metrics::InputToScreenUs, пишет PianoKeyboardWidget).
+class MidiInput : public QObject {
+    Q_OBJECT
+public:
+    static constexpr int PollTimeoutMs = 100;   // как часто поток проверяет остановку
+    static constexpr int BatchSize = 64;
+
+    explicit MidiInput(QObject *parent = nullptr);
+    ~MidiInput() override;
+
+    // Системный вход: ALSA sequencer на Linux (все устройства, в том
+    // числе подключённые позже). false — бэкенда нет или он не открылся.
+    bool openSystem();
+    // Вход без железа; указатель живёт до stop() или следующего open
+    LoopbackMidiInput *openLoopback();
+    bool start(std::unique_ptr<MidiInputBackend> backend);
+    void stop();
+    // Куда поток ввода отдаёт события для звука; менять только при
+    // остановленном вводе (до open/start)
+    void setSynth(SynthEngine *engine) { m_synth = engine; }
+
+    bool isOpen() const { return m_backend != nullptr; }
+    QString backendName() const { return m_backend ? m_backend->name() : QString(); }
+    QStringList sources() const { return m_backend ? m_backend->sources() : QStringList(); }
+    // Событий, не влезших в кольцо к GUI
+    qint64 droppedCount() const { return qint64(m_events.overflowCount()); }
+
+    // Запись принятого (в GUI-потоке) для последующего replay()
+    void setRecording(bool enabled);
+    // Записанное; timeNs — смещение от первого события
+    std::vector<MidiEvent> takeRecording();
+
+public slots:
+    // Часы воспроизведения для positionMs
+    void setPlaybackClock(const PlaybackClock &clock);
+
+signals:
+    void eventReceived(const MidiInputEvent &event);
+
+private:
+    void run();
+    void drain();
+
+    std::unique_ptr<MidiInputBackend> m_backend;
+    std::thread m_thread;
+    std::atomic<bool> m_quit{false};
+    SynthEngine *m_synth = nullptr;
+
+    SpscRing<MidiInputEvent> m_events{1024};
+    std::atomic<bool> m_drainPending{false};
+
+    std::mutex m_clockMutex;   // поток ввода берёт копию раз на пачку
+    PlaybackClock m_clock;
+
+    bool m_recording = false;
+    std::vector<MidiEvent> m_recorded;
+};
+
+#endif
@@ -1,71 +1,269 @@
 #include "MidiParser.h"
+#include "SmfReader.h"
+#include "SongCache.h"
+#include "Trace.h"
 #include <QDebug>
-
-// midifile
-#include "MidiFile.h"
-
-using namespace smf;
+#include <QElapsedTimer>
+#include <QFile>
+#include <algorithm>
+#include <vector>
 
 MidiParser::MidiParser() {}
 MidiParser::~MidiParser() {}
 
+NoteStore MidiParser::takeNotes()
+{
+    NoteStore taken(std::move(notes));
+    notes.clear();
+    loaded = false;
+    return taken;
+}
+
 bool MidiParser::parseFile(const QString &filePath) {
+    PIANO_TRACE_ZONE("MidiParser::parseFile");
     notes.clear();
+    tempoMap.reset(480);
+    controls.clear();
+    trackNames.clear();
+    format = 0;
     durationMs = 0;
+    stats = MidiParseStats();
     loaded = false;
+    canceled = false;
 
-    MidiFile mf;
-    if (!mf.read(filePath.toStdString())) {
-        qWarning() << "midifile: cannot read" << filePath;
+    QElapsedTimer timer;
+    timer.start();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "MidiParser: cannot open" << filePath;
+        return false;
+    }
+
+    // Файл целиком отображаем в память: дорожки читаются курсорами
+    // прямо из страниц ОС, без промежуточных буферов.
+    const qint64 size = file.size();
+    uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if (!data) {
+        qWarning() << "MidiParser: cannot map" << filePath;
         return false;
     }
-    if (!mf.status()) {
-        qWarning() << "midifile: read status failed for" << filePath;
+
+    // Хэш содержимого — ключ кэша: при попадании ноты берутся прямо
+    // из отображённого файла кэша, разбор не нужен. Отмену проверяем
+    // между шагами: хэш и кэш большого файла — это тоже сотни мс
+    QByteArray hash;
+    if (useCache) {
+        hash = SongCache::contentHash(data, size);
+        if (!cancelRequested())
+            stats.fromCache = SongCache::load(filePath, hash, notes, tempoMap, controls,
+                                              trackNames, format, durationMs);
+    }
+
+    const bool ok = !cancelRequested() && (stats.fromCache || parseData(data, size));
+    file.unmap(data);
+
+    if (ok && useCache && !stats.fromCache && !cancelRequested())
+        SongCache::store(filePath, hash, notes, tempoMap, controls, trackNames, format, durationMs);
+
+    stats.bytes     = size;
+    stats.elapsedNs = timer.nsecsElapsed();
+
+    if (!ok)
+        return false;
+
+    qDebug() << "MidiParser notes:" << notes.size()
+             << (stats.fromCache ? "(cached)" : "")
+             << "duration(ms):" << durationMs
+             << "events:" << stats.events
+             << "tempo segments:" << tempoMap.segmentCount()
+             << "MB/s:" << stats.megabytesPerSecond();
+
+    loaded = !notes.isEmpty();
+    return loaded;
+}
+
+bool MidiParser::cancelRequested()
+{
+    if (canceled)
+        return true;
+    if (!control || !control->cancel || !control->cancel->load(std::memory_order_relaxed))
+        return false;
+    canceled = true;
+    notes.clear();
+    controls.clear();
+    return true;
+}
+
+bool MidiParser::parseData(const uchar *data, qint64 size)
+{
+    SmfHeader header;
+    QVector<SmfTrackSpan> spans;
+    QString errorText;
+    if (!readSmfLayout(data, size, header, spans, &errorText)) {
+        qWarning() << "MidiParser:" << errorText;
         return false;
     }
 
-    // Важно: анализ времени с учетом tempo meta-messages:
-    mf.doTimeAnalysis();     // выставляет .seconds у событий по tempo map [page:0]
-    mf.linkNotePairs();      // связывает note-on/off, дает getDurationInSeconds() [page:0]
+    format = header.format;
+    trackNames = QVector<QString>(spans.size());
+
+    std::vector<SmfTrackCursor> cursors;
+    cursors.reserve(spans.size());
+    for (const auto &span : spans)
+        cursors.emplace_back(span);
+
+    // k-way merge дорожек: куча индексов, сверху — самое раннее событие.
+    // При равных тиках раньше идёт дорожка с меньшим номером.
+    auto later = [&cursors](int a, int b) {
+        const quint32 ta = cursors[a].tick();
+        const quint32 tb = cursors[b].tick();
+        return ta != tb ? ta > tb : a > b;
+    };
+
+    std::vector<int> heap;
+    heap.reserve(cursors.size());
+    for (int i = 0; i < int(cursors.size()); ++i) {
+        if (!cursors[i].atEnd())
+            heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    // Карта темпа строится на лету: события приходят в порядке тиков,
+    // поэтому смена темпа всегда дописывается в конец карты, а перевод
+    // очередного тика попадает в последний отрезок.
+    if (header.division < 0) {
+        int fps = -qint8(header.division >> 8);
+        const int ticksPerFrame = header.division & 0xFF;
+        const double ticksPerSecond = (fps == 29 ? 29.97 : double(fps)) * ticksPerFrame;
+        if (ticksPerSecond <= 0.0) {
+            qWarning() << "MidiParser: bad SMPTE division";
+            return false;
+        }
+        tempoMap.resetSmpte(ticksPerSecond);
+    } else {
+        tempoMap.reset(header.division);
+    }
+
+    // Открытые ноты по (channel, pitch): FIFO через односвязный список
+    // индексов в notes — note-off закрывает самую раннюю открытую ноту.
+    const int keyCount = 16 * 128;
+    std::vector<int> openHead(keyCount, -1);
+    std::vector<int> openTail(keyCount, -1);
+    std::vector<int> nextOpen;
+
+    // Дорожка ноты — номер MTrk. В формате 0 дорожка одна, и руки
+    // разнесены только по каналам: тогда дорожкой служит канал.
+    const bool tracksByChannel = header.format == 0;
+
+    const qint64 estimatedNotes = size / 6;
+    notes.reserve(estimatedNotes);
+    nextOpen.reserve(estimatedNotes);
 
-    // Чтобы проходить в одном списке:
-    mf.joinTracks();
+    qint64 totalBytes = 0;
+    for (const auto &span : spans)
+        totalBytes += span.end - span.begin;
+    bool prefixSent = !control || !control->prefix || control->prefixMs <= 0;
 
-    // Длительность файла:
-    durationMs = static_cast<qint64>(mf.getFileDurationInSeconds() * 1000.0);
+    qint64 lastUs = 0;
+    qint64 events = 0;
+    bool truncated = false;
+    SmfEvent ev;
 
-    // Забираем ноты:
-    for (int i = 0; i < mf[0].getEventCount(); ++i) {
-        auto &ev = mf[0][i];
-        if (!ev.isNoteOn())
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        const int track = heap.back();
+        SmfTrackCursor &cursor = cursors[track];
+
+        const bool gotEvent = cursor.next(ev);
+        if (cursor.atEnd()) {
+            truncated |= cursor.hasError();
+            heap.pop_back();
+        } else {
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+        if (!gotEvent)
             continue;
 
-        double startSec = ev.seconds;
-        double durSec   = ev.getDurationInSeconds(); // после linkNotePairs [page:0]
-        if (durSec <= 0.0)
+        ++events;
+        const qint64 us = tempoMap.tickToUs(ev.tick);
+        lastUs = qMax(lastUs, us);
+
+        if (control && (events & 0x3FFF) == 0) {
+            if (cancelRequested())
+                return false;
+            if (control->progress) {
+                qint64 left = 0;
+                for (int i : heap)
+                    left += cursors[i].bytesLeft();
+                control->progress(int(100 * (totalBytes - left) / qMax<qint64>(totalBytes, 1)));
+            }
+        }
+        if (!prefixSent && us / 1000 >= control->prefixMs) {
+            prefixSent = true;
+            control->prefix(notes.snapshot(quint32(us / 1000)), tempoMap, controls, us / 1000);
+        }
+
+        if (ev.isMeta()) {
+            if (ev.metaType == 0x51 && ev.length == 3) {
+                tempoMap.addTempo(ev.tick, (quint32(ev.payload[0]) << 16)
+                                         | (quint32(ev.payload[1]) << 8) | ev.payload[2]);
+            } else if (ev.metaType == 0x03 && trackNames[track].isEmpty()) {
+                trackNames[track] = QString::fromLatin1(reinterpret_cast<const char *>(ev.payload),
+                                                        ev.length).trimmed();
+            }
             continue;
+        }
 
-        MidiNote n;
-        n.pitch     = static_cast<uint8_t>(ev.getKeyNumber());  // pitch
-        n.velocity  = static_cast<uint8_t>(ev.getVelocity());   // vel
-        n.channel   = static_cast<uint8_t>(ev.getChannelNibble());
-        n.startTime = static_cast<qint64>(startSec * 1000.0);
-        n.duration  = static_cast<qint64>(durSec   * 1000.0);
+        const int kind = ev.kind();
+        if (kind == 0xB0 || kind == 0xC0) {
+            // События идут по времени — список контроллеров сразу отсортирован
+            ControlEvent cc;
+            cc.timeMs     = quint32(us / 1000);
+            cc.channel    = quint8(ev.channel());
+            cc.controller = kind == 0xC0 ? quint8(ControlEvent::Program) : ev.data1;
+            cc.value      = kind == 0xC0 ? ev.data1 : ev.data2;
+            if (kind == 0xC0 || ControlEvent::isTracked(cc.controller))
+                controls.push_back(cc);
+            continue;
+        }
+        if (kind != 0x90 && kind != 0x80)
+            continue;
 
-        notes.push_back(n);
-    }
+        const int key = ev.channel() * 128 + ev.data1;
 
-    // Если durationMs почему-то 0, можно взять максимум из нот:
-    if (durationMs <= 0) {
-        qint64 maxEnd = 0;
-        for (const auto &n : notes)
-            maxEnd = qMax(maxEnd, n.startTime + n.duration);
-        durationMs = maxEnd;
+        if (kind == 0x90 && ev.data2 > 0) {
+            const int index = notes.append(quint32(us / 1000), ev.data1, ev.data2,
+                                           quint8(ev.channel()),
+                                           tracksByChannel ? ev.channel() : track);
+            nextOpen.push_back(-1);
+
+            if (openTail[key] >= 0)
+                nextOpen[openTail[key]] = index;
+            else
+                openHead[key] = index;
+            openTail[key] = index;
+        } else {
+            // note-off или note-on с velocity 0
+            const int index = openHead[key];
+            if (index < 0)
+                continue;
+            openHead[key] = nextOpen[index];
+            if (openHead[key] < 0)
+                openTail[key] = -1;
+
+            notes.setEnd(index, quint32(us / 1000));
+        }
     }
 
-    qDebug() << "midifile notes:" << notes.size()
-             << "duration(ms):" << durationMs;
+    if (truncated)
+        qWarning() << "MidiParser: truncated or malformed track data, using what was read";
 
-    loaded = !notes.isEmpty();
-    return loaded;
+    // Незакрытые ноты и ноты нулевой длины не рисуются и не звучат
+    notes.finalize();
+
+    durationMs = qMax(lastUs / 1000, qint64(notes.endOfLastNote()));
+
+    stats.events = events;
+    return true;
 }
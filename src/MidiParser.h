@@ -4,14 +4,34 @@
 
 #include <QString>
 #include <QVector>
-#include <cstdint>
-
-struct MidiNote {
-    uint8_t pitch;
-    uint8_t velocity;
-    qint64 startTime;   // ms
-    qint64 duration;    // ms
-    uint8_t channel;
+#include <atomic>
+#include <functional>
+#include "ControllerState.h"
+#include "NoteStore.h"
+#include "TempoMap.h"
+
+// Статистика последнего разбора
+struct MidiParseStats {
+    qint64 bytes     = 0;
+    qint64 events    = 0;
+    qint64 elapsedNs = 0;
+    bool   fromCache = false;   // ноты взяты из SongCache
+
+    double megabytesPerSecond() const {
+        return elapsedNs > 0 ? (double(bytes) / 1.0e6) / (double(elapsedNs) / 1.0e9) : 0.0;
+    }
+};
+
+// Управление долгим разбором из фонового потока. Колбэки вызываются
+// в потоке разбора.
+struct MidiParseControl {
+    const std::atomic<bool> *cancel = nullptr;
+    std::function<void(int percent)> progress;
+    // Когда разбор дошёл до prefixMs времени песни, prefix получает копию
+    // уже прочитанного начала (незакрытые ноты обрезаны текущим моментом)
+    qint64 prefixMs = 0;
+    std::function<void(NoteStore &&notes, const TempoMap &tempoMap,
+                       const ControlEventList &controls, qint64 durationMs)> prefix;
 };
 
 class MidiParser {
@@ -21,14 +41,40 @@ public:
 
     bool parseFile(const QString &filePath);
     bool isLoaded() const { return loaded; }
+    bool wasCanceled() const { return canceled; }
+    // Задаётся до parseFile и должен пережить его
+    void setControl(const MidiParseControl *parseControl) { control = parseControl; }
+    // Кэш разобранных песен (SongCache); выключается для замеров холодного разбора
+    void setUseCache(bool enabled) { useCache = enabled; }
 
     qint64 getDuration() const { return durationMs; }
-    const QVector<MidiNote>& getNotes() const { return notes; }
+    const NoteStore& getNotes() const { return notes; }
+    // Забирает ноты без копирования; парсер после этого пуст
+    NoteStore takeNotes();
+    const TempoMap& getTempoMap() const { return tempoMap; }
+    // Громкость, педаль и программы каналов по времени (см. ControlEvent)
+    const ControlEventList& getControls() const { return controls; }
+    int getFormat() const { return format; }
+    // Имена дорожек (meta 0x03) по номеру MTrk; пустые, если не заданы
+    const QVector<QString>& getTrackNames() const { return trackNames; }
+    const MidiParseStats& getParseStats() const { return stats; }
 
 private:
-    QVector<MidiNote> notes;
+    bool parseData(const uchar *data, qint64 size);
+    // Отмена из MidiParseControl: ставит canceled и сбрасывает разобранное
+    bool cancelRequested();
+
+    NoteStore notes;
+    TempoMap tempoMap;
+    ControlEventList controls;
+    QVector<QString> trackNames;
+    int format = 0;
     qint64 durationMs = 0;
+    MidiParseStats stats;
     bool loaded = false;
+    bool canceled = false;
+    bool useCache = true;
+    const MidiParseControl *control = nullptr;
 };
 
 #endif
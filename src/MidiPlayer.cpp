@@ -1,78 +1,162 @@
 #include "MidiPlayer.h"
-#include "MidiParser.h"
+#include "Metrics.h"
+#include "SynthEngine.h"
+#include "Trace.h"
 #include <QTimer>
 #include <QDebug>
 #include <QFileInfo>
 
 MidiPlayer::MidiPlayer(QObject *parent)
     : QObject(parent),
-      parser(std::make_unique<MidiParser>()),
+      m_song(Song::empty()),
       currentPosition(0),
       totalDuration(0),
       isPlaying(false),
-      currentTempo(120) {
+      currentSpeedPercent(100) {
     
+    // Таймер раз в кадр опрашивает позицию и разбирает кольцо GUI-событий;
+    // сами события раздаёт поток секвенсора.
     playbackTimer = new QTimer(this);
+    playbackTimer->setTimerType(Qt::PreciseTimer);
     connect(playbackTimer, &QTimer::timeout, this, &MidiPlayer::onTimerTick);
+
+    SequencerThread::Callbacks callbacks;
+    callbacks.audioEvent = [this](const MidiEvent &event) {
+        if (synth)
+            synth->pushEvent(event);
+    };
+    callbacks.guiEvent = [this](const MidiEvent &event, quint32 epoch) {
+        guiEvents.push(GuiEvent{ event, epoch });
+    };
+    // Перемотка: секвенсор сам глушит синтезатор и следом досылает
+    // контроллеры новой позиции — из GUI allNotesOff их бы выбросил
+    callbacks.audioReset = [this]() {
+        if (synth)
+            synth->allNotesOff();
+    };
+    callbacks.finished = [this]() {
+        QMetaObject::invokeMethod(this, [this]() { onSequencerFinished(); }, Qt::QueuedConnection);
+    };
+    sequencer = std::make_unique<SequencerThread>(std::move(callbacks));
 }
 
 MidiPlayer::~MidiPlayer() {
 }
 
-bool MidiPlayer::loadFile(const QString &filePath) {
-    if (parser->parseFile(filePath)) {
-        const auto &notes = parser->getNotes();
-        qDebug() << "Loaded MIDI notes:" << notes.size();
-        if (!notes.isEmpty()) {
-            qDebug() << "First note pitch/start/duration(ms):"
-                     << notes[0].pitch
-                     << notes[0].startTime
-                     << notes[0].duration;
-        }
-
-        totalDuration   = parser->getDuration();
-        currentPosition = 0;
-        eventIndex      = 0;
-        noteIndex       = 0;
+void MidiPlayer::setSong(const SongPtr &newSong)
+{
+    PIANO_TRACE_ZONE("MidiPlayer::setSong");
+    const SongPtr current = song();
+    if (tailExpected && newSong && newSong->filePath() == current->filePath()) {
+        // Дочитанный хвост: секвенсор переключается на ходу, позиция сохраняется
+        tailExpected = !newSong->isComplete();
+        std::atomic_store(&m_song, newSong);
+        sequencer->replaceSong(newSong);
+        totalDuration = newSong->durationMs();
         emit durationChanged(totalDuration);
-        emit fileLoaded(QFileInfo(filePath).fileName());
-        return true;
+        if (waitingForTail && isPlaying) {
+            waitingForTail = false;
+            sequencer->start();
+            resyncKeyState(sequencer->positionMs());
+        }
+        publishClock();
+        return;
     }
 
-    emit error("Ошибка при загрузке MIDI файла: " + filePath);
-    return false;
+    isPlaying = false;
+    waitingForTail = false;
+    playbackTimer->stop();
+    if (synth)
+        synth->allNotesOff();
+    releaseAllKeys();
+    publishKeyState();
+
+    // Подмена указателя — атомарна: читатели видят либо старую песню
+    // целиком, либо новую
+    const SongPtr next = newSong ? newSong : Song::empty();
+    std::atomic_store(&m_song, next);
+    sequencer->setSong(next);
+    flushGuiEvents();
+    tailExpected = !next->isComplete();
+    totalDuration   = next->durationMs();
+    currentPosition = 0;
+
+    if (isLoaded())
+        qDebug() << "Loaded MIDI notes:" << next->notes().size()
+                 << (next->isComplete() ? "" : "(prefix)");
+
+    emit durationChanged(totalDuration);
+    publishClock();
+    emit fileLoaded(QFileInfo(next->filePath()).fileName());
+}
+
+void MidiPlayer::abandonTail()
+{
+    if (!tailExpected)
+        return;
+    tailExpected = false;
+    if (waitingForTail)
+        stop();
+}
+
+void MidiPlayer::onSequencerFinished()
+{
+    // Доиграли только начало: часы стоят на его конце, ждём хвост
+    if (tailExpected && isPlaying) {
+        waitingForTail = true;
+        return;
+    }
+    stop();
 }
 
 void MidiPlayer::play() {
-    if (!parser->isLoaded()) {
+    if (!isLoaded()) {
         emit error("Файл не загружен");
         return;
     }
     
     isPlaying = true;
-    playbackTimer->start(50); // Обновляем каждые 50ms
+    sequencer->setAudioLookaheadUs(synth ? synth->lookaheadUs() : 0);
+    sequencer->start();
+    playbackTimer->start(16); // опрос позиции ~60 раз в секунду
+    publishClock();
     emit playbackStarted();
 }
 
 void MidiPlayer::pause() {
     isPlaying = false;
+    waitingForTail = false;
+    sequencer->pause();
     playbackTimer->stop();
+    flushGuiEvents();
+    if (synth)
+        synth->allNotesOff();
+    currentPosition = sequencer->positionMs();
+    resyncKeyState(currentPosition);
+    publishClock();
     emit playbackPaused();
 }
 
 void MidiPlayer::stop() {
     isPlaying = false;
+    waitingForTail = false;
+    sequencer->pause();
+    sequencer->seek(0);
     playbackTimer->stop();
+    flushGuiEvents();
+    releaseAllKeys();
+    publishKeyState();
     currentPosition = 0;
-    eventIndex = 0;
-    noteIndex  = 0;
+    publishClock();
+    emit seeked(0);
     emit positionChanged(0);
     emit playbackStopped();
 }
 
 void MidiPlayer::setPosition(qint64 position)
 {
-    if (!parser || !parser->isLoaded())
+    PIANO_TRACE_ZONE("MidiPlayer::setPosition");
+    if (!isLoaded())
         return;
 
     if (position < 0)
@@ -81,70 +165,138 @@ void MidiPlayer::setPosition(qint64 position)
         position = totalDuration;
 
     currentPosition = position;
+    sequencer->seek(currentPosition);
+    flushGuiEvents();
+    resyncKeyState(currentPosition);
+    publishClock();
+    emit seeked(currentPosition);
     emit positionChanged(currentPosition);
-
-    const auto &notes = parser->getNotes();
-    noteIndex = 0;
-    while (noteIndex < notes.size() && notes[noteIndex].startTime < currentPosition) {
-        ++noteIndex;
-    }
 }
 
-void MidiPlayer::setTempo(int bpm) {
-    currentTempo = bpm;
+void MidiPlayer::setSpeedPercent(int percent) {
+    if (percent <= 0)
+        return;
+    currentSpeedPercent = percent;
+    // Время нот уже посчитано по карте темпа файла; скорость лишь
+    // растягивает часы секвенсора
+    sequencer->setSpeed(double(currentSpeedPercent) / 100.0);
+    publishClock();
 }
 
-void MidiPlayer::onTimerTick()
+void MidiPlayer::setTrackMasks(quint64 audible, quint64 autoplay)
 {
-    if (!isPlaying || !parser || !parser->isLoaded())
+    PIANO_TRACE_ZONE("MidiPlayer::setTrackMasks");
+    autoplayTracks = autoplay;
+    sequencer->setTrackMasks(audible, autoplay);
+    flushGuiEvents();
+    if (!isLoaded())
         return;
+    // Клавиши — по новой маске, как после перемотки
+    if (isPlaying)
+        currentPosition = sequencer->positionMs();
+    resyncKeyState(currentPosition);
+}
 
-    // Темп: пока будем считать, что currentTempo масштабирует время
-    int baseTempo = 120;
-    double tempoFactor = static_cast<double>(currentTempo) / static_cast<double>(baseTempo);
+double MidiPlayer::effectiveBpmAt(qint64 positionMs) const
+{
+    return song()->tempoMap().bpmAtUs(positionMs * 1000) * currentSpeedPercent / 100.0;
+}
 
-    qint64 deltaMs = static_cast<qint64>(50 * tempoFactor);
-    currentPosition += deltaMs;
+SequencerThread::TimingStats MidiPlayer::timingStats() const
+{
+    return sequencer->timingStats();
+}
 
-    if (currentPosition >= totalDuration) {
-        stop();
-        return;
-    }
+quint64 MidiPlayer::droppedEvents() const
+{
+    return guiEvents.overflowCount() + (synth ? synth->droppedEvents() : 0);
+}
 
-    emit positionChanged(currentPosition);
+void MidiPlayer::resyncKeyState(qint64 position)
+{
+    // Клавиши, которые должны быть нажаты в position: запрос к индексам
+    // интервалов только автоматически играемых дорожек
+    const SongPtr current = song();
+    const NoteStore &notes = current->notes();
+    releaseAllKeys();
+    const quint32 positionMs = quint32(qMax<qint64>(position, 0));
+    current->trackViews().overlapping(notes, autoplayTracks, positionMs, positionMs + 1, activeNotes);
+    for (quint32 i : activeNotes)
+        pressKey(notes.pitch(i), notes.velocity(i), notes.channel(i));
+    publishKeyState();
+}
 
-    const auto &notes = parser->getNotes();
-    if (notes.isEmpty())
-        return;
+void MidiPlayer::pressKey(int pitch, int velocity, int channel)
+{
+    keyChannels[size_t(pitch)] |= quint16(1u << channel);
+    keyState.press(pitch, velocity, channel);
+}
 
-    // 1) Включаем ноты, старт которых <= currentPosition
-    while (noteIndex < notes.size()) {
-        const auto &n = notes[noteIndex];
+void MidiPlayer::releaseKey(int pitch, int channel)
+{
+    quint16 &channels = keyChannels[size_t(pitch)];
+    channels &= quint16(~(1u << channel));
+    if (channels == 0)
+        keyState.release(pitch);
+}
 
-        if (n.startTime > currentPosition)
-            break;
+void MidiPlayer::releaseAllKeys()
+{
+    keyChannels.fill(0);
+    keyState.releaseAll();
+}
 
-        // Старт ноты
-        emit noteOn(static_cast<int>(n.pitch), static_cast<int>(n.velocity));
-        ++noteIndex;
-    }
+void MidiPlayer::publishKeyState()
+{
+    keyState.positionMs = currentPosition;
+    keyState.diffFrom(publishedKeyState);
+    if (!keyState.hasChanges())
+        return;
+    publishedKeyState = keyState;
+    emit keyStateChanged(keyState);
+}
 
-    // 2) Гасим ноты, у которых закончилась длительность
-    //    Проходим по всем нотам и выключаем те, что уже должны быть Off.
-    //    (Оптимизация потом; пока можно O(N) — у тебя записи не гигантские.)
-    for (const auto &n : notes) {
-        qint64 endTime = n.startTime + n.duration;
-        // небольшая «задержка» (5 ms), чтобы не мигали от неточностей
-        if (endTime <= currentPosition && endTime > currentPosition - deltaMs) {
-            emit noteOff(static_cast<int>(n.pitch));
-        }
-    }
+void MidiPlayer::publishClock()
+{
+    emit clockChanged(sequencer->clock());
 }
 
-const QVector<MidiNote>& MidiPlayer::getNotes() const
+void MidiPlayer::flushGuiEvents()
 {
-    static QVector<MidiNote> empty;
-    if (!parser || !parser->isLoaded())
-        return empty;
-    return parser->getNotes();
+    // Вызывается после команды секвенсору: всё, что он отдал до неё,
+    // относится к старой позиции (клавиши потом восстанавливает resync).
+    // Кольцо не чистим — поток мог уже положить события новой позиции;
+    // старые отсеются по эпохе в onTimerTick.
+    guiEpoch = sequencer->guiEpoch();
+}
+
+void MidiPlayer::onTimerTick()
+{
+    if (!isPlaying || !isLoaded())
+        return;
+    PIANO_TRACE_ZONE("MidiPlayer::onTimerTick");
+
+    // Все события, накопившиеся с прошлого кадра, сворачиваются в снимок
+    Metrics::set(Metrics::GuiQueueDepth, qint64(guiEvents.pushedCount() - guiEvents.poppedCount()));
+    GuiEvent item;
+    while (guiEvents.pop(item)) {
+        if (item.epoch != guiEpoch)
+            continue;
+        const MidiEvent &event = item.event;
+        if (event.type == MidiEvent::NoteOn && event.data2 > 0)
+            pressKey(event.data1, event.data2, event.channel);
+        else if (event.type == MidiEvent::NoteOn || event.type == MidiEvent::NoteOff)
+            releaseKey(event.data1, event.channel);
+    }
+
+    // Позиция всегда берётся из часов секвенсора, а не накапливается
+    currentPosition = sequencer->positionMs();
+    const quint64 overflows = guiEvents.overflowCount();
+    if (overflows != guiOverflowsSeen) {
+        guiOverflowsSeen = overflows;
+        resyncKeyState(currentPosition);
+    } else {
+        publishKeyState();
+    }
+    emit positionChanged(currentPosition);
 }
@@ -6,7 +6,12 @@
 #include <QTimer>
 #include <memory>
 
-#include "MidiParser.h"   // здесь объявлен MidiNote
+#include "KeyStateFrame.h"
+#include "MidiEvent.h"
+#include "SequencerThread.h"
+#include "Song.h"
+
+class SynthEngine;
 
 class MidiPlayer : public QObject {
     Q_OBJECT
@@ -15,41 +20,105 @@ public:
     explicit MidiPlayer(QObject *parent = nullptr);
     ~MidiPlayer();
 
-    bool loadFile(const QString &filePath);
+    // Песня из SongLoader. Если это дочитанная версия уже стоящего начала
+    // того же файла, она подменяется на ходу без остановки воспроизведения.
+    void setSong(const SongPtr &newSong);
+    // Текущая песня; никогда не nullptr (без файла — Song::empty()).
+    // Можно звать из любого потока: указатель читается атомарно.
+    SongPtr song() const { return std::atomic_load(&m_song); }
+    bool isLoaded() const { return !song()->isEmpty(); }
+    // Хвост песни не придёт (загрузка отменена или сорвалась) — играем начало
+    void abandonTail();
     void play();
     void pause();
     void stop();
     void setPosition(qint64 position);
-    void setTempo(int bpm);
+    // Позиция по часам секвенсора, мс
+    qint64 positionMs() const { return sequencer->positionMs(); }
+    // Скорость в процентах от собственного темпа файла (100 — как записано).
+    // Меняет только скорость часов секвенсора: ноты не пересчитываются.
+    void setSpeedPercent(int percent);
+    int speedPercent() const { return currentSpeedPercent; }
+    // Фактический темп в точке песни с учётом скорости; 0 для SMPTE-файлов
+    double effectiveBpmAt(qint64 positionMs) const;
+    // Маски дорожек (NoteStore::TrackMask): какие звучат и какие сами
+    // нажимают клавиши на экране. Действуют сразу, на ходу; смена песни
+    // их не сбрасывает.
+    void setTrackMasks(quint64 audible, quint64 autoplay);
+
+    // Синтезатор получает ноты прямо из потока секвенсора.
+    // Задаётся до начала воспроизведения и должен пережить плеер.
+    void setSynth(SynthEngine *engine) { synth = engine; }
+
+    // Часы воспроизведения для экстраполяции позиции между кадрами
+    PlaybackClock playbackClock() const { return sequencer->clock(); }
+
+    // Статистика точности раздачи событий потоком секвенсора
+    SequencerThread::TimingStats timingStats() const;
+    // События, потерянные из-за переполнения колец (GUI + аудио)
+    quint64 droppedEvents() const;
 
-    // Геттер обёртка:
-    const QVector<MidiNote>& getNotes() const;
 
 signals:
     void positionChanged(qint64 position);
+    // Перемотка или стоп: позиция сменилась скачком, а не ходом песни
+    void seeked(qint64 position);
     void durationChanged(qint64 duration);
     void playbackStarted();
     void playbackPaused();
     void playbackStopped();
     void fileLoaded(const QString &fileName);
     void error(const QString &message);
-    void noteOn(int midiNote, int velocity);
-    void noteOff(int midiNote);
+    // Раз в кадр, только если что-то изменилось: все ноты одним сигналом
+    void keyStateChanged(const KeyStateFrame &frame);
+    // После каждой команды управления (старт, пауза, перемотка, скорость)
+    void clockChanged(const PlaybackClock &clock);
 
 private slots:
     void onTimerTick();
 
 private:
-    std::unique_ptr<MidiParser> parser;
+    void flushGuiEvents();
+    void resyncKeyState(qint64 position);
+    void publishKeyState();
+    void publishClock();
+    void onSequencerFinished();
+    void pressKey(int pitch, int velocity, int channel);
+    void releaseKey(int pitch, int channel);
+    void releaseAllKeys();
+
+    SongPtr m_song;               // только через std::atomic_load/store
+    bool tailExpected = false;    // стоит начало песни, хвост ещё читается
+    bool waitingForTail = false;  // начало доиграно, ждём хвост
     QTimer *playbackTimer;
 
     qint64 currentPosition;
     qint64 totalDuration;
     bool isPlaying;
-    int currentTempo;
+    int currentSpeedPercent;
+    quint64 autoplayTracks = NoteStore::AllTracks;   // для resyncKeyState
+
+    SynthEngine *synth = nullptr;
+
+    // Секвенсор → GUI; разбирается раз в кадр в onTimerTick
+    struct GuiEvent {
+        MidiEvent event;
+        quint32 epoch = 0;   // SequencerThread::guiEpoch() на момент раздачи
+    };
+    SpscRing<GuiEvent> guiEvents{4096};
+    quint32 guiEpoch = 0;   // события других эпох при разборе выбрасываются
+    // Кольцо переполнялось — потерянный note-off оставил бы клавишу нажатой,
+    // поэтому снимок клавиш восстанавливается по песне (resyncKeyState)
+    quint64 guiOverflowsSeen = 0;
+    KeyStateFrame keyState;            // текущее состояние клавиш
+    // Каналы, на которых клавиша звучит: note-off приходят по каналам,
+    // отпущена клавиша, когда замолчал последний
+    std::array<quint16, 128> keyChannels{};
+    KeyStateFrame publishedKeyState;   // последнее отправленное
+    std::vector<quint32> activeNotes;  // буфер для resyncKeyState
 
-    int eventIndex = 0;
-    int noteIndex  = 0;
+    // Объявлен последним: останавливается раньше, чем уничтожаются данные песни
+    std::unique_ptr<SequencerThread> sequencer;
 };
 
 #endif // MIDIPLAYER_H
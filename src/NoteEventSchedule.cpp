@@ -0,0 +1,79 @@
+#include "NoteEventSchedule.h"
+#include "SeekIndex.h"
+#include <algorithm>
+#include <numeric>
+
+void NoteEventSchedule::build(const NoteStore &notes)
+{
+    const int n = notes.size();
+    m_events.clear();
+    m_events.reserve(size_t(2 * n));
+
+    // note-on уже упорядочены по старту; note-off упорядочиваем по концу
+    std::vector<quint32> offOrder(n);
+    std::iota(offOrder.begin(), offOrder.end(), 0u);
+    const quint32 *ends = notes.endTimes();
+    std::stable_sort(offOrder.begin(), offOrder.end(),
+                     [ends](quint32 a, quint32 b) { return ends[a] < ends[b]; });
+
+    // Слияние двух отсортированных потоков, off раньше on при равенстве
+    const quint32 *starts = notes.startTimes();
+    int on = 0;
+    int off = 0;
+    while (on < n || off < n) {
+        const bool takeOff = off < n && (on >= n || ends[offOrder[off]] <= starts[on]);
+        if (takeOff) {
+            const quint32 note = offOrder[off++];
+            m_events.push_back({ ends[note], note << 1 });
+        } else {
+            const quint32 note = quint32(on++);
+            m_events.push_back({ starts[note], (note << 1) | 1u });
+        }
+    }
+}
+
+int NoteEventSchedule::upperBound(quint32 timeMs) const
+{
+    auto it = std::upper_bound(m_events.begin(), m_events.end(), timeMs,
+                               [](quint32 t, const Event &ev) { return t < ev.timeMs; });
+    return int(it - m_events.begin());
+}
+
+void NoteEventCursor::reset()
+{
+    m_pos = 0;
+    m_refs.fill(0);
+}
+
+void NoteEventCursor::seek(const NoteEventSchedule &schedule, const NoteStore &notes,
+                           const SeekIndex &index, quint32 positionMs)
+{
+    // Хвост от точки до positionMs — только счётчики, наружу ничего
+    m_pos = schedule.upperBound(positionMs);
+    countRefs(schedule, notes, index, positionMs, m_pos, m_refs);
+}
+
+void NoteEventCursor::countRefs(const NoteEventSchedule &schedule, const NoteStore &notes,
+                                const SeekIndex &index, quint32 positionMs, int endPos,
+                                RefCounts &refs) const
+{
+    const SeekIndex::Checkpoint &cp = index.checkpointFor(positionMs);
+    refs.fill(0);
+    for (quint32 i = cp.activeBegin; i < cp.activeEnd; ++i) {
+        const int note = int(index.activeNotes()[i]);
+        if (accepts(notes, note))
+            ++refs[size_t(refKey(notes, note))];
+    }
+
+    for (int pos = cp.schedulePos; pos < endPos; ++pos) {
+        const NoteEventSchedule::Event &ev = schedule.at(pos);
+        const int note = ev.note();
+        if (!accepts(notes, note))
+            continue;
+        quint16 &count = refs[size_t(refKey(notes, note))];
+        if (ev.isOn())
+            ++count;
+        else if (count > 0)
+            --count;
+    }
+}
@@ -0,0 +1,146 @@
+// NoteEventSchedule.h
+#ifndef NOTEEVENTSCHEDULE_H
+#define NOTEEVENTSCHEDULE_H
+
+#include <QtGlobal>
+#include <array>
+#include <vector>
+#include "NoteStore.h"
+
+// Заранее посчитанный поток note-on/note-off, отсортированный по времени.
+// При равном времени note-off идёт раньше note-on, чтобы повторный удар по
+// той же клавише не гасился собственным предшественником.
+class NoteEventSchedule {
+public:
+    struct Event {
+        quint32 timeMs;
+        quint32 code;      // (индекс ноты << 1) | 1 для note-on
+
+        int note() const { return int(code >> 1); }
+        bool isOn() const { return code & 1u; }
+    };
+
+    void build(const NoteStore &notes);
+    void clear() { m_events.clear(); }
+
+    int size() const { return int(m_events.size()); }
+    bool isEmpty() const { return m_events.empty(); }
+    const Event &at(int i) const { return m_events[i]; }
+
+    // Первое событие строго позже timeMs
+    int upperBound(quint32 timeMs) const;
+
+private:
+    std::vector<Event> m_events;
+};
+
+class SeekIndex;
+
+// Курсор воспроизведения по расписанию. Хранит счётчик звучащих нот на
+// каждую пару (канал, высота): note-off отдаётся наружу, только когда
+// отпущена последняя из перекрывающихся нот этой высоты на этом канале.
+// Синтезатор глушит голоса по каналу, так что перекрытие на разных
+// каналах даёт по note-off на каждый.
+//
+// События нот дорожек вне маски курсор пропускает и не считает: выключенная
+// дорожка стоит одной проверки бита на событие, расписание не перестраивается.
+class NoteEventCursor {
+public:
+    using TrackMask = NoteStore::TrackMask;
+
+    NoteEventCursor() { reset(); }
+
+    // В начало песни; маска сохраняется
+    void reset();
+
+    // Проигрывает события в (предыдущее время, nowMs]:
+    // onNote(timeMs, pitch, velocity, channel) для note-on,
+    // offNote(timeMs, pitch, channel) для note-off.
+    template <typename OnFn, typename OffFn>
+    void advance(const NoteEventSchedule &schedule, const NoteStore &notes,
+                 quint32 nowMs, OnFn &&onNote, OffFn &&offNote);
+
+    // Переставляет курсор на positionMs: счётчики берутся из ближайшей
+    // контрольной точки и доигрываются по хвосту расписания до positionMs.
+    void seek(const NoteEventSchedule &schedule, const NoteStore &notes,
+              const SeekIndex &index, quint32 positionMs);
+
+    TrackMask trackMask() const { return m_mask; }
+    // Без пересчёта — для курсора, который ещё ничего не проиграл
+    void setTrackMask(TrackMask mask) { m_mask = mask; }
+    // Меняет маску на месте, без сдвига позиции: счётчики пересчитываются
+    // по новой маске, и для пар (канал, высота), которые от этого замолчали,
+    // вызывается offNote(timeMs, pitch, channel) с моментом последнего
+    // события курсора
+    template <typename OffFn>
+    void setTrackMask(const NoteEventSchedule &schedule, const NoteStore &notes,
+                      const SeekIndex &index, TrackMask mask, OffFn &&offNote);
+
+    int position() const { return m_pos; }
+    int refCount(int pitch, int channel) const { return m_refs[size_t(refKey(pitch, channel))]; }
+
+private:
+    // Счётчик на (канал, высота): 16 × 128
+    using RefCounts = std::array<quint16, 16 * 128>;
+    static int refKey(int pitch, int channel) { return (channel << 7) | pitch; }
+    static int refKey(const NoteStore &notes, int note) { return refKey(notes.pitch(note), notes.channel(note)); }
+
+    bool accepts(const NoteStore &notes, int note) const { return (m_mask >> notes.track(note)) & 1u; }
+    // Счётчики после событий [0, endPos), считая от контрольной точки
+    // на момент positionMs
+    void countRefs(const NoteEventSchedule &schedule, const NoteStore &notes,
+                   const SeekIndex &index, quint32 positionMs, int endPos, RefCounts &refs) const;
+
+    int m_pos = 0;
+    RefCounts m_refs;
+    TrackMask m_mask = NoteStore::AllTracks;
+};
+
+template <typename OnFn, typename OffFn>
+void NoteEventCursor::advance(const NoteEventSchedule &schedule, const NoteStore &notes,
+                              quint32 nowMs, OnFn &&onNote, OffFn &&offNote)
+{
+    const int count = schedule.size();
+    while (m_pos < count) {
+        const NoteEventSchedule::Event &ev = schedule.at(m_pos);
+        if (ev.timeMs > nowMs)
+            break;
+        ++m_pos;
+
+        const int note  = ev.note();
+        if (!accepts(notes, note))
+            continue;
+        const int pitch = notes.pitch(note);
+        const int channel = notes.channel(note);
+        quint16 &refs = m_refs[size_t(refKey(pitch, channel))];
+        if (ev.isOn()) {
+            ++refs;
+            onNote(ev.timeMs, pitch, int(notes.velocity(note)), channel);
+        } else if (refs > 0 && --refs == 0) {
+            offNote(ev.timeMs, pitch, channel);
+        }
+    }
+}
+
+template <typename OffFn>
+void NoteEventCursor::setTrackMask(const NoteEventSchedule &schedule, const NoteStore &notes,
+                                   const SeekIndex &index, TrackMask mask, OffFn &&offNote)
+{
+    if (mask == m_mask)
+        return;
+    m_mask = mask;
+    if (m_pos == 0)
+        return;   // ещё ничего не звучало
+
+    // События курсора до m_pos — это ровно всё, что не позже последнего из них
+    const quint32 nowMs = schedule.at(m_pos - 1).timeMs;
+    RefCounts refs;
+    countRefs(schedule, notes, index, nowMs, m_pos, refs);
+    for (int key = 0; key < int(refs.size()); ++key) {
+        if (m_refs[size_t(key)] > 0 && refs[size_t(key)] == 0)
+            offNote(nowMs, key & 127, key >> 7);
+    }
+    m_refs = refs;
+}
+
+#endif
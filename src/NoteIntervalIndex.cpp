@@ -0,0 +1,56 @@
+#include "NoteIntervalIndex.h"
+#include <algorithm>
+
+void NoteIntervalIndex::build(const quint32 *ends, int count)
+{
+    m_count = count;
+    const int blockCount = (count + BlockSize - 1) / BlockSize;
+
+    m_leafBase = 1;
+    while (m_leafBase < blockCount)
+        m_leafBase <<= 1;
+
+    m_tree.assign(size_t(2 * m_leafBase), 0);
+
+    for (int b = 0; b < blockCount; ++b) {
+        const int first = b * BlockSize;
+        const int last  = std::min(first + BlockSize, count);
+        quint32 maxEnd = 0;
+        for (int i = first; i < last; ++i)
+            maxEnd = std::max(maxEnd, ends[i]);
+        m_tree[m_leafBase + b] = maxEnd;
+    }
+
+    for (int node = m_leafBase - 1; node >= 1; --node)
+        m_tree[node] = std::max(m_tree[2 * node], m_tree[2 * node + 1]);
+    m_nodes = m_tree.data();
+}
+
+void NoteIntervalIndex::attach(const quint32 *tree, int leafBase, int count)
+{
+    m_tree.clear();
+    m_tree.shrink_to_fit();
+    m_nodes = tree;
+    m_leafBase = leafBase;
+    m_count = count;
+}
+
+NoteIntervalIndex &NoteIntervalIndex::operator=(const NoteIntervalIndex &other)
+{
+    if (this == &other)
+        return *this;
+    m_tree = other.m_tree;
+    const bool owned = other.m_nodes == other.m_tree.data();
+    m_nodes = owned ? m_tree.data() : other.m_nodes;
+    m_leafBase = other.m_leafBase;
+    m_count = other.m_count;
+    return *this;
+}
+
+void NoteIntervalIndex::clear()
+{
+    m_tree.clear();
+    m_nodes = nullptr;
+    m_leafBase = 0;
+    m_count = 0;
+}
@@ -0,0 +1,86 @@
+// NoteIntervalIndex.h
+#ifndef NOTEINTERVALINDEX_H
+#define NOTEINTERVALINDEX_H
+
+#include <QtGlobal>
+#include <vector>
+
+// Индекс интервалов звучания нот над массивами, отсортированными по старту.
+// Ноты разбиты на блоки по BlockSize; поверх блоков лежит неявное дерево
+// максимумов времени окончания. Запрос «что пересекает [t0, t1)» отрезает
+// бинарным поиском ноты, начинающиеся после t1, и спускается только в те
+// поддеревья, где есть нота с концом после t0: O(log n + k) на практике,
+// вместо прохода по всей песне.
+//
+// Индекс не хранит указателей на колонки — их передаёт владелец, поэтому
+// копирование NoteStore вместе с индексом безопасно. Само дерево может
+// лежать и во внешней памяти (кэш песни): attach() только запоминает адрес.
+class NoteIntervalIndex {
+public:
+    static constexpr int BlockSize = 32;
+
+    NoteIntervalIndex() = default;
+    NoteIntervalIndex(const NoteIntervalIndex &other) { *this = other; }
+    NoteIntervalIndex &operator=(const NoteIntervalIndex &other);
+
+    void build(const quint32 *ends, int count);
+    // Готовое дерево из 2 * leafBase узлов; память должна пережить индекс
+    void attach(const quint32 *tree, int leafBase, int count);
+    void clear();
+
+    const quint32 *treeData() const { return m_nodes; }
+    int treeSize() const { return 2 * m_leafBase; }
+    int leafBase() const { return m_leafBase; }
+
+    qint64 memoryUsage() const { return qint64(m_tree.capacity()) * sizeof(quint32); }
+
+    // Вызывает f(index) для нот [0, limit) с ends[index] > t0,
+    // по возрастанию индекса. limit — число нот со стартом < t1.
+    template <typename F>
+    void forEachOverlapping(const quint32 *ends, int limit, quint32 t0, F &&f) const;
+
+private:
+    std::vector<quint32> m_tree;   // [1, 2P): узлы, [P, 2P): листья-блоки
+    const quint32 *m_nodes = nullptr;   // m_tree.data() или внешнее дерево
+    int m_leafBase = 0;            // P — степень двойки
+    int m_count = 0;
+};
+
+template <typename F>
+void NoteIntervalIndex::forEachOverlapping(const quint32 *ends, int limit, quint32 t0, F &&f) const
+{
+    if (limit <= 0 || m_count == 0)
+        return;
+    if (limit > m_count)
+        limit = m_count;
+
+    const int lastBlock = (limit - 1) / BlockSize;
+
+    struct Item { int node; int firstBlock; int width; };
+    Item stack[64];
+    int top = 0;
+    stack[top++] = { 1, 0, m_leafBase };
+
+    while (top > 0) {
+        const Item it = stack[--top];
+        if (it.firstBlock > lastBlock || m_nodes[it.node] <= t0)
+            continue;
+
+        if (it.width == 1) {
+            const int first = it.firstBlock * BlockSize;
+            const int last  = qMin(first + BlockSize, limit);
+            for (int i = first; i < last; ++i) {
+                if (ends[i] > t0)
+                    f(i);
+            }
+            continue;
+        }
+
+        // Правый кладём первым, чтобы левый обработался раньше
+        const int half = it.width / 2;
+        stack[top++] = { it.node * 2 + 1, it.firstBlock + half, half };
+        stack[top++] = { it.node * 2, it.firstBlock, half };
+    }
+}
+
+#endif
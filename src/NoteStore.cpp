@@ -0,0 +1,261 @@
+#include "NoteStore.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+template <typename T>
+void permute(std::vector<T> &column, const std::vector<quint32> &order)
+{
+    std::vector<T> sorted(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        sorted[i] = column[order[i]];
+    column.swap(sorted);
+}
+
+} // namespace
+
+NoteStore &NoteStore::operator=(const NoteStore &other)
+{
+    if (this == &other)
+        return *this;
+    m_start = other.m_start;
+    m_end = other.m_end;
+    m_pitch = other.m_pitch;
+    m_velocity = other.m_velocity;
+    m_channel = other.m_channel;
+    m_track = other.m_track;
+    m_pitchOffsets = other.m_pitchOffsets;
+    m_pitchIndex = other.m_pitchIndex;
+    m_channelOffsets = other.m_channelOffsets;
+    m_channelIndex = other.m_channelIndex;
+    m_intervals = other.m_intervals;
+    m_backing = other.m_backing;
+
+    // Внешние колонки делим с оригиналом, свои — перепривязываем к копии
+    m_cols = other.m_cols;
+    if (!m_backing)
+        bindOwned();
+    return *this;
+}
+
+void NoteStore::bindOwned()
+{
+    // Сводные значения не зависят от того, где лежат колонки
+    const quint32 maxDuration = m_cols.maxDuration;
+    const quint32 lastEnd = m_cols.lastEnd;
+    const TrackMask presentTracks = m_cols.presentTracks;
+    m_cols = Columns();
+    m_cols.count          = int(m_start.size());
+    m_cols.start          = m_start.data();
+    m_cols.end            = m_end.data();
+    m_cols.pitch          = m_pitch.data();
+    m_cols.velocity       = m_velocity.data();
+    m_cols.channel        = m_channel.data();
+    m_cols.track          = m_track.data();
+    m_cols.pitchOffsets   = m_pitchOffsets.empty() ? nullptr : m_pitchOffsets.data();
+    m_cols.pitchIndex     = m_pitchIndex.data();
+    m_cols.channelOffsets = m_channelOffsets.empty() ? nullptr : m_channelOffsets.data();
+    m_cols.channelIndex   = m_channelIndex.data();
+    m_cols.maxDuration    = maxDuration;
+    m_cols.lastEnd        = lastEnd;
+    m_cols.presentTracks  = presentTracks;
+}
+
+NoteStore::Columns NoteStore::columns() const
+{
+    Columns c = m_cols;
+    c.intervalTree = m_intervals.treeData();
+    c.intervalLeafBase = m_intervals.leafBase();
+    return c;
+}
+
+void NoteStore::adopt(const Columns &columns, std::shared_ptr<const void> backing)
+{
+    clear();
+    m_backing = std::move(backing);
+    m_cols = columns;
+    m_cols.intervalTree = nullptr;
+    m_cols.intervalLeafBase = 0;
+    m_intervals.attach(columns.intervalTree, columns.intervalLeafBase, columns.count);
+}
+
+NoteStore::IndexRange NoteStore::notesForPitch(int pitch) const
+{
+    IndexRange r;
+    if (pitch < 0 || pitch > 127 || !m_cols.pitchOffsets)
+        return r;
+    r.first = m_cols.pitchIndex + m_cols.pitchOffsets[pitch];
+    r.last  = m_cols.pitchIndex + m_cols.pitchOffsets[pitch + 1];
+    return r;
+}
+
+NoteStore::IndexRange NoteStore::notesForChannel(int channel) const
+{
+    IndexRange r;
+    if (channel < 0 || channel > 15 || !m_cols.channelOffsets)
+        return r;
+    r.first = m_cols.channelIndex + m_cols.channelOffsets[channel];
+    r.last  = m_cols.channelIndex + m_cols.channelOffsets[channel + 1];
+    return r;
+}
+
+int NoteStore::lowerBound(quint32 timeMs) const
+{
+    const quint32 *first = m_cols.start;
+    const quint32 *last = first + m_cols.count;
+    return int(std::lower_bound(first, last, timeMs) - first);
+}
+
+void NoteStore::overlapping(quint32 t0Ms, quint32 t1Ms, std::vector<quint32> &out) const
+{
+    out.clear();
+    forEachOverlapping(t0Ms, t1Ms, [&out](int i) { out.push_back(quint32(i)); });
+}
+
+void NoteStore::activeAt(quint32 timeMs, std::vector<quint32> &out) const
+{
+    overlapping(timeMs, timeMs + 1, out);
+}
+
+qint64 NoteStore::memoryUsage() const
+{
+    const qint64 columns = qint64(m_start.capacity() + m_end.capacity()) * sizeof(quint32)
+                         + qint64(m_pitch.capacity() + m_velocity.capacity() + m_channel.capacity()
+                                + m_track.capacity());
+    const qint64 indices = qint64(m_pitchOffsets.capacity() + m_pitchIndex.capacity()
+                                + m_channelOffsets.capacity() + m_channelIndex.capacity()) * sizeof(quint32);
+    return columns + indices + m_intervals.memoryUsage();
+}
+
+void NoteStore::clear()
+{
+    m_start.clear();
+    m_end.clear();
+    m_pitch.clear();
+    m_velocity.clear();
+    m_channel.clear();
+    m_track.clear();
+    m_pitchOffsets.clear();
+    m_pitchIndex.clear();
+    m_channelOffsets.clear();
+    m_channelIndex.clear();
+    m_intervals.clear();
+    m_backing.reset();
+    m_cols = Columns();
+}
+
+void NoteStore::reserve(int count)
+{
+    m_start.reserve(count);
+    m_end.reserve(count);
+    m_pitch.reserve(count);
+    m_velocity.reserve(count);
+    m_channel.reserve(count);
+    m_track.reserve(count);
+}
+
+int NoteStore::append(quint32 startMs, quint8 pitch, quint8 velocity, quint8 channel, int track)
+{
+    m_start.push_back(startMs);
+    m_end.push_back(startMs);
+    m_pitch.push_back(pitch);
+    m_velocity.push_back(velocity);
+    m_channel.push_back(channel);
+    m_track.push_back(quint8(qBound(0, track, MaxTracks - 1)));
+    return int(m_start.size()) - 1;
+}
+
+void NoteStore::finalize()
+{
+    // 1) Выкидываем незакрытые ноты и ноты нулевой длины
+    size_t out = 0;
+    for (size_t i = 0; i < m_start.size(); ++i) {
+        if (m_end[i] <= m_start[i])
+            continue;
+        m_start[out]    = m_start[i];
+        m_end[out]      = m_end[i];
+        m_pitch[out]    = m_pitch[i];
+        m_velocity[out] = m_velocity[i];
+        m_channel[out]  = m_channel[i];
+        m_track[out]    = m_track[i];
+        ++out;
+    }
+    m_start.resize(out);
+    m_end.resize(out);
+    m_pitch.resize(out);
+    m_velocity.resize(out);
+    m_channel.resize(out);
+    m_track.resize(out);
+    // Парсер резервирует по оценке сверху (size / 6) — излишек отдаём
+    for (std::vector<quint32> *column : { &m_start, &m_end })
+        column->shrink_to_fit();
+    for (std::vector<quint8> *column : { &m_pitch, &m_velocity, &m_channel, &m_track })
+        column->shrink_to_fit();
+
+    // 2) Парсер выдаёт ноты уже по порядку; сортируем только если нет
+    if (!std::is_sorted(m_start.begin(), m_start.end())) {
+        std::vector<quint32> order(out);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(),
+                         [this](quint32 a, quint32 b) { return m_start[a] < m_start[b]; });
+        permute(m_start, order);
+        permute(m_end, order);
+        permute(m_pitch, order);
+        permute(m_velocity, order);
+        permute(m_channel, order);
+        permute(m_track, order);
+    }
+
+    quint32 maxDuration = 0;
+    quint32 lastEnd = 0;
+    TrackMask presentTracks = 0;
+    for (size_t i = 0; i < out; ++i) {
+        maxDuration = std::max(maxDuration, m_end[i] - m_start[i]);
+        lastEnd = std::max(lastEnd, m_end[i]);
+        presentTracks |= TrackMask(1) << m_track[i];
+    }
+
+    // 3) Вторичные индексы и индекс интервалов
+    buildIndex(m_pitch, 128, m_pitchOffsets, m_pitchIndex);
+    buildIndex(m_channel, 16, m_channelOffsets, m_channelIndex);
+    m_intervals.build(m_end.data(), int(out));
+
+    bindOwned();
+    m_cols.maxDuration = maxDuration;
+    m_cols.lastEnd = lastEnd;
+    m_cols.presentTracks = presentTracks;
+}
+
+NoteStore NoteStore::snapshot(quint32 openEndMs) const
+{
+    NoteStore s;
+    s.m_start     = m_start;
+    s.m_end       = m_end;
+    s.m_pitch     = m_pitch;
+    s.m_velocity  = m_velocity;
+    s.m_channel   = m_channel;
+    s.m_track     = m_track;
+    for (size_t i = 0; i < s.m_start.size(); ++i) {
+        if (s.m_end[i] <= s.m_start[i])
+            s.m_end[i] = std::max(openEndMs, s.m_start[i] + 1);
+    }
+    s.finalize();
+    return s;
+}
+
+void NoteStore::buildIndex(const std::vector<quint8> &keys, int keyCount,
+                           std::vector<quint32> &offsets, std::vector<quint32> &index) const
+{
+    // Сортировка подсчётом: индексы внутри ключа остаются по возрастанию старта
+    offsets.assign(keyCount + 1, 0);
+    for (quint8 k : keys)
+        ++offsets[k + 1];
+    for (int k = 0; k < keyCount; ++k)
+        offsets[k + 1] += offsets[k];
+
+    index.resize(keys.size());
+    std::vector<quint32> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < keys.size(); ++i)
+        index[fill[keys[i]]++] = quint32(i);
+}
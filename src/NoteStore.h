@@ -0,0 +1,156 @@
+// NoteStore.h
+#ifndef NOTESTORE_H
+#define NOTESTORE_H
+
+#include <QtGlobal>
+#include <memory>
+#include <vector>
+#include "NoteIntervalIndex.h"
+
+// Ноты песни в колоночном виде (structure of arrays), отсортированные по
+// времени начала. Горячие циклы читают только нужные колонки: 4 байта
+// на время начала/конца и по байту на высоту, громкость, канал и дорожку —
+// вместо 32-байтной структуры с выравниванием.
+//
+// Всего на ноту: 12 байт колонок и 8 байт индексов по высоте и каналу —
+// около 20 байт (memoryUsage) плюс дерево интервалов. Тиков не храним:
+// время в мс, а тик, если понадобится, даёт TempoMap::usToTick. Индекса
+// по дорожкам тоже нет — он нужен только запросам с маской дорожек, и
+// его строит TrackViews, причём лишь у песен с несколькими дорожками.
+//
+// Читатели ходят по указателям на колонки, а не по векторам: колонки
+// могут принадлежать самому NoteStore (после finalize) или лежать во
+// внешней памяти — в отображённом файле кэша песни (adopt). Копия такого
+// NoteStore делит отображение, а не копирует ноты.
+class NoteStore {
+public:
+    // Дорожек различается не больше MaxTracks: набор дорожек — битовая маска
+    static constexpr int MaxTracks = 64;
+    using TrackMask = quint64;
+    static constexpr TrackMask AllTracks = ~TrackMask(0);
+
+    // Колонки и готовые индексы одним набором указателей
+    struct Columns {
+        int count = 0;
+        const quint32 *start = nullptr;
+        const quint32 *end = nullptr;
+        const quint8  *pitch = nullptr;
+        const quint8  *velocity = nullptr;
+        const quint8  *channel = nullptr;
+        const quint8  *track = nullptr;
+        const quint32 *pitchOffsets = nullptr;     // 129 границ
+        const quint32 *pitchIndex = nullptr;
+        const quint32 *channelOffsets = nullptr;   // 17 границ
+        const quint32 *channelIndex = nullptr;
+        const quint32 *intervalTree = nullptr;     // 2 * intervalLeafBase узлов
+        int intervalLeafBase = 0;
+        quint32 maxDuration = 0;
+        quint32 lastEnd = 0;
+        TrackMask presentTracks = 0;
+    };
+
+    NoteStore() = default;
+    NoteStore(const NoteStore &other) { *this = other; }
+    NoteStore &operator=(const NoteStore &other);
+    // Перемещение не трогает буферы векторов — указатели колонок остаются верными
+    NoteStore(NoteStore &&other) = default;
+    NoteStore &operator=(NoteStore &&other) = default;
+
+    // Диапазон индексов нот во вторичном индексе (по возрастанию старта)
+    struct IndexRange {
+        const quint32 *first = nullptr;
+        const quint32 *last  = nullptr;
+
+        const quint32 *begin() const { return first; }
+        const quint32 *end() const { return last; }
+        int size() const { return int(last - first); }
+        bool isEmpty() const { return first == last; }
+    };
+
+    int size() const { return m_cols.count; }
+    bool isEmpty() const { return m_cols.count == 0; }
+
+    quint32 startTime(int i) const { return m_cols.start[i]; }   // ms
+    quint32 endTime(int i) const { return m_cols.end[i]; }       // ms
+    quint32 duration(int i) const { return m_cols.end[i] - m_cols.start[i]; }
+    quint8  pitch(int i) const { return m_cols.pitch[i]; }
+    quint8  velocity(int i) const { return m_cols.velocity[i]; }
+    quint8  channel(int i) const { return m_cols.channel[i]; }
+    quint8  track(int i) const { return m_cols.track[i]; }
+
+    const quint32 *startTimes() const { return m_cols.start; }
+    const quint32 *endTimes() const { return m_cols.end; }
+    const quint8  *pitches() const { return m_cols.pitch; }
+    const quint8  *velocities() const { return m_cols.velocity; }
+    const quint8  *channels() const { return m_cols.channel; }
+    const quint8  *tracks() const { return m_cols.track; }
+
+    IndexRange notesForPitch(int pitch) const;
+    IndexRange notesForChannel(int channel) const;
+    // Дорожки, в которых есть хотя бы одна нота
+    TrackMask presentTracks() const { return m_cols.presentTracks; }
+
+    // Самая длинная нота — граница для поиска по времени
+    quint32 maxDuration() const { return m_cols.maxDuration; }
+    quint32 endOfLastNote() const { return m_cols.lastEnd; }
+
+    // Индекс первой ноты, начинающейся не раньше timeMs
+    int lowerBound(quint32 timeMs) const;
+
+    // Ноты, пересекающие [t0Ms, t1Ms), по возрастанию старта
+    template <typename F>
+    void forEachOverlapping(quint32 t0Ms, quint32 t1Ms, F &&f) const {
+        m_intervals.forEachOverlapping(m_cols.end, lowerBound(t1Ms), t0Ms, f);
+    }
+    void overlapping(quint32 t0Ms, quint32 t1Ms, std::vector<quint32> &out) const;
+
+    // Ноты, звучащие в момент timeMs: start <= t < end
+    void activeAt(quint32 timeMs, std::vector<quint32> &out) const;
+
+    qint64 memoryUsage() const;   // только своя куча, без внешних колонок
+
+    // --- Внешние колонки (кэш песни) ---
+    Columns columns() const;
+    // Колонки уже отсортированы и проиндексированы; backing держит их память
+    void adopt(const Columns &columns, std::shared_ptr<const void> backing);
+    bool isExternal() const { return m_backing != nullptr; }
+
+    // --- Заполнение (парсер) ---
+    void clear();
+    void reserve(int count);
+    // track больше MaxTracks - 1 сводится к последней дорожке
+    int append(quint32 startMs, quint8 pitch, quint8 velocity, quint8 channel, int track = 0);
+    void setEnd(int i, quint32 endMs) { m_end[i] = endMs; }
+
+    // Убирает ноты нулевой длины, упорядочивает по старту
+    // и строит индексы по высоте и каналу.
+    void finalize();
+
+    // Готовая копия того, что уже добавлено (заполнение ещё идёт):
+    // незакрытые ноты получают конец openEndMs
+    NoteStore snapshot(quint32 openEndMs) const;
+
+private:
+    void bindOwned();
+    void buildIndex(const std::vector<quint8> &keys, int keyCount,
+                    std::vector<quint32> &offsets, std::vector<quint32> &index) const;
+
+    std::vector<quint32> m_start;
+    std::vector<quint32> m_end;
+    std::vector<quint8>  m_pitch;
+    std::vector<quint8>  m_velocity;
+    std::vector<quint8>  m_channel;
+    std::vector<quint8>  m_track;
+
+    std::vector<quint32> m_pitchOffsets;    // 129 границ
+    std::vector<quint32> m_pitchIndex;
+    std::vector<quint32> m_channelOffsets;  // 17 границ
+    std::vector<quint32> m_channelIndex;
+
+    NoteIntervalIndex m_intervals;
+
+    Columns m_cols;                          // на что смотрят читатели
+    std::shared_ptr<const void> m_backing;   // внешняя память колонок
+};
+
+#endif
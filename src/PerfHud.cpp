@@ -0,0 +1,143 @@
+#include "PerfHud.h"
+#include <QElapsedTimer>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QPainter>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+constexpr qint64 kNsPerMs = 1000000;
+constexpr int kPadding = 6;
+
+qint64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Перцентиль в мкс или прочерк, если за окно записей не было
+QString formatUs(double us)
+{
+    return us < 0.0 ? QString("—") : QString::number(us, 'f', 0);
+}
+
+QString formatMs(double us)
+{
+    return us < 0.0 ? QString("—") : QString::number(us / 1000.0, 'f', 2);
+}
+
+} // namespace
+
+PerfHud::PerfHud() = default;
+
+void PerfHud::sample(qint64 nowNs)
+{
+    // RSS — системный вызов, хватает раза за шаг окна
+    if (nowNs - m_lastRssNs >= WindowStepMs * kNsPerMs) {
+        Metrics::set(Metrics::ResidentBytes, Metrics::processResidentBytes());
+        m_lastRssNs = nowNs;
+    }
+
+    const int slotCount = int(m_window.size());
+    if (m_windowFilled > 0 && nowNs - m_window[m_windowHead].timeNs < WindowStepMs * kNsPerMs)
+        return;
+    m_windowHead = (m_windowHead + 1) % slotCount;
+    m_window[m_windowHead] = Metrics::snapshot();
+    m_windowFilled = std::min(m_windowFilled + 1, slotCount);
+}
+
+QStringList PerfHud::formatLines(const Metrics::Snapshot &now) const
+{
+    const int slotCount = int(m_window.size());
+    const Metrics::Snapshot &from = m_window[(m_windowHead - (m_windowFilled - 1) + slotCount) % slotCount];
+    const double seconds = double(std::max<qint64>(now.timeNs - from.timeNs, 1)) / 1.0e9;
+    auto rate = [&](Metrics::Counter counter) {
+        return double(now.counters[counter] - from.counters[counter]) / seconds;
+    };
+    auto pct = [&](Metrics::Histogram histogram, double q) {
+        return Metrics::percentile(from, now, histogram, q);
+    };
+
+    const qint64 rss = now.counters[Metrics::ResidentBytes];
+    return {
+        QString("FPS %1   кадр p50 %2 / p99 %3 мс")
+            .arg(rate(Metrics::RollFrames), 0, 'f', 1)
+            .arg(formatMs(pct(Metrics::RollFrameUs, 0.5)))
+            .arg(formatMs(pct(Metrics::RollFrameUs, 0.99))),
+        QString("тик секвенсора: опоздание p50 %1 / p99 %2 мкс, %3/с")
+            .arg(formatUs(pct(Metrics::SequencerLatenessUs, 0.5)))
+            .arg(formatUs(pct(Metrics::SequencerLatenessUs, 0.99)))
+            .arg(rate(Metrics::SequencerTicks), 0, 'f', 0),
+        QString("аудио-блок p99 %1 мкс   голосов %2")
+            .arg(formatUs(pct(Metrics::AudioRenderUs, 0.99)))
+            .arg(now.counters[Metrics::ActiveVoices]),
+        QString("нот в окне ~%1   очереди: аудио %2, GUI %3")
+            .arg(now.counters[Metrics::VisibleNotes])
+            .arg(now.counters[Metrics::AudioQueueDepth])
+            .arg(now.counters[Metrics::GuiQueueDepth]),
+        QString("MIDI-вход %1/с: → GUI p99 %2 мкс, → экран p50 %3 / p99 %4 мс")
+            .arg(rate(Metrics::InputEvents), 0, 'f', 0)
+            .arg(formatUs(pct(Metrics::InputToGuiUs, 0.99)))
+            .arg(formatMs(pct(Metrics::InputToScreenUs, 0.5)))
+            .arg(formatMs(pct(Metrics::InputToScreenUs, 0.99))),
+        QString("RSS %1 МБ   HUD %2 мкс (с текстом %3)")
+            .arg(rss < 0 ? QString("—") : QString::number(double(rss) / (1024.0 * 1024.0), 'f', 1))
+            .arg(m_blitUs, 0, 'f', 0)
+            .arg(m_refreshUs, 0, 'f', 0),
+    };
+}
+
+void PerfHud::renderImage(const QStringList &lines, qreal dpr)
+{
+    QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    font.setPointSize(9);
+    const QFontMetrics metrics(font);
+
+    int textWidth = 0;
+    for (const QString &line : lines)
+        textWidth = std::max(textWidth, metrics.horizontalAdvance(line));
+    const QSize size(textWidth + 2 * kPadding, int(lines.size()) * metrics.height() + 2 * kPadding);
+
+    // Ширина только растёт: рамка не дёргается от смены цифр
+    const QSize logical(std::max(size.width(), m_image.isNull() ? 0 : int(m_image.width() / dpr)),
+                        size.height());
+    if (m_image.isNull() || m_image.devicePixelRatio() != dpr
+        || m_image.size() != logical * dpr) {
+        m_image = QPixmap(logical * dpr);
+        m_image.setDevicePixelRatio(dpr);
+    }
+    m_image.fill(QColor(0, 0, 0, 170));
+
+    QPainter p(&m_image);
+    p.setFont(font);
+    p.setPen(QColor("#E0E0E0"));
+    int y = kPadding + metrics.ascent();
+    for (const QString &line : lines) {
+        p.drawText(kPadding, y, line);
+        y += metrics.height();
+    }
+}
+
+void PerfHud::paint(QPainter &p, int width, qreal dpr)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qint64 nowNs = steadyNowNs();
+    sample(nowNs);
+
+    const bool refresh = m_image.isNull() || m_image.devicePixelRatio() != dpr
+                         || nowNs - m_lastRefreshNs >= RefreshMs * kNsPerMs;
+    if (refresh) {
+        renderImage(formatLines(Metrics::snapshot()), dpr);
+        m_lastRefreshNs = nowNs;
+    }
+
+    const int imageWidth = int(m_image.width() / dpr);
+    p.drawPixmap(width - imageWidth - 8, 8, m_image);
+
+    const double us = double(timer.nsecsElapsed()) / 1000.0;
+    (refresh ? m_refreshUs : m_blitUs) = us;
+}
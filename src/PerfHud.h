@@ -0,0 +1,47 @@
+// PerfHud.h
+#ifndef PERFHUD_H
+#define PERFHUD_H
+
+#include <QPixmap>
+#include <QStringList>
+#include <array>
+#include "Metrics.h"
+
+class QPainter;
+
+// Оверлей производительности поверх ролла: FPS, p50/p99 кадра ролла,
+// опоздание тиков секвенсора, задержку MIDI-входа, ноты в окне, голоса, очереди событий и
+// RSS. Всё — из Metrics: снимок реестра каждые WindowStepMs кладётся в
+// кольцо, цифры — разница текущего снимка с самым старым (окно ~1 s).
+//
+// Каждый кадр HUD только копирует готовую картинку: текст
+// перерисовывается не чаще RefreshMs — чаще его всё равно не прочесть,
+// а растеризация строк стоит больше, чем весь остальной кадр HUD.
+class PerfHud {
+public:
+    static constexpr int RefreshMs = 100;
+    static constexpr int WindowStepMs = 250;
+    static constexpr int WindowSteps = 4;
+
+    PerfHud();
+
+    // В правый верхний угол области шириной width
+    void paint(QPainter &p, int width, qreal dpr);
+
+private:
+    void sample(qint64 nowNs);
+    QStringList formatLines(const Metrics::Snapshot &now) const;
+    void renderImage(const QStringList &lines, qreal dpr);
+
+    std::array<Metrics::Snapshot, WindowSteps + 1> m_window;
+    int m_windowHead = 0;    // самый свежий снимок окна
+    int m_windowFilled = 0;
+    qint64 m_lastRefreshNs = 0;
+    qint64 m_lastRssNs = 0;
+    // Цена HUD выводится им же: обычный кадр и кадр с перерисовкой текста
+    double m_blitUs = 0.0;
+    double m_refreshUs = 0.0;
+    QPixmap m_image;
+};
+
+#endif
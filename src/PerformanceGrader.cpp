@@ -0,0 +1,232 @@
+#include "PerformanceGrader.h"
+#include "Trace.h"
+#include <algorithm>
+
+void PerformanceGrader::setSong(const SongPtr &song, qint64 positionMs)
+{
+    m_song = song;
+    m_notes = song ? &song->notes() : nullptr;
+    // Единственное место, где оценка выделяет память
+    const size_t count = m_notes ? size_t(m_notes->size()) : 0;
+    m_grades.assign(count, Pending);
+    m_deviations.assign(count, 0);
+    restart(positionMs);
+}
+
+void PerformanceGrader::replaceSong(const SongPtr &song)
+{
+    if (!m_notes || !song) {
+        setSong(song, m_positionMs);
+        return;
+    }
+    const NoteStore &oldNotes = *m_notes;
+    const NoteStore &notes = song->notes();
+    std::vector<quint8> grades(size_t(notes.size()), Pending);
+    std::vector<qint16> deviations(size_t(notes.size()), 0);
+    std::vector<bool> mapped(size_t(notes.size()), false);
+
+    // Старую ноту ищем среди нот той же высоты с тем же стартом; у каждой
+    // новой — не больше одной пары
+    const quint32 *starts = notes.startTimes();
+    for (int i = 0; i < oldNotes.size(); ++i) {
+        const quint32 start = oldNotes.startTime(i);
+        const NoteStore::IndexRange range = notes.notesForPitch(oldNotes.pitch(i));
+        const quint32 *it = std::lower_bound(range.begin(), range.end(), start,
+                                             [starts](quint32 note, quint32 ms) { return starts[note] < ms; });
+        for (; it != range.end() && starts[*it] == start; ++it) {
+            if (mapped[*it] || notes.track(int(*it)) != oldNotes.track(i))
+                continue;
+            mapped[*it] = true;
+            grades[*it] = m_grades[size_t(i)];
+            deviations[*it] = m_deviations[size_t(i)];
+            break;
+        }
+    }
+
+    m_song = song;
+    m_notes = &notes;
+    m_grades.swap(grades);
+    m_deviations.swap(deviations);
+
+    // Ноты, которых не было: пока окно открыто — играются, иначе мимо счёта
+    const qint64 windowMs = m_tolerances.windowMs;
+    for (int i = 0; i < notes.size(); ++i) {
+        if (mapped[size_t(i)])
+            continue;
+        const bool open = qint64(starts[i]) + windowMs >= m_positionMs;
+        m_grades[size_t(i)] = open && isGraded(i) ? Pending : Skipped;
+    }
+    m_expireCursor = 0;
+    while (m_expireCursor < notes.size() && qint64(starts[m_expireCursor]) + windowMs < m_positionMs)
+        ++m_expireCursor;
+    resetPitchCursors();
+}
+
+void PerformanceGrader::setTrackMask(quint64 mask)
+{
+    m_trackMask = mask;
+    if (!m_notes)
+        return;
+
+    // Ноты с открытым окном переоцениваются по новой маске; прошлое и уже
+    // сыгранное не трогаем
+    const quint32 *starts = m_notes->startTimes();
+    const qint64 windowMs = m_tolerances.windowMs;
+    for (int i = m_expireCursor; i < m_notes->size(); ++i) {
+        quint8 &grade = m_grades[size_t(i)];
+        if (grade != Pending && grade != Skipped)
+            continue;
+        if (qint64(starts[i]) + windowMs < m_positionMs)
+            continue;
+        grade = isGraded(i) ? Pending : Skipped;
+    }
+    resetPitchCursors();
+}
+
+void PerformanceGrader::setTolerances(const Tolerances &tolerances)
+{
+    // Отклонение хранится в int16 — окно больше нескольких секунд смысла не имеет
+    m_tolerances.windowMs = qBound(1, tolerances.windowMs, 5000);
+    m_tolerances.hitMs = qBound(0, tolerances.hitMs, m_tolerances.windowMs);
+    m_binMs = std::max(1, m_tolerances.windowMs / (HistogramBins / 2));
+    restart(m_positionMs);
+}
+
+void PerformanceGrader::restart(qint64 positionMs)
+{
+    m_positionMs = positionMs;
+    m_attemptFromMs = std::max<qint64>(positionMs, 0);
+    m_stats = Stats();
+    m_histogram.fill(0);
+    m_pitchCursor.fill(0);
+    m_expireCursor = 0;
+    if (!m_notes)
+        return;
+
+    const int first = m_notes->lowerBound(quint32(m_attemptFromMs));
+    for (int i = 0; i < m_notes->size(); ++i) {
+        m_grades[size_t(i)] = i >= first && isGraded(i) ? Pending : Skipped;
+        m_deviations[size_t(i)] = 0;
+    }
+    m_expireCursor = first;
+    resetPitchCursors();
+}
+
+void PerformanceGrader::resetPitchCursors()
+{
+    // Раньше начала попытки и раньше открытого окна играть нечего
+    const qint64 fromMs = std::max(m_attemptFromMs, m_positionMs - qint64(m_tolerances.windowMs));
+    const quint32 from = quint32(std::max<qint64>(fromMs, 0));
+    const quint32 *starts = m_notes->startTimes();
+    for (int pitch = 0; pitch < 128; ++pitch) {
+        const NoteStore::IndexRange range = m_notes->notesForPitch(pitch);
+        const quint32 *it = std::lower_bound(range.begin(), range.end(), from,
+                                             [starts](quint32 note, quint32 ms) { return starts[note] < ms; });
+        m_pitchCursor[size_t(pitch)] = int(it - range.begin());
+    }
+}
+
+bool PerformanceGrader::isGraded(int note) const
+{
+    return qint64(m_notes->startTime(note)) >= m_attemptFromMs
+        && ((m_trackMask >> m_notes->track(note)) & 1);
+}
+
+void PerformanceGrader::advance(qint64 positionMs)
+{
+    m_positionMs = positionMs;
+    if (!m_notes)
+        return;
+
+    // Окно ноты закрывается в start + windowMs — дальше её уже не сыграть
+    const quint32 *starts = m_notes->startTimes();
+    const qint64 windowMs = m_tolerances.windowMs;
+    const int count = m_notes->size();
+    while (m_expireCursor < count && qint64(starts[m_expireCursor]) + windowMs < positionMs) {
+        if (m_grades[size_t(m_expireCursor)] == Pending)
+            judge(m_expireCursor, Missed, 0);
+        ++m_expireCursor;
+    }
+}
+
+PerformanceGrader::Judgement PerformanceGrader::noteOn(int pitch, qint64 positionMs)
+{
+    PIANO_TRACE_ZONE("PerformanceGrader::noteOn");
+    Judgement result;
+    if (!m_notes || pitch < 0 || pitch > 127) {
+        result.grade = Skipped;
+        return result;
+    }
+    advance(positionMs);
+
+    const NoteStore::IndexRange range = m_notes->notesForPitch(pitch);
+    const quint32 *starts = m_notes->startTimes();
+    const qint64 windowMs = m_tolerances.windowMs;
+
+    // Курсор проходит ноты, которые уже не сыграть: оценённые, чужие
+    // и с закрывшимся окном. Каждую — один раз за попытку.
+    int &cursor = m_pitchCursor[size_t(pitch)];
+    while (cursor < range.size()) {
+        const quint32 note = range.first[cursor];
+        if (m_grades[note] == Pending && qint64(starts[note]) + windowMs >= positionMs)
+            break;
+        ++cursor;
+    }
+
+    // Ноты по возрастанию старта: |отклонение| сначала падает, потом
+    // растёт — ищем минимум и останавливаемся, как только он пройден
+    int best = -1;
+    qint64 bestDeviation = 0;
+    for (int j = cursor; j < range.size(); ++j) {
+        const quint32 note = range.first[j];
+        const qint64 deviation = positionMs - qint64(starts[note]);
+        if (deviation < -windowMs)
+            break;
+        if (m_grades[note] != Pending)
+            continue;
+        if (best >= 0 && qAbs(deviation) >= qAbs(bestDeviation))
+            break;
+        best = int(note);
+        bestDeviation = deviation;
+    }
+
+    if (best < 0) {
+        ++m_stats.wrong;
+        return result;
+    }
+
+    result.note = best;
+    result.deviationMs = int(bestDeviation);
+    if (qAbs(bestDeviation) <= m_tolerances.hitMs)
+        result.grade = Hit;
+    else
+        result.grade = bestDeviation < 0 ? Early : Late;
+    judge(best, result.grade, result.deviationMs);
+    return result;
+}
+
+void PerformanceGrader::judge(int note, Grade grade, int deviationMs)
+{
+    m_grades[size_t(note)] = grade;
+    m_deviations[size_t(note)] = qint16(deviationMs);
+    switch (grade) {
+    case Hit:
+        ++m_stats.hit;
+        break;
+    case Early:
+        ++m_stats.early;
+        break;
+    case Late:
+        ++m_stats.late;
+        break;
+    case Missed:
+        ++m_stats.missed;
+        return;
+    default:
+        return;
+    }
+
+    m_stats.deviationSumMs += deviationMs;
+    const int bin = HistogramBins / 2 + qRound(double(deviationMs) / double(m_binMs));
+    ++m_histogram[size_t(qBound(0, bin, HistogramBins - 1))];
+}
@@ -0,0 +1,133 @@
+// PerformanceGrader.h
+#ifndef PERFORMANCEGRADER_H
+#define PERFORMANCEGRADER_H
+
+#include <QtGlobal>
+#include <array>
+#include <vector>
+#include "Song.h"
+
+// Оценка игры ученика по нотам песни. Нажатие сопоставляется с ближайшей
+// по времени ещё не сыгранной нотой той же высоты и попадает в одну из
+// оценок: вовремя (|отклонение| <= hitMs), рано/поздно (до windowMs) или
+// мимо — такой ноты в окне нет. Нота, окно которой прошло без нажатия, —
+// пропущена.
+//
+// Всё считается по ходу игры и без аллокаций: на песню заводится по
+// байту оценки и по int16 отклонения на ноту, дальше работают курсоры.
+// Курсор по каждой высоте стоит на первой ноте индекса
+// NoteStore::notesForPitch, которую ещё можно сыграть, — нажатие
+// смотрит только ноты своей высоты в окне ±windowMs. Общий курсор по
+// нотам в порядке старта отмечает пропущенные по мере того, как окно
+// уходит вперёд (advance).
+//
+// Время — позиция песни в мс (MidiInputEvent::positionMs), так что
+// допуски тоже в мс песни: на замедленном темпе они шире в реальном
+// времени. Отпускания не оцениваются. Только поток GUI.
+class PerformanceGrader {
+public:
+    enum Grade : quint8 {
+        Pending,   // ещё не сыграна и окно не прошло
+        Hit,
+        Early,
+        Late,
+        Missed,
+        Skipped,   // не оценивается: до точки старта или чужая дорожка
+        Wrong      // только в Judgement: нажатие без ноты в окне
+    };
+
+    struct Tolerances {
+        int hitMs = 60;
+        int windowMs = 200;
+    };
+
+    // Итог одного нажатия
+    struct Judgement {
+        Grade grade = Wrong;
+        int note = -1;          // индекс в NoteStore; -1 — мимо
+        int deviationMs = 0;    // < 0 — раньше ноты
+    };
+
+    struct Stats {
+        int hit = 0;
+        int early = 0;
+        int late = 0;
+        int missed = 0;
+        int wrong = 0;
+        qint64 deviationSumMs = 0;   // по сыгранным нотам, со знаком
+
+        int played() const { return hit + early + late; }
+        // Доля сыгранных нот среди оценённых и лишних нажатий; -1 — оценок нет
+        double accuracy() const
+        {
+            const int total = played() + missed + wrong;
+            return total > 0 ? double(played()) / double(total) : -1.0;
+        }
+        // Средний сдвиг: < 0 — ученик торопится
+        double meanDeviationMs() const
+        {
+            return played() > 0 ? double(deviationSumMs) / double(played()) : 0.0;
+        }
+    };
+
+    // Гистограмма отклонений: корзина HistogramBins / 2 — ноль, ширина
+    // корзины — windowMs / (HistogramBins / 2)
+    static constexpr int HistogramBins = 41;
+    using Histogram = std::array<int, HistogramBins>;
+
+    PerformanceGrader() = default;
+
+    // Оценка с positionMs новой песни; прежние результаты сбрасываются
+    void setSong(const SongPtr &song, qint64 positionMs = 0);
+    // Та же песня в другом виде (дочитанный хвост вместо начала): оценки
+    // и счёт попытки переносятся на ноты с тем же стартом, высотой и
+    // дорожкой. Новые ноты, окно которых уже прошло, не оцениваются.
+    void replaceSong(const SongPtr &song);
+    // Какие дорожки играет ученик (NoteStore::TrackMask). Уже оценённые
+    // ноты остаются как есть, меняются только ещё не сыгранные
+    void setTrackMask(quint64 mask);
+    void setTolerances(const Tolerances &tolerances);
+    const Tolerances &tolerances() const { return m_tolerances; }
+
+    // Новая попытка с позиции positionMs (перемотка, стоп): ноты раньше
+    // неё не оцениваются, счёт и гистограммы обнуляются
+    void restart(qint64 positionMs);
+
+    // Нажатие клавиши pitch в момент песни positionMs
+    Judgement noteOn(int pitch, qint64 positionMs);
+    // Песня дошла до positionMs: ноты, окно которых прошло, — пропущены
+    void advance(qint64 positionMs);
+
+    Grade grade(int note) const { return Grade(m_grades[size_t(note)]); }
+    int deviationMs(int note) const { return m_deviations[size_t(note)]; }
+    const Stats &stats() const { return m_stats; }
+    const Histogram &deviationHistogram() const { return m_histogram; }
+    int histogramBinMs() const { return m_binMs; }
+    qint64 positionMs() const { return m_positionMs; }
+    const SongPtr &song() const { return m_song; }
+    bool isEmpty() const { return !m_song || m_song->isEmpty(); }
+
+private:
+    void judge(int note, Grade grade, int deviationMs);
+    // Курсоры высот — на первую ноту, которую ещё можно сыграть
+    void resetPitchCursors();
+    bool isGraded(int note) const;
+
+    SongPtr m_song;
+    const NoteStore *m_notes = nullptr;
+    Tolerances m_tolerances;
+    quint64 m_trackMask = NoteStore::AllTracks;
+    qint64 m_positionMs = 0;   // последняя известная позиция
+    qint64 m_attemptFromMs = 0;   // начало попытки: ноты раньше не оцениваются
+
+    std::vector<quint8> m_grades;       // Grade по индексу ноты
+    std::vector<qint16> m_deviations;   // отклонение сыгранной ноты, мс
+    std::array<int, 128> m_pitchCursor{};   // позиция в notesForPitch(pitch)
+    int m_expireCursor = 0;                  // первая нота, окно которой не прошло
+
+    Stats m_stats;
+    Histogram m_histogram{};
+    int m_binMs = 10;
+};
+
+#endif
@@ -1,12 +1,19 @@
 #include "PianoKeyboardWidget.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include <QPainter>
 #include <QResizeEvent>
+#include <QMouseEvent>
+#include <QDebug>
+#include <chrono>
 
 PianoKeyboardWidget::PianoKeyboardWidget(QWidget *parent)
     : QWidget(parent)
 {
     setMinimumHeight(120);
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    // Слои покрывают виджет целиком — стирать фон перед отрисовкой не нужно
+    setAttribute(Qt::WA_OpaquePaintEvent);
     layoutKeys();
 }
 
@@ -38,14 +45,15 @@ bool PianoKeyboardWidget::isBlackKey(int midiNote) const
 
 void PianoKeyboardWidget::layoutKeys()
 {
-    whiteKeys.clear();
-    blackKeys.clear();
-
-    int firstNote = 21;  // A0
-    int lastNote  = 108; // C8
+    whiteNotes.clear();
+    blackNotes.clear();
+    for (Key &k : keys) {
+        k.rect = QRect();
+        k.exists = false;
+    }
 
     int whiteCount = 0;
-    for (int n = firstNote; n <= lastNote; ++n) {
+    for (int n = FirstNote; n <= LastNote; ++n) {
         if (!isBlackKey(n))
             ++whiteCount;
     }
@@ -54,63 +62,49 @@ void PianoKeyboardWidget::layoutKeys()
     int w = width() > 0 ? width() : 800;
     int h = height() > 0 ? height() : 120;
 
-    int whiteWidth = w / whiteCount;
+    whiteWidth = w / whiteCount;
     int whiteHeight = h;
 
     int currentX = 0;
 
-    // Сначала создаём белые
-    for (int n = firstNote; n <= lastNote; ++n) {
+    // Сначала белые
+    for (int n = FirstNote; n <= LastNote; ++n) {
         if (!isBlackKey(n)) {
-            Key k;
+            Key &k = keys[n];
             k.rect = QRect(currentX, 0, whiteWidth, whiteHeight);
             k.isBlack = false;
-            k.pressed = false;
-            k.midiNote = n;
-            whiteKeys.push_back(k);
+            k.exists = true;
+            whiteNotes.push_back(n);
 
             currentX += whiteWidth;
         }
     }
 
-    // Затем создаём чёрные (короче и уже, поверх белых)
-    for (int i = 0; i < whiteKeys.size(); ++i) {
-        const Key &wk = whiteKeys[i];
-        int midi = wk.midiNote;
-
-        // Внутри октавы смотрим следующую белую и вставляем чёрную между ними
-        int semitone = (midi % 12);
-        if (semitone == 0 || semitone == 2 || semitone == 5 || semitone == 7 || semitone == 9) {
-            int blackNote = midi + 1;
-            if (blackNote > lastNote || !isBlackKey(blackNote))
-                continue;
-
-            Key bk;
-            int bw = whiteWidth * 0.6;
-            int bh = whiteHeight * 0.6;
-            int bx = wk.rect.x() + whiteWidth - bw / 2;
-            int by = 0;
-
-            bk.rect = QRect(bx, by, bw, bh);
-            bk.isBlack = true;
-            bk.pressed = false;
-            bk.midiNote = blackNote;
-
-            blackKeys.push_back(bk);
-        }
+    // Затем чёрные (короче и уже, поверх белых): между белой и следующей
+    int bw = whiteWidth * 0.6;
+    blackHeight = whiteHeight * 0.6;
+    for (int n = FirstNote + 1; n <= LastNote; ++n) {
+        if (!isBlackKey(n))
+            continue;
+
+        const QRect &left = keys[n - 1].rect;
+        Key &bk = keys[n];
+        bk.rect = QRect(left.x() + whiteWidth - bw / 2, 0, bw, blackHeight);
+        bk.isBlack = true;
+        bk.exists = true;
+        blackNotes.push_back(n);
     }
 }
 
-void PianoKeyboardWidget::paintEvent(QPaintEvent *event)
+void PianoKeyboardWidget::drawKeys(QPainter &p, bool pressed) const
 {
-    Q_UNUSED(event);
-    QPainter p(this);
     p.setRenderHint(QPainter::Antialiasing, false);
 
     // Белые клавиши
-    for (const Key &k : whiteKeys) {
+    for (int note : whiteNotes) {
+        const Key &k = keys[note];
         QLinearGradient grad(k.rect.topLeft(), k.rect.bottomLeft());
-        if (k.pressed) {
+        if (pressed) {
             grad.setColorAt(0.0, QColor("#FFE082")); // светлый сверху
             grad.setColorAt(1.0, QColor("#FFB300")); // насыщенный снизу
         } else {
@@ -125,9 +119,10 @@ void PianoKeyboardWidget::paintEvent(QPaintEvent *event)
     }
 
     // Чёрные клавиши
-    for (const Key &k : blackKeys) {
+    for (int note : blackNotes) {
+        const Key &k = keys[note];
         QLinearGradient grad(k.rect.topLeft(), k.rect.bottomLeft());
-        if (k.pressed) {
+        if (pressed) {
             grad.setColorAt(0.0, QColor("#424242"));
             grad.setColorAt(1.0, QColor("#00BCD4"));
         } else {
@@ -144,7 +139,62 @@ void PianoKeyboardWidget::paintEvent(QPaintEvent *event)
     p.setPen(QColor("#303030"));
     p.setBrush(Qt::NoBrush);
     p.drawRect(rect().adjusted(0, 0, -1, -1));
+}
 
+void PianoKeyboardWidget::renderLayers()
+{
+    const qreal dpr = devicePixelRatioF();
+    QPixmap *layers[2] = { &idleLayer, &pressedLayer };
+    for (int i = 0; i < 2; ++i) {
+        *layers[i] = QPixmap(size() * dpr);
+        layers[i]->setDevicePixelRatio(dpr);
+        layers[i]->fill(QColor("#121212"));
+        QPainter p(layers[i]);
+        drawKeys(p, i == 1);
+    }
+}
+
+void PianoKeyboardWidget::paintEvent(QPaintEvent *event)
+{
+    PIANO_TRACE_ZONE("PianoKeyboardWidget::paintEvent");
+    QPainter p(this);
+    if (idleLayer.isNull())
+        renderLayers();
+
+    // Qt уже ограничил отрисовку изменённой областью: копируем слой
+    // отпущенных клавиш, затем нажатые белые, затем все задетые чёрные
+    // (нажатая белая под ними закрасила их своим слоем)
+    const QRect dirty = event->rect();
+    p.drawPixmap(0, 0, idleLayer);
+
+    for (int note : whiteNotes) {
+        const Key &k = keys[note];
+        if (!k.pressed || !k.rect.intersects(dirty))
+            continue;
+        p.save();
+        p.setClipRect(k.rect, Qt::IntersectClip);
+        p.drawPixmap(0, 0, pressedLayer);
+        p.restore();
+    }
+
+    for (int note : blackNotes) {
+        const Key &k = keys[note];
+        if (!k.rect.intersects(dirty))
+            continue;
+        p.save();
+        p.setClipRect(k.rect.adjusted(1, 0, -1, -1), Qt::IntersectClip);
+        p.drawPixmap(0, 0, k.pressed ? pressedLayer : idleLayer);
+        p.restore();
+    }
+
+    // Кадр с клавишей MIDI-входа собран: отсюда до экрана остаётся
+    // только композиция окна, её виджет не видит
+    if (pendingInputNs != 0) {
+        const qint64 nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 std::chrono::steady_clock::now().time_since_epoch()).count();
+        Metrics::record(Metrics::InputToScreenUs, (nowNs - pendingInputNs) / 1000);
+        pendingInputNs = 0;
+    }
 }
 
 
@@ -152,59 +202,145 @@ void PianoKeyboardWidget::resizeEvent(QResizeEvent *event)
 {
     QWidget::resizeEvent(event);
     layoutKeys();      // переразложить клавиши при изменении размера
+    renderLayers();
+}
+
+void PianoKeyboardWidget::setPressed(int midiNote, quint8 source, bool on)
+{
+    if (midiNote < 0 || midiNote > 127 || !keys[midiNote].exists) {
+        if (on)
+            qDebug() << "PianoKeyboardWidget: key not found" << midiNote;
+        return;
+    }
+
+    Key &k = keys[midiNote];
+    const bool wasPressed = k.pressed != 0;
+    k.pressed = on ? (k.pressed | source) : (k.pressed & ~source);
+    if (wasPressed != (k.pressed != 0))
+        update(k.rect);   // только эта клавиша
+}
+
+void PianoKeyboardWidget::setLivePressed(int midiNote, bool on, qint64 receivedNs)
+{
+    if (midiNote < FirstNote || midiNote > LastNote)
+        return;
+    setPressed(midiNote, Live, on);
+    // Клавишу могло уже держать воспроизведение — тогда setPressed её не
+    // перерисует, но задержку до экрана всё равно меряем по этому кадру
+    update(keys[midiNote].rect);
+    if (pendingInputNs == 0)
+        pendingInputNs = receivedNs;
 }
 
+void PianoKeyboardWidget::pressLiveKey(int midiNote, qint64 receivedNs)
+{
+    setLivePressed(midiNote, true, receivedNs);
+}
+
+void PianoKeyboardWidget::releaseLiveKey(int midiNote, qint64 receivedNs)
+{
+    setLivePressed(midiNote, false, receivedNs);
+}
 
 void PianoKeyboardWidget::pressKey(int midiNote)
 {
-    bool found = false;
-    for (Key &k : whiteKeys) {
-        if (k.midiNote == midiNote) {
-            k.pressed = true;
-            found = true;
-        }
-    }
-    for (Key &k : blackKeys) {
-        if (k.midiNote == midiNote) {
-            k.pressed = true;
-            found = true;
-        }
-    }
-    if (found) {
-        update();
-    } else {
-        qDebug() << "PianoKeyboardWidget: key not found" << midiNote;
-    }
+    setPressed(midiNote, Playback, true);
 }
 
 
 void PianoKeyboardWidget::releaseKey(int midiNote)
 {
-    for (Key &k : whiteKeys) {
-        if (k.midiNote == midiNote) {
-            k.pressed = false;
-            update();
-            return;
-        }
-    }
-    for (Key &k : blackKeys) {
-        if (k.midiNote == midiNote) {
-            k.pressed = false;
-            update();
-            return;
-        }
-    }
+    setPressed(midiNote, Playback, false);
+}
+
+void PianoKeyboardWidget::releaseAllKeys()
+{
+    for (int note = FirstNote; note <= LastNote; ++note)
+        setPressed(note, Playback, false);
+}
+
+void PianoKeyboardWidget::applyKeyState(const KeyStateFrame &frame)
+{
+    frame.forEachChanged([&](int note) {
+        setPressed(note, Playback, frame.isPressed(note));
+    });
 }
 
 QRect PianoKeyboardWidget::keyRect(int midiNote) const
 {
-    for (const Key &k : whiteKeys) {
-        if (k.midiNote == midiNote)
-            return k.rect;
-    }
-    for (const Key &k : blackKeys) {
-        if (k.midiNote == midiNote)
-            return k.rect;
+    if (midiNote < 0 || midiNote > 127 || !keys[midiNote].exists)
+        return QRect();
+    return keys[midiNote].rect;
+}
+
+int PianoKeyboardWidget::noteAt(const QPoint &pos) const
+{
+    if (whiteWidth <= 0 || pos.x() < 0 || pos.y() < 0 || pos.y() >= height())
+        return -1;
+
+    // Белые одинаковой ширины — индекс делением
+    const int whiteIndex = pos.x() / whiteWidth;
+    if (whiteIndex >= whiteNotes.size())
+        return -1;
+    const int white = whiteNotes[whiteIndex];
+
+    // Поверх неё могут лежать только соседние чёрные
+    if (pos.y() < blackHeight) {
+        for (int note : { white - 1, white + 1 }) {
+            if (note >= FirstNote && note <= LastNote && keys[note].isBlack
+                && keys[note].rect.contains(pos))
+                return note;
+        }
     }
-    return QRect();
+    return white;
+}
+
+int PianoKeyboardWidget::velocityAt(const QPoint &pos) const
+{
+    // Чем ближе к краю клавиши, тем сильнее удар
+    const int note = noteAt(pos);
+    const int keyHeight = note >= 0 ? keys[note].rect.height() : height();
+    const int v = 40 + 87 * pos.y() / qMax(1, keyHeight);
+    return qBound(1, v, 127);
+}
+
+void PianoKeyboardWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return QWidget::mousePressEvent(event);
+
+    const QPoint pos = event->position().toPoint();
+    mouseNote = noteAt(pos);
+    if (mouseNote < 0)
+        return;
+    setPressed(mouseNote, Mouse, true);
+    emit userNoteOn(mouseNote, velocityAt(pos));
+}
+
+void PianoKeyboardWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (mouseNote < 0 || !(event->buttons() & Qt::LeftButton))
+        return;
+
+    // Глиссандо: при переходе на другую клавишу отпускаем прежнюю
+    const QPoint pos = event->position().toPoint();
+    const int note = noteAt(pos);
+    if (note == mouseNote || note < 0)
+        return;
+
+    setPressed(mouseNote, Mouse, false);
+    emit userNoteOff(mouseNote);
+    mouseNote = note;
+    setPressed(mouseNote, Mouse, true);
+    emit userNoteOn(mouseNote, velocityAt(pos));
+}
+
+void PianoKeyboardWidget::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton || mouseNote < 0)
+        return QWidget::mouseReleaseEvent(event);
+
+    setPressed(mouseNote, Mouse, false);
+    emit userNoteOff(mouseNote);
+    mouseNote = -1;
 }
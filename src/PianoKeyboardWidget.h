@@ -3,7 +3,15 @@
 
 #include <QWidget>
 #include <QVector>
+#include <QPixmap>
+#include <array>
+#include "KeyStateFrame.h"
 
+// Клавиатура 88 клавиш. Геометрия хранится в таблице на 128 MIDI-нот,
+// так что keyRect/pressKey/noteAt — O(1). Обе раскраски клавиатуры
+// (все клавиши отпущены / все нажаты) заранее отрисованы в пиксмапы
+// при resizeEvent; смена состояния клавиши перерисовывает только её
+// прямоугольник, копируя нужный слой.
 class PianoKeyboardWidget : public QWidget
 {
     Q_OBJECT
@@ -13,26 +21,67 @@ public:
     // MIDI ноты: 21 (A0) .. 108 (C8)
     void pressKey(int midiNote);
     void releaseKey(int midiNote);
+    void releaseAllKeys();
+    // Игра на MIDI-клавиатуре. receivedNs — метка приёма (steady_clock),
+    // по ней считается задержка до отрисовки (Metrics::InputToScreenUs)
+    void pressLiveKey(int midiNote, qint64 receivedNs);
+    void releaseLiveKey(int midiNote, qint64 receivedNs);
     QRect keyRect(int midiNote) const;
+    int noteAt(const QPoint &pos) const;   // -1 — мимо клавиш
+
+public slots:
+    // Снимок от MidiPlayer: перерисовываются только изменившиеся клавиши
+    void applyKeyState(const KeyStateFrame &frame);
+
+signals:
+    // Игра мышью
+    void userNoteOn(int midiNote, int velocity);
+    void userNoteOff(int midiNote);
 
 protected:
     void paintEvent(QPaintEvent *event) override;
     void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
     QSize minimumSizeHint() const override;
     QSize sizeHint() const override;
 
 private:
+    static constexpr int FirstNote = 21;    // A0
+    static constexpr int LastNote  = 108;   // C8
+
+    // Кто держит клавишу: воспроизведение, мышь и MIDI-вход независимы
+    enum PressSource : quint8 {
+        Playback = 1,
+        Mouse    = 2,
+        Live     = 4
+    };
+
     struct Key {
         QRect rect;
-        bool isBlack;
-        bool pressed;
-        int midiNote;
+        bool exists = false;
+        bool isBlack = false;
+        quint8 pressed = 0;   // маска PressSource
     };
 
-    QVector<Key> whiteKeys;
-    QVector<Key> blackKeys;
+    std::array<Key, 128> keys;
+    QVector<int> whiteNotes;   // слева направо
+    QVector<int> blackNotes;
+    int whiteWidth = 0;
+    int blackHeight = 0;
+
+    QPixmap idleLayer;
+    QPixmap pressedLayer;
+    int mouseNote = -1;
+    qint64 pendingInputNs = 0;   // самое раннее неотрисованное событие MIDI-входа
 
     void layoutKeys();
+    void renderLayers();
+    void drawKeys(QPainter &p, bool pressed) const;
+    void setPressed(int midiNote, quint8 source, bool on);
+    void setLivePressed(int midiNote, bool on, qint64 receivedNs);
+    int velocityAt(const QPoint &pos) const;
     bool isBlackKey(int midiNote) const;
 };
 
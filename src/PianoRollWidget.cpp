@@ -1,19 +1,43 @@
 #include "PianoRollWidget.h"
 #include "PianoKeyboardWidget.h"
+#include "FramePacer.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include <QPainter>
+#include <QElapsedTimer>
+#include <QImage>
 #include <algorithm>
+#include <cmath>
 
+namespace {
+
+const QColor kNoteColor(0, 188, 212);      // #00BCD4
+const QColor kNearLineColor(255, 152, 0);  // #FF9800
+
+} // namespace
 
 PianoRollWidget::PianoRollWidget(QWidget *parent)
-    : QWidget(parent)
+    : QWidget(parent),
+      m_song(Song::empty())
 {
     setMinimumHeight(200);
     setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    // Фон непрозрачный и рисуется целиком — Qt не нужно стирать виджет
+    setAttribute(Qt::WA_OpaquePaintEvent);
+
+    m_hudTimer = new QTimer(this);
+    m_hudTimer->setInterval(PerfHud::WindowStepMs);
+    connect(m_hudTimer, &QTimer::timeout, this, [this]() {
+        if (!m_pacer || !m_pacer->isActive())
+            update();
+    });
 }
 
-void PianoRollWidget::setNotes(const QVector<MidiNote> &notes)
+void PianoRollWidget::setSong(SongPtr song)
 {
-    m_notes = notes;
+    m_song = song ? std::move(song) : Song::empty();
+    invalidateTiles();
+    resetFrameStats();
     update();
 }
 
@@ -33,86 +57,356 @@ QSize PianoRollWidget::sizeHint() const
     return QSize(800, 300);
 }
 
-void PianoRollWidget::paintEvent(QPaintEvent *event)
+void PianoRollWidget::resizeEvent(QResizeEvent *event)
 {
-    Q_UNUSED(event);
-    QPainter p(this);
+    QWidget::resizeEvent(event);
+    // Высота задаёт масштаб времени — все тайлы устаревают
+    rebuildBackground();
+    invalidateTiles();
+}
 
-    int w = width();
-    int h = height();
+void PianoRollWidget::rebuildBackground()
+{
+    const qreal dpr = devicePixelRatioF();
+    m_background = QPixmap(size() * dpr);
+    m_background.setDevicePixelRatio(dpr);
 
-    // 1) Фон и градиент
-    QLinearGradient bg(0, 0, 0, h);
+    QPainter p(&m_background);
+    QLinearGradient bg(0, 0, 0, height());
     bg.setColorAt(0.0, QColor("#202020"));
     bg.setColorAt(1.0, QColor("#151515"));
     p.fillRect(rect(), bg);
+}
+
+void PianoRollWidget::rebuildKeyTable()
+{
+    // Единственное место, где спрашиваем геометрию у клавиатуры
+    m_keyTableWidth = m_keyboard ? m_keyboard->width() : -1;
+    for (int note = 0; note < 128; ++note) {
+        const QRect r = m_keyboard ? m_keyboard->keyRect(note) : QRect();
+        m_keyX[note] = r.isValid() ? r.x() : 0;
+        m_keyWidth[note] = r.isValid() ? r.width() : 0;
+    }
+}
+
+void PianoRollWidget::invalidateTiles()
+{
+    for (Tile &t : m_tiles)
+        t.index = -1;
+}
+
+const QPixmap &PianoRollWidget::tile(qint64 index, qint64 firstVisible, qint64 lastVisible)
+{
+    Tile *victim = nullptr;
+    for (Tile &t : m_tiles) {
+        if (t.index == index)
+            return t.pixmap;
+        // Вытесняем тайл, ушедший из окна (обычно — уже проигранный)
+        if (!victim && (t.index < firstVisible || t.index > lastVisible))
+            victim = &t;
+    }
+    if (!victim) {
+        m_tiles.emplace_back();
+        victim = &m_tiles.back();
+    }
+
+    victim->index = index;
+    renderTile(*victim);
+    ++m_frameStats.tilesRendered;
+    return victim->pixmap;
+}
+
+void PianoRollWidget::renderTile(Tile &t)
+{
+    PIANO_TRACE_ZONE("PianoRollWidget::renderTile");
+    // Пиксель времени T (от начала песни) лежит в тайле на строке
+    // (index + 1) * TileHeight - T: время растёт вверх
+    const double px = pixelsPerMs();
+    const qint64 tileBottomPx = t.index * TileHeight;
+    const qint64 tileTopPx = tileBottomPx + TileHeight;
+    const quint32 t0 = quint32(std::max(0.0, std::floor(double(tileBottomPx) / px)));
+    const quint32 t1 = quint32(std::ceil(double(tileTopPx) / px));
 
-    if (m_notes.isEmpty() || !m_keyboard)
+    const qint64 noteBudget = qint64(width()) * TileHeight / PixelsPerNote;
+    if (m_song->density().noteEstimate(m_visibleTracks, t0, t1) > noteBudget) {
+        renderDensityTile(t, tileTopPx);
+        ++m_frameStats.densityTiles;
         return;
+    }
 
-    const qint64 windowLength = 8000;
-    const qint64 tNow = m_currentTimeMs;
+    // Ноты растеризуются полосами в пуле потоков прямо в буфер изображения,
+    // готовый тайл — один QPixmap
+    const qreal dpr = devicePixelRatioF();
+    QImage image(QSize(width(), TileHeight) * dpr, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
 
-    p.setRenderHint(QPainter::Antialiasing, false);
+    std::array<int, 128> keyX;
+    std::array<int, 128> keyWidth;
+    for (int pitch = 0; pitch < 128; ++pitch) {
+        keyX[pitch] = int(std::lround(m_keyX[pitch] * dpr));
+        keyWidth[pitch] = m_keyWidth[pitch] > 0
+            ? std::max(1, int(std::lround((m_keyX[pitch] + m_keyWidth[pitch]) * dpr)) - keyX[pitch])
+            : 0;
+    }
+
+    RollRasterizer::Params params;
+    params.notes     = &m_song->notes();
+    params.tracks    = &m_song->trackViews();
+    params.trackMask = m_visibleTracks;
+    params.keyX      = &keyX;
+    params.keyWidth  = &keyWidth;
+    params.topPx     = std::llround(double(tileTopPx) * dpr);
+    params.pxPerMs   = px * dpr;
+    params.color     = qPremultiply(kNoteColor.rgba());
+    m_rasterizer.render(image, params);
 
-    // 2) Цвета для нот
-    QColor mainColor(0, 188, 212);      // #00BCD4
-    QColor nearLineColor(255, 152, 0);  // #FF9800
+    t.pixmap = QPixmap::fromImage(image);
+    t.pixmap.setDevicePixelRatio(dpr);
+}
+
+void PianoRollWidget::renderDensityTile(Tile &t, qint64 tileTopPx)
+{
+    PIANO_TRACE_ZONE("PianoRollWidget::renderDensityTile");
+    // Строка за строкой прямо в буфер: на строку — одна корзина карты,
+    // на клавишу — один отрезок строки. Соседние строки из одной корзины
+    // просто копируются.
+    const qreal dpr = devicePixelRatioF();
+    const QSize deviceSize = QSize(width(), TileHeight) * dpr;
+    QImage image(deviceSize, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
 
-    // 3) Цикл по нотам
-    for (const auto &n : m_notes) {
-        qint64 start = n.startTime;
-        qint64 end   = n.startTime + n.duration;
+    const DensityPyramid &density = m_song->density();
+    const double px = pixelsPerMs();
+    const double msPerRow = 1.0 / (px * dpr);
+    const int level = density.levelForBinMs(msPerRow);
+    const qint64 binMs = density.binMs(level);
+    const int binCount = density.binCount(level);
+    const bool allTracks = density.coversAll(m_visibleTracks);
+    std::array<DensityPyramid::Cell, 128> masked;
 
-        if (end <= tNow || start >= tNow + windowLength)
+    std::array<int, 128> x0;
+    std::array<int, 128> x1;
+    for (int pitch = 0; pitch < 128; ++pitch) {
+        x0[pitch] = std::min(deviceSize.width(), int(std::lround(m_keyX[pitch] * dpr)));
+        x1[pitch] = std::min(deviceSize.width(), int(std::lround((m_keyX[pitch] + m_keyWidth[pitch]) * dpr)));
+    }
+
+    int prevBin = -1;
+    for (int row = 0; row < deviceSize.height(); ++row) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(row));
+        const double timeMs = (double(tileTopPx) - (row + 0.5) / dpr) / px;
+        if (timeMs < 0.0)
+            break;
+        const int bin = int(qint64(timeMs) / binMs);
+        if (bin >= binCount)
+            continue;
+        if (bin == prevBin) {
+            const quint32 *prev = reinterpret_cast<const quint32 *>(image.constScanLine(row - 1));
+            std::copy(prev, prev + deviceSize.width(), line);
             continue;
+        }
+        prevBin = bin;
 
-        qint64 visibleStart = std::max(start, tNow);
-        qint64 visibleEnd   = std::min(end,   tNow + windowLength);
+        // Скрыта часть дорожек — ячейки пересчитываются по маске
+        const DensityPyramid::Cell *cells = density.bin(level, bin);
+        if (!allTracks) {
+            density.maskedBin(m_visibleTracks, level, bin, masked.data());
+            cells = masked.data();
+        }
+        for (int pitch = 0; pitch < 128; ++pitch) {
+            const DensityPyramid::Cell &c = cells[pitch];
+            if (c.count == 0 || x0[pitch] >= x1[pitch])
+                continue;
+            // Прозрачность — по числу нот, яркость — по самой громкой
+            const int a = std::min(255, 96 + 40 * c.count);
+            const int bright = 128 + c.maxVelocity;
+            const quint32 argb = qPremultiply(qRgba(kNoteColor.red() * bright / 255,
+                                                    kNoteColor.green() * bright / 255,
+                                                    kNoteColor.blue() * bright / 255, a));
+            std::fill(line + x0[pitch], line + x1[pitch], argb);
+        }
+    }
 
-        double tToNowStart = double(visibleStart - tNow);
-        double tToNowEnd   = double(visibleEnd   - tNow);
+    t.pixmap = QPixmap::fromImage(image);
+    t.pixmap.setDevicePixelRatio(dpr);
+}
 
-        auto timeToY = [h, windowLength](double tToNow) {
-            double ratio = tToNow / double(windowLength);
-            if (ratio < 0.0) ratio = 0.0;
-            if (ratio > 1.0) ratio = 1.0;
-            return h - int(ratio * h);
-        };
+void PianoRollWidget::recordFrame(qint64 ns)
+{
+    const double ms = double(ns) / 1.0e6;
+    FrameStats &s = m_frameStats;
+    ++s.frames;
+    s.lastMs = ms;
+    s.meanMs += (ms - s.meanMs) / double(s.frames);
+    s.maxMs = std::max(s.maxMs, ms);
 
-        int yBottom = timeToY(tToNowStart);
-        int yTop    = timeToY(tToNowEnd);
-        if (yTop > yBottom)
-            std::swap(yTop, yBottom);
+    Metrics::add(Metrics::RollFrames);
+    Metrics::record(Metrics::RollFrameUs, ns / 1000);
+}
 
-        QRect keyR = m_keyboard->keyRect(n.pitch);
-        if (!keyR.isValid())
-            continue;
+void PianoRollWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    PIANO_TRACE_ZONE("PianoRollWidget::paintEvent");
+    QElapsedTimer timer;
+    timer.start();
 
-        int noteX     = keyR.x();
-        int noteWidth = keyR.width();
+    QPainter p(this);
+    const int w = width();
+    const int h = height();
 
-        QRect r(noteX, yTop, noteWidth, yBottom - yTop);
+    // 1) Фон — готовый градиент
+    p.drawPixmap(0, 0, m_background);
 
-        // 4) Выбор цвета ноты
-        QColor color = mainColor;
-        if (visibleStart <= tNow + 150 && visibleEnd >= tNow) {
-            // нота прямо над клавиатурой
-            color = nearLineColor;
-        }
+    if (m_song->isEmpty() || !m_keyboard) {
+        Metrics::set(Metrics::VisibleNotes, 0);
+        if (m_showHud)
+            m_hud.paint(p, w, devicePixelRatioF());
+        recordFrame(timer.nsecsElapsed());
+        return;
+    }
+
+    if (m_keyboard->width() != m_keyTableWidth) {
+        rebuildKeyTable();
+        invalidateTiles();
+    }
 
-        p.setPen(Qt::NoPen);
-        p.setBrush(color);
-        p.drawRect(r);
+    // 2) Поле нот из тайлов. y(T) = base - T * px, base — y момента 0.
+    const double px = pixelsPerMs();
+    const qint64 tNow = m_currentTimeMs;
+    const qint64 nowPx = std::lround(double(tNow) * px);
+    const qint64 base = h + nowPx;
+
+    const qint64 firstTile = std::max<qint64>(0, nowPx) / TileHeight;
+    const qint64 lastTile = (std::max<qint64>(0, nowPx) + h) / TileHeight;
+    for (qint64 k = firstTile; k <= lastTile; ++k)
+        p.drawPixmap(0, int(base - (k + 1) * TileHeight), tile(k, firstTile, lastTile));
+
+    // 3) Ноты прямо над клавиатурой — поверх тайлов другим цветом;
+    // в сплошной массе нот подсветка ничего не добавит, её пропускаем
+    p.setRenderHint(QPainter::Antialiasing, false);
+    const quint32 windowStart = quint32(std::max<qint64>(tNow, 0));
+    const quint32 windowEnd = quint32(windowStart + HighlightMs);
+    const NoteStore &notes = m_song->notes();
+    Metrics::set(Metrics::VisibleNotes, m_song->density().noteEstimate(m_visibleTracks, windowStart, quint32(windowStart + WindowMs)));
+    m_visible.clear();
+    if (m_song->density().noteEstimate(m_visibleTracks, windowStart, windowEnd) <= HighlightNoteBudget)
+        m_song->trackViews().overlapping(notes, m_visibleTracks, windowStart, windowEnd, m_visible);
+    for (quint32 i : m_visible) {
+        const int pitch = notes.pitch(i);
+        if (m_keyWidth[pitch] == 0)
+            continue;
+        const int yTop    = int(base - std::lround(double(notes.endTime(i)) * px));
+        const int yBottom = int(base - std::lround(double(notes.startTime(i)) * px));
+        p.fillRect(m_keyX[pitch], yTop, m_keyWidth[pitch], std::max(1, yBottom - yTop), kNearLineColor);
     }
 
+    // 4) Звучащие клавиши: полоса над клавишей, яркость — по velocity
+    m_keyState.forEachPressed([&](int pitch) {
+        if (m_keyWidth[pitch] == 0)
+            return;
+        QColor glow = kNearLineColor;
+        glow.setAlpha(96 + m_keyState.velocity[pitch]);
+        p.fillRect(m_keyX[pitch], h - 6, m_keyWidth[pitch], 6, glow);
+    });
+
     // 5) Линия текущего времени (у клавиатуры)
-    p.setPen(QPen(QColor("#FF9800"), 2));
+    p.setPen(QPen(kNearLineColor, 2));
     p.drawLine(0, h - 1, w, h - 1);
+
+    if (m_showHistogram && m_pacer)
+        drawHistogram(p);
+    if (m_showHud)
+        m_hud.paint(p, w, devicePixelRatioF());
+
+    recordFrame(timer.nsecsElapsed());
+}
+
+void PianoRollWidget::applyKeyState(const KeyStateFrame &frame)
+{
+    m_keyState = frame;
+    if (frame.hasChanges())
+        update(0, height() - 6, width(), 6);
+}
+
+void PianoRollWidget::setPlaybackClock(const PlaybackClock &clock)
+{
+    m_clock = clock;
+}
+
+void PianoRollWidget::advanceFrame(qint64 nowNs)
+{
+    const qint64 t = m_clock.positionMsAt(nowNs);
+    if (t == m_currentTimeMs && !m_showHistogram && !m_showHud)
+        return;
+    m_currentTimeMs = t;
+    update();
+}
+
+void PianoRollWidget::setHistogramVisible(bool visible)
+{
+    m_showHistogram = visible;
+    update();
+}
+
+void PianoRollWidget::setHudVisible(bool visible)
+{
+    m_showHud = visible;
+    if (visible)
+        m_hudTimer->start();
+    else
+        m_hudTimer->stop();
+    update();
+}
+
+void PianoRollWidget::drawHistogram(QPainter &p)
+{
+    const FramePacer::Stats &s = m_pacer->stats();
+    const int barWidth = 4;
+    const int chartHeight = 60;
+    const QRect box(width() - FramePacer::HistogramBuckets * barWidth - 20, 8,
+                    FramePacer::HistogramBuckets * barWidth + 12, chartHeight + 44);
+
+    p.fillRect(box, QColor(0, 0, 0, 170));
+
+    qint64 peak = 1;
+    for (qint64 count : s.histogram)
+        peak = std::max(peak, count);
+
+    // Столбик на каждую миллисекунду интервала; период экрана — отметка
+    const int chartLeft = box.x() + 6;
+    const int chartBottom = box.y() + 6 + chartHeight;
+    for (int i = 0; i < FramePacer::HistogramBuckets; ++i) {
+        const int barHeight = int(s.histogram[i] * chartHeight / peak);
+        if (barHeight > 0)
+            p.fillRect(chartLeft + i * barWidth, chartBottom - barHeight, barWidth - 1, barHeight, kNoteColor);
+    }
+    const int periodX = chartLeft + int(1000.0 / m_pacer->refreshRate() * barWidth);
+    p.setPen(kNearLineColor);
+    p.drawLine(periodX, chartBottom - chartHeight, periodX, chartBottom);
+
+    p.setPen(QColor("#E0E0E0"));
+    p.drawText(chartLeft, chartBottom + 16,
+               QString("%1 Гц, кадр %2 мс, отрисовка %3 мс")
+                   .arg(m_pacer->refreshRate(), 0, 'f', 0)
+                   .arg(s.lastIntervalMs, 0, 'f', 1)
+                   .arg(m_frameStats.lastMs, 0, 'f', 2));
+    p.drawText(chartLeft, chartBottom + 32,
+               QString("поздних %1, пропущено %2 из %3").arg(s.late).arg(s.missed).arg(s.frames));
+}
+
+void PianoRollWidget::setVisibleTracks(quint64 mask)
+{
+    if (mask == m_visibleTracks)
+        return;
+    m_visibleTracks = mask;
+    invalidateTiles();
+    update();
 }
 
 void PianoRollWidget::setKeyboard(PianoKeyboardWidget *keyboard)
 {
     m_keyboard = keyboard;
+    m_keyTableWidth = -1;
     update();
 }
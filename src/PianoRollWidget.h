@@ -2,31 +2,129 @@
 #define PIANOROLLWIDGET_H
 
 #include <QWidget>
-#include <QVector>
-#include "MidiParser.h"   // для MidiNote
+#include <QPixmap>
+#include <QTimer>
+#include <array>
+#include <vector>
+#include "KeyStateFrame.h"
+#include "PerfHud.h"
+#include "Song.h"
+#include "PlaybackClock.h"
+#include "RollRasterizer.h"
 
 class PianoKeyboardWidget;   // forward
+class FramePacer;
 
+// Ноты падают сверху к клавиатуре; окно — WindowMs вперёд от текущего
+// времени. Поле нот заранее растеризуется в горизонтальные полосы-тайлы
+// (TileHeight пикселей по времени; сами ноты заливает RollRasterizer
+// в несколько потоков), которые при движении времени лишь сдвигаются:
+// кадр — это фон, пара-тройка blit'ов и подсвеченные ноты у клавиатуры.
+// Тайлы перерисовываются только при смене песни, размера
+// или раскладки клавиатуры.
+//
+// Там, где нот больше, чем пикселей (PixelsPerNote на ноту), тайл рисуется
+// не по нотам, а по карте плотности песни (DensityPyramid): цена тайла
+// ограничена его площадью, сколько бы нот в нём ни было. Скрытые дорожки
+// этого не отменяют: выбор делает DensityPyramid::noteEstimate по маске
+// видимых дорожек, и плотный тайл берёт ячейки из maskedBin — счётчики
+// только видимых дорожек. По нотам (Song::trackViews) рисуются лишь
+// тайлы, уложившиеся в бюджет.
+//
+// В режиме FramePacer позиция не приходит снаружи, а экстраполируется
+// на каждый кадр экрана из PlaybackClock — прокрутка идёт с частотой
+// монитора, без лишних обращений к секвенсору.
 class PianoRollWidget : public QWidget
 {
     Q_OBJECT
 public:
+    struct FrameStats {
+        qint64 frames = 0;
+        double lastMs = 0.0;
+        double meanMs = 0.0;
+        double maxMs  = 0.0;
+        qint64 tilesRendered = 0;   // промахи кэша тайлов
+        qint64 densityTiles = 0;    // из них нарисовано по карте плотности
+    };
+
     explicit PianoRollWidget(QWidget *parent = nullptr);
 
-    void setNotes(const QVector<MidiNote> &notes);
+    // Песня делится с плеером, ноты не копируются
+    void setSong(SongPtr song);
     void setCurrentTime(qint64 ms);
 
     void setKeyboard(PianoKeyboardWidget *keyboard);
 
+    // Видимые дорожки (NoteStore::TrackMask); тайлы перерисуются к следующему кадру
+    void setVisibleTracks(quint64 mask);
+
+    const FrameStats &frameStats() const { return m_frameStats; }
+    void resetFrameStats() { m_frameStats = FrameStats(); }
+
+    // Гистограмма интервалов кадров поверх ролла
+    void setFramePacer(const FramePacer *pacer) { m_pacer = pacer; }
+    void setHistogramVisible(bool visible);
+    // HUD производительности (PerfHud) в правом верхнем углу
+    void setHudVisible(bool visible);
+    bool isHudVisible() const { return m_showHud; }
+
+public slots:
+    // Звучащие клавиши подсвечиваются полосой у клавиатуры
+    void applyKeyState(const KeyStateFrame &frame);
+    void setPlaybackClock(const PlaybackClock &clock);
+    // Кадр от FramePacer: позиция = часы воспроизведения на момент nowNs
+    void advanceFrame(qint64 nowNs);
+
 protected:
     void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
     QSize minimumSizeHint() const override;
     QSize sizeHint() const override;
 
 private:
-    QVector<MidiNote> m_notes;
+    static constexpr qint64 WindowMs    = 8000;
+    static constexpr qint64 HighlightMs = 150;   // «у клавиатуры»
+    static constexpr int    TileHeight  = 256;
+    static constexpr int    PixelsPerNote = 16;       // плотнее — рисуем по карте плотности
+    static constexpr int    HighlightNoteBudget = 2048;
+
+    struct Tile {
+        qint64 index = -1;   // тайл k покрывает пиксели времени [k*TileHeight, (k+1)*TileHeight)
+        QPixmap pixmap;
+    };
+
+    double pixelsPerMs() const { return double(height()) / double(WindowMs); }
+    void rebuildKeyTable();
+    void rebuildBackground();
+    void invalidateTiles();
+    const QPixmap &tile(qint64 index, qint64 firstVisible, qint64 lastVisible);
+    void renderTile(Tile &tile);
+    void renderDensityTile(Tile &tile, qint64 tileTopPx);
+    void recordFrame(qint64 ns);
+    void drawHistogram(QPainter &p);
+
+    SongPtr m_song;   // никогда не nullptr
+    std::vector<quint32> m_visible;   // подсвеченные ноты, переиспользуется между кадрами
     qint64 m_currentTimeMs = 0;
+    quint64 m_visibleTracks = NoteStore::AllTracks;
+    KeyStateFrame m_keyState;
+    PlaybackClock m_clock;
+    const FramePacer *m_pacer = nullptr;
+    bool m_showHistogram = false;
+    PerfHud m_hud;
+    bool m_showHud = false;
+    QTimer *m_hudTimer;   // без воспроизведения кадров нет — HUD обновляет он
     PianoKeyboardWidget *m_keyboard = nullptr;
+
+    // x и ширина клавиши по MIDI-ноте; ширина 0 — клавиши нет
+    std::array<int, 128> m_keyX{};
+    std::array<int, 128> m_keyWidth{};
+    int m_keyTableWidth = -1;         // ширина клавиатуры, под которую строилась таблица
+
+    QPixmap m_background;
+    std::vector<Tile> m_tiles;
+    RollRasterizer m_rasterizer;
+    FrameStats m_frameStats;
 };
 
 #endif // PIANOROLLWIDGET_H
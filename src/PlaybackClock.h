@@ -0,0 +1,27 @@
+// PlaybackClock.h
+#ifndef PLAYBACKCLOCK_H
+#define PLAYBACKCLOCK_H
+
+#include <QtGlobal>
+
+// Снимок часов секвенсора: якорь (время песни, момент steady_clock) и
+// скорость. По нему GUI сам экстраполирует позицию на любой момент —
+// например, на каждый кадр экрана, не дёргая поток секвенсора.
+struct PlaybackClock {
+    double anchorSongUs = 0.0;
+    qint64 anchorWallNs = 0;   // steady_clock, нс от его эпохи
+    double speed = 1.0;
+    bool running = false;
+    qint64 durationMs = 0;
+
+    double positionUsAt(qint64 wallNs) const
+    {
+        double us = anchorSongUs;
+        if (running)
+            us += double(wallNs - anchorWallNs) / 1000.0 * speed;
+        return qBound(0.0, us, double(durationMs) * 1000.0);
+    }
+    qint64 positionMsAt(qint64 wallNs) const { return qint64(positionUsAt(wallNs) / 1000.0); }
+};
+
+#endif
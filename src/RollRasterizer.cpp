@@ -0,0 +1,81 @@
+#include "RollRasterizer.h"
+#include "NoteStore.h"
+#include "TrackViews.h"
+#include "Trace.h"
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <cmath>
+
+RollRasterizer::RollRasterizer(QThreadPool *pool)
+    : m_pool(pool ? pool : QThreadPool::globalInstance())
+{
+}
+
+void RollRasterizer::render(QImage &image, const Params &params) const
+{
+    PIANO_TRACE_ZONE("RollRasterizer::render");
+    const int rows = image.height();
+    if (rows <= 0 || !params.notes || params.notes->isEmpty())
+        return;
+
+    // bits() может отсоединить данные — берём указатель до запуска полос
+    const Target target{ image.bits(), image.bytesPerLine(), image.width() };
+    const int threads = m_maxThreads > 0 ? m_maxThreads : m_pool->maxThreadCount() + 1;
+    const int bands = qBound(1, rows / MinBandRows, qMax(1, threads));
+    if (bands == 1) {
+        renderBand(target, params, 0, rows);
+        return;
+    }
+
+    // Полоса i — строки [i * rows / bands, (i + 1) * rows / bands)
+    QSemaphore done;
+    for (int i = 0; i < bands - 1; ++i) {
+        const int y0 = i * rows / bands;
+        const int y1 = (i + 1) * rows / bands;
+        m_pool->start([&target, &params, &done, y0, y1]() {
+            Trace::setThreadName("raster pool");
+            renderBand(target, params, y0, y1);
+            done.release();
+        });
+    }
+    renderBand(target, params, (bands - 1) * rows / bands, rows);
+    done.acquire(bands - 1);
+}
+
+void RollRasterizer::renderBand(const Target &target, const Params &params, int y0, int y1)
+{
+    PIANO_TRACE_ZONE("RollRasterizer::renderBand");
+    // Строка y показывает момент (topPx - y) / pxPerMs; полосе нужны ноты,
+    // задевающие её промежуток времени
+    const double px = params.pxPerMs;
+    const quint32 t0 = quint32(std::max(0.0, std::floor(double(params.topPx - y1) / px)));
+    const quint32 t1 = quint32(std::max(0.0, std::ceil(double(params.topPx - y0) / px)));
+    const int width = target.width;
+    const std::array<int, 128> &keyX = *params.keyX;
+    const std::array<int, 128> &keyWidth = *params.keyWidth;
+    const NoteStore &notes = *params.notes;
+
+    auto fill = [&](quint32 i) {
+        const int pitch = notes.pitch(i);
+        if (keyWidth[pitch] == 0)
+            return;
+        const qint64 yTop    = params.topPx - std::llround(double(notes.endTime(i)) * px);
+        const qint64 yBottom = std::max(yTop + 1, params.topPx - std::llround(double(notes.startTime(i)) * px));
+        const int r0 = int(std::max<qint64>(yTop, y0));
+        const int r1 = int(std::min<qint64>(yBottom, y1));
+        const int x0 = std::max(0, keyX[pitch]);
+        const int x1 = std::min(width, keyX[pitch] + keyWidth[pitch]);
+        if (r0 >= r1 || x0 >= x1)
+            return;
+
+        for (int y = r0; y < r1; ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(target.bits + y * target.stride);
+            std::fill(line + x0, line + x1, params.color);
+        }
+    };
+    if (params.tracks)
+        params.tracks->forEachOverlapping(notes, params.trackMask, t0, t1, fill);
+    else
+        notes.forEachOverlapping(t0, t1, fill);
+}
@@ -0,0 +1,59 @@
+// RollRasterizer.h
+#ifndef ROLLRASTERIZER_H
+#define ROLLRASTERIZER_H
+
+#include <QImage>
+#include <QtGlobal>
+#include <array>
+
+class NoteStore;
+class QThreadPool;
+class TrackViews;
+
+// Программная растеризация нот ролла в QImage без QPainter. Изображение
+// делится на горизонтальные полосы, каждая полоса — отдельная задача
+// пула потоков: сама находит свои ноты через индекс интервалов (только
+// видимых дорожек) и заливает их прямоугольники построчно (std::fill по строке пикселей).
+// Полосы не пересекаются, так что потоки пишут в общий буфер без
+// синхронизации; вызывающий поток берёт последнюю полосу себе и ждёт
+// остальные.
+class RollRasterizer {
+public:
+    // Геометрия в пикселях устройства
+    struct Params {
+        const NoteStore *notes = nullptr;
+        const TrackViews *tracks = nullptr;          // nullptr — все ноты
+        quint64 trackMask = ~quint64(0);             // NoteStore::TrackMask
+        const std::array<int, 128> *keyX = nullptr;       // ширина 0 — клавиши нет
+        const std::array<int, 128> *keyWidth = nullptr;
+        qint64 topPx = 0;        // строка 0 изображения = момент topPx / pxPerMs; время растёт вверх
+        double pxPerMs = 1.0;
+        QRgb color = 0;          // premultiplied ARGB
+    };
+
+    static constexpr int MinBandRows = 16;   // тоньше — накладные расходы больше работы
+
+    explicit RollRasterizer(QThreadPool *pool = nullptr);   // nullptr — глобальный пул
+
+    // 0 — столько полос, сколько потоков у пула (плюс вызывающий)
+    void setMaxThreads(int threads) { m_maxThreads = threads; }
+    int maxThreads() const { return m_maxThreads; }
+
+    // image — ARGB32_Premultiplied, уже очищенное
+    void render(QImage &image, const Params &params) const;
+
+private:
+    struct Target {
+        uchar *bits;
+        qsizetype stride;
+        int width;
+    };
+
+    // Одна полоса [y0, y1) — ядро, которое выполняют задачи пула
+    static void renderBand(const Target &target, const Params &params, int y0, int y1);
+
+    QThreadPool *m_pool;
+    int m_maxThreads = 0;
+};
+
+#endif
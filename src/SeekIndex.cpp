@@ -0,0 +1,67 @@
+#include "SeekIndex.h"
+
+void SeekIndex::build(const NoteStore &notes, const NoteEventSchedule &schedule,
+                      const ControlEventList &controls)
+{
+    m_checkpoints.clear();
+    m_active.clear();
+
+    quint32 lastMs = 0;
+    if (schedule.size() > 0)
+        lastMs = schedule.at(schedule.size() - 1).timeMs;
+    if (!controls.empty())
+        lastMs = qMax(lastMs, controls.back().timeMs);
+    m_checkpoints.reserve(lastMs / IntervalMs + 1);
+
+    // Один проход по расписанию. Звучащие ноты — плотный массив,
+    // slot[note] — место ноты в нём (удаление обменом с последней)
+    std::vector<quint32> sounding;
+    std::vector<int> slot(size_t(notes.size()), -1);
+    ControllerState state;
+    const int count = schedule.size();
+    int pos = 0;
+    int controlPos = 0;
+
+    for (quint32 k = 0; k <= lastMs / IntervalMs; ++k) {
+        const quint32 timeMs = k * IntervalMs;
+        for (; pos < count && schedule.at(pos).timeMs <= timeMs; ++pos) {
+            const quint32 note = quint32(schedule.at(pos).note());
+            if (schedule.at(pos).isOn()) {
+                slot[note] = int(sounding.size());
+                sounding.push_back(note);
+            } else if (slot[note] >= 0) {
+                const quint32 moved = sounding.back();
+                sounding[slot[note]] = moved;
+                slot[moved] = slot[note];
+                sounding.pop_back();
+                slot[note] = -1;
+            }
+        }
+        for (; controlPos < int(controls.size()) && controls[controlPos].timeMs <= timeMs; ++controlPos)
+            state.apply(controls[controlPos]);
+
+        Checkpoint cp;
+        cp.schedulePos = pos;
+        cp.controlPos  = controlPos;
+        cp.activeBegin = quint32(m_active.size());
+        m_active.insert(m_active.end(), sounding.begin(), sounding.end());
+        cp.activeEnd   = quint32(m_active.size());
+        cp.controllers = state;
+        m_checkpoints.push_back(cp);
+    }
+}
+
+const SeekIndex::Checkpoint &SeekIndex::checkpointFor(quint32 positionMs) const
+{
+    const size_t i = qMin<size_t>(positionMs / IntervalMs, m_checkpoints.size() - 1);
+    return m_checkpoints[i];
+}
+
+ControllerState SeekIndex::controllersAt(const ControlEventList &controls, quint32 positionMs) const
+{
+    const Checkpoint &cp = checkpointFor(positionMs);
+    ControllerState state = cp.controllers;
+    for (int i = cp.controlPos; i < int(controls.size()) && controls[i].timeMs <= positionMs; ++i)
+        state.apply(controls[i]);
+    return state;
+}
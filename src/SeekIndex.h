@@ -0,0 +1,48 @@
+// SeekIndex.h
+#ifndef SEEKINDEX_H
+#define SEEKINDEX_H
+
+#include <QtGlobal>
+#include <vector>
+#include "ControllerState.h"
+#include "NoteEventSchedule.h"
+#include "NoteStore.h"
+
+// Контрольные точки для перемотки, строятся при загрузке песни раз
+// в IntervalMs. Точка хранит позицию в расписании и в списке
+// контроллеров, звучащие ноты и состояние контроллеров всех каналов
+// сразу после событий своего момента. Перемотка берёт ближайшую точку
+// не позже цели и доигрывает хвост не длиннее IntervalMs — её цена
+// не зависит от длины песни.
+class SeekIndex {
+public:
+    static constexpr quint32 IntervalMs = 2000;
+
+    struct Checkpoint {
+        int schedulePos = 0;       // события расписания до неё уже проиграны
+        int controlPos = 0;        // то же для контроллеров
+        quint32 activeBegin = 0;   // звучащие ноты — [begin, end) в activeNotes()
+        quint32 activeEnd = 0;
+        ControllerState controllers;
+    };
+
+    // Нулевая точка есть всегда, в том числе у пустой песни
+    SeekIndex() : m_checkpoints(1) {}
+
+    void build(const NoteStore &notes, const NoteEventSchedule &schedule,
+               const ControlEventList &controls);
+
+    int checkpointCount() const { return int(m_checkpoints.size()); }
+    // Последняя точка с моментом <= positionMs
+    const Checkpoint &checkpointFor(quint32 positionMs) const;
+    const quint32 *activeNotes() const { return m_active.data(); }
+
+    // Состояние контроллеров после всех событий с моментом <= positionMs
+    ControllerState controllersAt(const ControlEventList &controls, quint32 positionMs) const;
+
+private:
+    std::vector<Checkpoint> m_checkpoints;   // i-я — момент i * IntervalMs
+    std::vector<quint32> m_active;           // звучащие ноты всех точек подряд
+};
+
+#endif
@@ -0,0 +1,471 @@
+#include "SequencerThread.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+SequencerThread::SequencerThread(Callbacks callbacks)
+    : m_callbacks(std::move(callbacks)),
+      m_anchorWall(Clock::now())
+{
+    // Пачка — события одного пробуждения. Обычно хватает и этого запаса;
+    // плотный аккорд или перемотка с досылкой контроллеров его превысят,
+    // тогда буфер вырастет один раз: clear() ёмкость не отдаёт, и дальше
+    // выделений нет, пока не придёт пачка крупнее
+    for (Outgoing *out : { &m_outgoing, &m_delivering }) {
+        out->audio.reserve(256);
+        out->gui.reserve(256);
+    }
+    m_thread = std::thread(&SequencerThread::run, this);
+}
+
+SequencerThread::~SequencerThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SequencerThread::setSong(SongPtr song)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        adoptSong(song);
+        m_cursor.reset();
+        m_audioCursor.reset();
+        m_audioControlPos = m_controls ? controlUpperBound(*m_controls, 0) : 0;
+        m_chasePending = true;
+        m_chaseMs = 0;
+        m_running = false;
+        reanchor(0.0);
+        ++m_generation;
+        m_guiEpoch.fetch_add(1, std::memory_order_release);
+    }
+    m_wake.notify_all();
+    // song теперь держит прежнюю песню — она освобождается здесь, вне мьютекса
+}
+
+void SequencerThread::replaceSong(SongPtr song)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const Clock::time_point now = Clock::now();
+        const double songUs = m_running ? songUsAt(now) : m_anchorSongUs;
+        adoptSong(song);
+        reanchor(qBound(0.0, songUs, double(m_durationMs) * 1000.0));
+        if (m_schedule && m_notes) {
+            const double audioUs = m_running ? songUsAt(now + microseconds(m_audioLookaheadUs)) : songUs;
+            // Начало песни не изменилось — контроллеры уже отправлены, досылать нечего
+            const SeekIndex &index = m_song->seekIndex();
+            m_cursor.seek(*m_schedule, *m_notes, index, quint32(songUs / 1000.0));
+            m_audioCursor.seek(*m_schedule, *m_notes, index, quint32(audioUs / 1000.0));
+            m_audioControlPos = controlUpperBound(*m_controls, quint32(audioUs / 1000.0));
+        } else {
+            m_cursor.reset();
+            m_audioCursor.reset();
+            m_audioControlPos = 0;
+        }
+        ++m_generation;
+    }
+    m_wake.notify_all();
+}
+
+void SequencerThread::adoptSong(SongPtr &song)
+{
+    // Обмен, а не присваивание: старая песня уходит вызывающему
+    m_song.swap(song);
+    m_notes = m_song ? &m_song->notes() : nullptr;
+    m_schedule = m_song ? &m_song->schedule() : nullptr;
+    m_controls = m_song ? &m_song->controls() : nullptr;
+    m_durationMs = m_song ? m_song->durationMs() : 0;
+}
+
+void SequencerThread::start()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_running || !m_schedule)
+            return;
+        reanchor(m_anchorSongUs);
+        m_running = true;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+}
+
+void SequencerThread::pause()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        reanchor(songUsAt(Clock::now()));
+        m_running = false;
+        ++m_generation;
+        m_guiEpoch.fetch_add(1, std::memory_order_release);
+    }
+    m_wake.notify_all();
+}
+
+void SequencerThread::seek(qint64 positionMs)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        positionMs = qBound<qint64>(0, positionMs, m_durationMs);
+        reanchor(double(positionMs) * 1000.0);
+        if (m_schedule && m_notes) {
+            const SeekIndex &index = m_song->seekIndex();
+            m_cursor.seek(*m_schedule, *m_notes, index, quint32(positionMs));
+            m_audioCursor.seek(*m_schedule, *m_notes, index, quint32(positionMs));
+            m_audioControlPos = controlUpperBound(*m_controls, quint32(positionMs));
+        } else {
+            m_cursor.reset();
+            m_audioCursor.reset();
+            m_audioControlPos = 0;
+        }
+        m_chasePending = true;
+        m_chaseMs = quint32(positionMs);
+        ++m_generation;
+        m_guiEpoch.fetch_add(1, std::memory_order_release);
+    }
+    m_wake.notify_all();
+}
+
+void SequencerThread::setSpeed(double speed)
+{
+    if (speed <= 0.0)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_running)
+            reanchor(songUsAt(Clock::now()));
+        m_speed = speed;
+        ++m_generation;
+    }
+    m_wake.notify_all();
+}
+
+void SequencerThread::setAudioLookaheadUs(qint64 us)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_audioLookaheadUs = qMax<qint64>(0, us);
+        ++m_generation;
+    }
+    m_wake.notify_all();
+}
+
+void SequencerThread::setTrackMasks(quint64 audible, quint64 autoplay)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_schedule || !m_notes) {
+            m_audioCursor.setTrackMask(audible);
+            m_cursor.setTrackMask(autoplay);
+            return;
+        }
+        const SeekIndex &index = m_song->seekIndex();
+        // note-off выключенных дорожек отправит поток секвенсора — у кольца
+        // синтезатора один писатель
+        m_audioCursor.setTrackMask(*m_schedule, *m_notes, index, audible,
+                                   [this](quint32 timeMs, int pitch, int channel) {
+                                       m_outgoing.audio.push_back(MidiEvent::noteOff(eventStampNs(timeMs), pitch, channel));
+                                   });
+        // Клавиши GUI восстанавливает сам владелец — по позиции, как после перемотки
+        m_cursor.setTrackMask(*m_schedule, *m_notes, index, autoplay, [](quint32, int, int) {});
+        ++m_generation;
+        m_guiEpoch.fetch_add(1, std::memory_order_release);
+    }
+    m_wake.notify_all();
+}
+
+bool SequencerThread::isRunning() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_running;
+}
+
+qint64 SequencerThread::positionMs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const double us = m_running ? songUsAt(Clock::now()) : m_anchorSongUs;
+    return qBound<qint64>(0, qint64(us / 1000.0), m_durationMs);
+}
+
+PlaybackClock SequencerThread::clock() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PlaybackClock c;
+    c.anchorSongUs = m_anchorSongUs;
+    c.anchorWallNs = duration_cast<nanoseconds>(m_anchorWall.time_since_epoch()).count();
+    c.speed = m_speed;
+    c.running = m_running;
+    c.durationMs = m_durationMs;
+    return c;
+}
+
+SequencerThread::TimingStats SequencerThread::timingStats() const
+{
+    TimingStats stats;
+    stats.dispatched    = m_statDispatched.load(std::memory_order_relaxed);
+    stats.maxLatenessUs = m_statMaxLatenessUs.load(std::memory_order_relaxed);
+    stats.lateCount     = m_statLate.load(std::memory_order_relaxed);
+    if (stats.dispatched > 0)
+        stats.meanLatenessUs = double(m_statLatenessSumUs.load(std::memory_order_relaxed))
+                           / double(stats.dispatched);
+    return stats;
+}
+
+void SequencerThread::resetTimingStats()
+{
+    m_statDispatched.store(0, std::memory_order_relaxed);
+    m_statLatenessSumUs.store(0, std::memory_order_relaxed);
+    m_statMaxLatenessUs.store(0, std::memory_order_relaxed);
+    m_statLate.store(0, std::memory_order_relaxed);
+}
+
+double SequencerThread::songUsAt(Clock::time_point t) const
+{
+    const double wallUs = double(duration_cast<microseconds>(t - m_anchorWall).count());
+    return m_anchorSongUs + wallUs * m_speed;
+}
+
+SequencerThread::Clock::time_point SequencerThread::wallTimeOf(double songUs) const
+{
+    const double wallUs = std::ceil((songUs - m_anchorSongUs) / m_speed);
+    return m_anchorWall + microseconds(qint64(wallUs));
+}
+
+qint64 SequencerThread::eventStampNs(quint32 timeMs) const
+{
+    return duration_cast<nanoseconds>(wallTimeOf(double(timeMs) * 1000.0).time_since_epoch()).count();
+}
+
+void SequencerThread::reanchor(double songUs)
+{
+    m_anchorSongUs = songUs;
+    m_anchorWall = Clock::now();
+}
+
+void SequencerThread::chaseControllers()
+{
+    PIANO_TRACE_ZONE("SequencerThread::chaseControllers");
+    m_chasePending = false;
+    // Сброс выбросит в синтезаторе всё отправленное до него — несобранное
+    // тем более не нужно
+    m_outgoing.audio.clear();
+    m_outgoing.audioReset = true;
+
+    // Сброс каждого канала и явные значения того, что сбросом не задаётся
+    // или отличается от умолчаний. Метка 0 — применить сразу.
+    const ControllerState state = m_song ? m_song->controllersAt(m_chaseMs) : ControllerState();
+    for (int ch = 0; ch < 16; ++ch) {
+        const ChannelState &c = state.channels[ch];
+        std::vector<MidiEvent> &audio = m_outgoing.audio;
+        audio.push_back(MidiEvent::control(0, ControlEvent::ResetAll, 0, ch));
+        audio.push_back(MidiEvent::control(0, ControlEvent::Volume, c.volume, ch));
+        audio.push_back(MidiEvent::program(0, c.program, ch));
+        if (c.expression != 127)
+            audio.push_back(MidiEvent::control(0, ControlEvent::Expression, c.expression, ch));
+        if (c.sustain != 0)
+            audio.push_back(MidiEvent::control(0, ControlEvent::Sustain, c.sustain, ch));
+    }
+}
+
+void SequencerThread::dispatchAudio(quint32 nowMs)
+{
+    PIANO_TRACE_ZONE("SequencerThread::dispatchAudio");
+    std::vector<MidiEvent> &audio = m_outgoing.audio;
+    auto noteOn = [this, &audio](quint32 timeMs, int pitch, int velocity, int channel) {
+        audio.push_back(MidiEvent::noteOn(eventStampNs(timeMs), pitch, velocity, channel));
+    };
+    auto noteOff = [this, &audio](quint32 timeMs, int pitch, int channel) {
+        audio.push_back(MidiEvent::noteOff(eventStampNs(timeMs), pitch, channel));
+    };
+
+    // Синтезатор разбирает кольцо по порядку, поэтому контроллеры вливаются
+    // между нотами по времени; при равном времени контроллер идёт первым
+    // (педаль, нажатая вместе с нотой, её уже держит)
+    const ControlEventList &controls = *m_controls;
+    for (; m_audioControlPos < int(controls.size()); ++m_audioControlPos) {
+        const ControlEvent &cc = controls[m_audioControlPos];
+        if (cc.timeMs > nowMs)
+            break;
+        if (cc.timeMs > 0)
+            m_audioCursor.advance(*m_schedule, *m_notes, cc.timeMs - 1, noteOn, noteOff);
+        const qint64 stampNs = eventStampNs(cc.timeMs);
+        audio.push_back(cc.controller == ControlEvent::Program
+                            ? MidiEvent::program(stampNs, cc.value, cc.channel)
+                            : MidiEvent::control(stampNs, cc.controller, cc.value, cc.channel));
+    }
+    m_audioCursor.advance(*m_schedule, *m_notes, nowMs, noteOn, noteOff);
+}
+
+void SequencerThread::deliver(std::unique_lock<std::mutex> &lock)
+{
+    // Обмен, а не копия: GUI может дописывать в m_outgoing, пока мы раздаём
+    std::swap(m_outgoing, m_delivering);
+    lock.unlock();
+
+    PIANO_TRACE_ZONE("SequencerThread::deliver");
+    Outgoing &out = m_delivering;
+    if (out.audioReset && m_callbacks.audioReset)
+        m_callbacks.audioReset();
+    if (m_callbacks.audioEvent) {
+        for (const MidiEvent &event : out.audio)
+            m_callbacks.audioEvent(event);
+    }
+    if (m_callbacks.guiEvent) {
+        for (const MidiEvent &event : out.gui)
+            m_callbacks.guiEvent(event, out.guiEpoch);
+    }
+    out.clear();
+
+    lock.lock();
+}
+
+void SequencerThread::recordDispatch(qint64 latenessUs)
+{
+    // Пишет только поток секвенсора — хватает relaxed load/store
+    m_statDispatched.fetch_add(1, std::memory_order_relaxed);
+    m_statLatenessSumUs.fetch_add(latenessUs, std::memory_order_relaxed);
+    if (latenessUs > m_statMaxLatenessUs.load(std::memory_order_relaxed))
+        m_statMaxLatenessUs.store(latenessUs, std::memory_order_relaxed);
+    if (latenessUs > 1000)
+        m_statLate.fetch_add(1, std::memory_order_relaxed);
+
+    Metrics::add(Metrics::SequencerTicks);
+    Metrics::record(Metrics::SequencerLatenessUs, latenessUs);
+}
+
+void SequencerThread::run()
+{
+#ifdef Q_OS_WIN
+    // Иначе wait_until на Windows округляется до кванта 15.6 ms
+    timeBeginPeriod(1);
+#endif
+
+    Trace::setThreadName("sequencer");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_quit) {
+        if (m_chasePending)
+            chaseControllers();
+        if (!m_outgoing.isEmpty()) {
+            // Пока мьютекс был отпущен, могла прийти команда — после
+            // раздачи всё пересчитываем заново
+            deliver(lock);
+            continue;
+        }
+        if (!m_running || !m_schedule || !m_notes) {
+            m_wake.wait(lock);
+            continue;
+        }
+
+        const quint64 generation = m_generation;
+        const microseconds lookahead(m_audioLookaheadUs);
+
+        // Ближайшая цель: следующее GUI-событие, следующее аудио-событие
+        // минус упреждение или, когда оба курсора дошли до конца, конец песни
+        const int count = m_schedule->size();
+        const int guiPos = m_cursor.position();
+        const int audioPos = m_audioCursor.position();
+        const bool finishing = guiPos >= count && audioPos >= count;
+
+        Clock::time_point guiTarget = Clock::time_point::max();
+        Clock::time_point audioTarget = Clock::time_point::max();
+        quint32 audioNextMs = 0;
+        if (guiPos < count)
+            guiTarget = wallTimeOf(double(m_schedule->at(guiPos).timeMs) * 1000.0);
+        if (audioPos < count) {
+            // Ближайшее из ноты и контроллера; контроллеры после последней ноты не ждём
+            audioNextMs = m_schedule->at(audioPos).timeMs;
+            if (m_audioControlPos < int(m_controls->size()))
+                audioNextMs = qMin(audioNextMs, (*m_controls)[m_audioControlPos].timeMs);
+            audioTarget = wallTimeOf(double(audioNextMs) * 1000.0) - lookahead;
+        }
+        const Clock::time_point target = finishing
+            ? wallTimeOf(double(m_durationMs) * 1000.0)
+            : std::min(guiTarget, audioTarget);
+
+        // Цель уже в прошлом (старт, перемотка, упреждение аудио) — это
+        // догоняющая раздача, а не джиттер; в статистику её не пишем
+        const Clock::time_point before = Clock::now();
+        const bool scheduled = before < target;
+
+        if (before < target - microseconds(SpinWindowUs)) {
+            // Просыпаемся либо заранее перед целью, либо по команде
+            m_wake.wait_until(lock, target - microseconds(SpinWindowUs));
+            continue;
+        }
+
+        // Досыпаем остаток без блокировки, чтобы не держать GUI
+        lock.unlock();
+        while (Clock::now() < target)
+            std::this_thread::yield();
+        lock.lock();
+
+        if (m_quit)
+            break;
+        if (generation != m_generation)
+            continue;   // за время ожидания пришла команда — пересчитать
+
+        PIANO_TRACE_ZONE("SequencerThread::tick");
+        const Clock::time_point now = Clock::now();
+        if (scheduled)
+            recordDispatch(duration_cast<microseconds>(now - target).count());
+
+        if (finishing) {
+            reanchor(double(m_durationMs) * 1000.0);
+            m_running = false;
+            ++m_generation;
+            if (m_callbacks.finished) {
+                lock.unlock();
+                m_callbacks.finished();
+                lock.lock();
+            }
+            continue;
+        }
+
+        // Всё, что уже наступило к этому моменту, отдаём одной пачкой.
+        // qMax защищает от округления: курсор, ради которого проснулись,
+        // обязан сдвинуться хотя бы на своё событие.
+        quint32 guiNowMs = quint32(songUsAt(now) / 1000.0);
+        if (now >= guiTarget)
+            guiNowMs = qMax(guiNowMs, m_schedule->at(guiPos).timeMs);
+        quint32 audioNowMs = quint32(songUsAt(now + lookahead) / 1000.0);
+        if (now >= audioTarget)
+            audioNowMs = qMax(audioNowMs, audioNextMs);
+
+        dispatchAudio(audioNowMs);
+        // Раздача — на следующем круге, уже без мьютекса
+        PIANO_TRACE_ZONE("SequencerThread::dispatchGui");
+        std::vector<MidiEvent> &gui = m_outgoing.gui;
+        m_outgoing.guiEpoch = m_guiEpoch.load(std::memory_order_relaxed);
+        m_cursor.advance(*m_schedule, *m_notes, guiNowMs,
+                         [this, &gui](quint32 timeMs, int pitch, int velocity, int channel) {
+                             gui.push_back(MidiEvent::noteOn(eventStampNs(timeMs), pitch, velocity, channel));
+                         },
+                         [this, &gui](quint32 timeMs, int pitch, int channel) {
+                             gui.push_back(MidiEvent::noteOff(eventStampNs(timeMs), pitch, channel));
+                         });
+    }
+
+#ifdef Q_OS_WIN
+    timeEndPeriod(1);
+#endif
+}
@@ -0,0 +1,169 @@
+// SequencerThread.h
+#ifndef SEQUENCERTHREAD_H
+#define SEQUENCERTHREAD_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MidiEvent.h"
+#include "PlaybackClock.h"
+#include "Song.h"
+
+// Отдельный поток секвенсора. Позиция песни всегда вычисляется из
+// std::chrono::steady_clock: якорь (время песни, момент стены) плюс
+// прошедшее реальное время, умноженное на скорость. Поэтому занятый
+// GUI-поток не вызывает дрейфа — он лишь реже спрашивает позицию.
+//
+// Поток спит на condition_variable почти до момента следующего события,
+// последние SpinWindowUs досыпает активным ожиданием: это даёт
+// субмиллисекундный джиттер без таймера высокого разрешения.
+//
+// Событий два потока, у каждого свой курсор: аудио получает их заранее
+// (на audioLookahead, чтобы синтезатор поставил ноту на точный отсчёт
+// внутри блока), GUI — ровно в момент события. Каждое событие несёт
+// плановое время steady_clock, а не время фактической раздачи.
+//
+// Каждый курсор видит только свои дорожки: аудио — звучащие, GUI —
+// играемые автоматически (остальные играет ученик). Смена маски на ходу
+// не трогает позицию: аудио получает note-off для нот выключенных дорожек.
+//
+// Контроллеры (педаль, громкость, программы) идут только в аудио, вперемешку
+// с нотами по времени. После перемотки и смены песни поток сам сбрасывает
+// аудио (audioReset) и досылает состояние контроллеров на новую позицию,
+// взятое из контрольных точек песни (SeekIndex).
+//
+// События собираются под мьютексом, а колбэки зовутся уже без него —
+// команды из GUI не ждут, пока слушатели разберут пачку. Все колбэки
+// зовёт только поток секвенсора и в порядке сбора: note-off от смены
+// маски тоже уходят через него, а audioReset — перед контроллерами,
+// досланными следом.
+class SequencerThread {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct TimingStats {
+        qint64 dispatched     = 0;   // обработано пробуждений с событиями
+        double meanLatenessUs = 0.0; // среднее опоздание пробуждения (факт - план >= 0)
+        qint64 maxLatenessUs = 0;   // худшее опоздание
+        qint64 lateCount     = 0;   // опозданий больше 1 ms
+    };
+
+    // Вызываются только из потока секвенсора, без его мьютекса, и должны
+    // быть неблокирующими (обычно — push в SpscRing)
+    struct Callbacks {
+        std::function<void(const MidiEvent &)> audioEvent;
+        // epoch — guiEpoch() того состояния курсора, из которого взято событие
+        std::function<void(const MidiEvent &, quint32 epoch)> guiEvent;
+        // Заглушить аудио и выбросить уже отправленные ему события.
+        // Зовётся из потока секвенсора, поэтому всё, что он пришлёт
+        // следом, гарантированно не будет выброшено.
+        std::function<void()> audioReset;
+        std::function<void()> finished;   // песня доиграна до конца
+    };
+
+    explicit SequencerThread(Callbacks callbacks);
+    ~SequencerThread();
+
+    // Поток держит свою ссылку на песню: заменённая освобождается,
+    // только когда он на неё больше не смотрит. nullptr — без песни.
+    void setSong(SongPtr song);
+    // Та же песня, но полнее (дочитан хвост): позиция и ход часов сохраняются,
+    // аудио-курсор продолжает с уже отправленного упреждения
+    void replaceSong(SongPtr song);
+
+    void start();
+    void pause();
+    void seek(qint64 positionMs);
+    void setSpeed(double speed);
+    // Упреждение для аудио-событий; обычно — длительность буфера вывода
+    void setAudioLookaheadUs(qint64 us);
+    // Маски дорожек (NoteStore::TrackMask) для аудио и для GUI;
+    // сохраняются при смене песни
+    void setTrackMasks(quint64 audible, quint64 autoplay);
+
+    bool isRunning() const;
+    qint64 positionMs() const;
+    // Меняется командами, после которых владелец восстанавливает клавиши
+    // по позиции (смена песни, пауза, перемотка, маски): GUI-события
+    // прежней эпохи, ещё лежащие в его кольце, устарели. Событие новой
+    // эпохи может прийти раньше, чем команда вернёт управление, поэтому
+    // кольцо не чистится, а фильтруется по эпохе при разборе.
+    quint32 guiEpoch() const { return m_guiEpoch.load(std::memory_order_acquire); }
+    PlaybackClock clock() const;   // меняется только командами управления
+    TimingStats timingStats() const;
+    void resetTimingStats();
+
+private:
+    static constexpr qint64 SpinWindowUs = 500;
+
+    void run();
+    double songUsAt(Clock::time_point t) const;          // под m_mutex
+    Clock::time_point wallTimeOf(double songUs) const;    // под m_mutex
+    qint64 eventStampNs(quint32 timeMs) const;             // под m_mutex
+    void reanchor(double songUs);                          // под m_mutex
+    void adoptSong(SongPtr &song);                         // под m_mutex
+    void chaseControllers();                               // под m_mutex
+    void dispatchAudio(quint32 nowMs);                     // под m_mutex
+    // Отдать собранное слушателям; зовётся с захваченным lock, отпускает
+    // его на время колбэков
+    void deliver(std::unique_lock<std::mutex> &lock);
+    void recordDispatch(qint64 latenessUs);
+
+    // Собранные для колбэков события одной пачки
+    struct Outgoing {
+        bool audioReset = false;          // до audio
+        std::vector<MidiEvent> audio;
+        std::vector<MidiEvent> gui;
+        quint32 guiEpoch = 0;
+
+        bool isEmpty() const { return !audioReset && audio.empty() && gui.empty(); }
+        void clear()
+        {
+            audioReset = false;
+            audio.clear();
+            gui.clear();
+        }
+    };
+
+    Callbacks m_callbacks;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+
+    SongPtr m_song;
+    const NoteStore *m_notes = nullptr;               // m_song->notes()
+    const NoteEventSchedule *m_schedule = nullptr;    // m_song->schedule()
+    const ControlEventList *m_controls = nullptr;     // m_song->controls()
+    NoteEventCursor m_cursor;        // GUI: события в момент наступления
+    NoteEventCursor m_audioCursor;   // аудио: с упреждением m_audioLookaheadUs
+    int m_audioControlPos = 0;       // следующий контроллер для аудио
+    bool m_chasePending = false;     // дослать аудио контроллеры на m_chaseMs
+    quint32 m_chaseMs = 0;
+    qint64 m_audioLookaheadUs = 0;
+    qint64 m_durationMs = 0;
+
+    bool m_quit = false;
+    bool m_running = false;
+    quint64 m_generation = 0;      // меняется при каждой команде управления
+    std::atomic<quint32> m_guiEpoch{0};   // пишется под m_mutex
+
+    Outgoing m_outgoing;     // под m_mutex
+    Outgoing m_delivering;   // только поток секвенсора; буферы меняются местами
+
+    Clock::time_point m_anchorWall;
+    double m_anchorSongUs = 0.0;
+    double m_speed = 1.0;
+
+    std::atomic<qint64> m_statDispatched{0};
+    std::atomic<qint64> m_statLatenessSumUs{0};
+    std::atomic<qint64> m_statMaxLatenessUs{0};
+    std::atomic<qint64> m_statLate{0};
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "SmfReader.h"
+
+namespace {
+
+quint32 readBE32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+quint16 readBE16(const uchar *p)
+{
+    return quint16((p[0] << 8) | p[1]);
+}
+
+bool chunkIs(const uchar *p, const char *id)
+{
+    return p[0] == uchar(id[0]) && p[1] == uchar(id[1])
+        && p[2] == uchar(id[2]) && p[3] == uchar(id[3]);
+}
+
+// Количество байт данных у channel/system сообщения по статусу
+int dataLength(quint8 status)
+{
+    switch (status & 0xF0) {
+    case 0xC0:
+    case 0xD0:
+        return 1;
+    case 0xF0:
+        if (status == 0xF2) return 2;
+        if (status == 0xF1 || status == 0xF3) return 1;
+        return 0;
+    default:
+        return 2;
+    }
+}
+
+} // namespace
+
+bool readSmfLayout(const uchar *data, qint64 size,
+                   SmfHeader &header, QVector<SmfTrackSpan> &tracks,
+                   QString *error)
+{
+    tracks.clear();
+
+    if (!data || size < 14 || !chunkIs(data, "MThd")) {
+        if (error) *error = "not a Standard MIDI File";
+        return false;
+    }
+
+    const quint32 headerLen = readBE32(data + 4);
+    if (headerLen < 6 || qint64(8) + headerLen > size) {
+        if (error) *error = "broken MThd chunk";
+        return false;
+    }
+
+    header.format     = readBE16(data + 8);
+    header.trackCount = readBE16(data + 10);
+    header.division   = qint16(readBE16(data + 12));
+
+    if (header.division == 0) {
+        if (error) *error = "zero time division";
+        return false;
+    }
+
+    const uchar *pos = data + 8 + headerLen;
+    const uchar *end = data + size;
+    tracks.reserve(header.trackCount);
+
+    // Неизвестные чанки пропускаем; обрезанную последнюю дорожку
+    // оставляем как есть — плееры обычно так же снисходительны.
+    while (end - pos >= 8) {
+        const quint32 len = readBE32(pos + 4);
+        const uchar *body = pos + 8;
+        const uchar *bodyEnd = (quint64(end - body) < len) ? end : body + len;
+
+        if (chunkIs(pos, "MTrk")) {
+            SmfTrackSpan span;
+            span.begin = body;
+            span.end   = bodyEnd;
+            tracks.push_back(span);
+        }
+        pos = bodyEnd;
+    }
+
+    if (tracks.isEmpty()) {
+        if (error) *error = "no MTrk chunks";
+        return false;
+    }
+    return true;
+}
+
+SmfTrackCursor::SmfTrackCursor(const SmfTrackSpan &span)
+    : m_pos(span.begin),
+      m_end(span.end),
+      m_atEnd(false)
+{
+    readDelta();
+}
+
+bool SmfTrackCursor::readVarLen(quint32 &value)
+{
+    value = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (m_pos >= m_end)
+            return false;
+        const uchar b = *m_pos++;
+        value = (value << 7) | (b & 0x7F);
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;   // VLQ длиннее 4 байт
+}
+
+void SmfTrackCursor::readDelta()
+{
+    if (m_pos >= m_end) {
+        m_atEnd = true;
+        return;
+    }
+    quint32 delta = 0;
+    if (!readVarLen(delta)) {
+        m_error = true;
+        m_atEnd = true;
+        return;
+    }
+    m_tick += delta;
+}
+
+bool SmfTrackCursor::next(SmfEvent &ev)
+{
+    if (m_atEnd)
+        return false;
+
+    if (m_pos >= m_end) {
+        m_error = true;
+        m_atEnd = true;
+        return false;
+    }
+
+    ev.tick = m_tick;
+    ev.payload = nullptr;
+    ev.length = 0;
+    ev.metaType = 0;
+    ev.data1 = ev.data2 = 0;
+
+    quint8 status = *m_pos;
+    if (status & 0x80) {
+        ++m_pos;
+    } else {
+        // running status: байт уже относится к данным
+        if (!m_runningStatus) {
+            m_error = true;
+            m_atEnd = true;
+            return false;
+        }
+        status = m_runningStatus;
+    }
+    ev.status = status;
+
+    if (status == 0xFF) {
+        // meta: type, length, payload. Running status не сбрасываем —
+        // так читаются и файлы, нарушающие это правило спецификации.
+        if (m_pos >= m_end) {
+            m_error = true;
+            m_atEnd = true;
+            return false;
+        }
+        ev.metaType = *m_pos++;
+
+        quint32 len = 0;
+        if (!readVarLen(len) || quint32(m_end - m_pos) < len) {
+            m_error = true;
+            m_atEnd = true;
+            return false;
+        }
+        ev.payload = m_pos;
+        ev.length  = len;
+        m_pos += len;
+        if (ev.metaType == 0x2F) {   // End of Track
+            m_atEnd = true;
+            return true;
+        }
+    } else if (status == 0xF0 || status == 0xF7) {
+        quint32 len = 0;
+        if (!readVarLen(len) || quint32(m_end - m_pos) < len) {
+            m_error = true;
+            m_atEnd = true;
+            return false;
+        }
+        ev.payload = m_pos;
+        ev.length  = len;
+        m_pos += len;
+    } else {
+        const int n = dataLength(status);
+        if (m_end - m_pos < n) {
+            m_error = true;
+            m_atEnd = true;
+            return false;
+        }
+        if (n > 0) ev.data1 = m_pos[0] & 0x7F;
+        if (n > 1) ev.data2 = m_pos[1] & 0x7F;
+        m_pos += n;
+        if (status < 0xF0)
+            m_runningStatus = status;
+    }
+
+    readDelta();
+    return true;
+}
@@ -0,0 +1,72 @@
+// SmfReader.h
+#ifndef SMFREADER_H
+#define SMFREADER_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+// Низкоуровневое чтение Standard MIDI File прямо из памяти (обычно из mmap).
+// Ничего не аллоцирует на событие: курсор дорожки декодирует VLQ и running
+// status на месте и отдаёт событие по значению.
+
+struct SmfHeader {
+    quint16 format     = 0;
+    quint16 trackCount = 0;
+    qint16  division   = 0;   // > 0: тики на четвертную; < 0: SMPTE
+};
+
+struct SmfTrackSpan {
+    const uchar *begin = nullptr;
+    const uchar *end   = nullptr;
+};
+
+struct SmfEvent {
+    quint32 tick   = 0;        // абсолютный тик
+    quint8  status = 0;        // 0x80..0xEF, 0xF0/0xF7 (sysex), 0xFF (meta)
+    quint8  data1  = 0;
+    quint8  data2  = 0;
+    quint8  metaType = 0;      // только для 0xFF
+    const uchar *payload = nullptr;  // данные meta/sysex
+    quint32 length = 0;
+
+    bool isMeta() const { return status == 0xFF; }
+    int  channel() const { return status & 0x0F; }
+    int  kind() const { return status & 0xF0; }
+};
+
+// Разбирает заголовок MThd и находит все чанки MTrk.
+bool readSmfLayout(const uchar *data, qint64 size,
+                   SmfHeader &header, QVector<SmfTrackSpan> &tracks,
+                   QString *error);
+
+class SmfTrackCursor {
+public:
+    SmfTrackCursor() = default;
+    explicit SmfTrackCursor(const SmfTrackSpan &span);
+
+    bool atEnd() const { return m_atEnd; }
+    bool hasError() const { return m_error; }
+
+    // Сколько байт дорожки ещё не прочитано — для прогресса разбора
+    qint64 bytesLeft() const { return m_end - m_pos; }
+
+    // Абсолютный тик следующего события (валиден, пока !atEnd()).
+    quint32 tick() const { return m_tick; }
+
+    // Декодирует текущее событие и читает delta-time следующего.
+    bool next(SmfEvent &ev);
+
+private:
+    bool readVarLen(quint32 &value);
+    void readDelta();
+
+    const uchar *m_pos = nullptr;
+    const uchar *m_end = nullptr;
+    quint32 m_tick = 0;
+    quint8  m_runningStatus = 0;
+    bool m_atEnd = true;
+    bool m_error = false;
+};
+
+#endif
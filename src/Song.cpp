@@ -0,0 +1,48 @@
+#include "Song.h"
+#include "Trace.h"
+#include <QFileInfo>
+
+SongPtr Song::create(const QString &filePath, NoteStore &&notes, const TempoMap &tempoMap,
+                     ControlEventList controls, qint64 durationMs, QVector<Track> tracks,
+                     int format, const MidiParseStats &stats, bool complete)
+{
+    PIANO_TRACE_ZONE("Song::create");
+    // Конструктор закрыт: make_shared до него не дотянется
+    std::shared_ptr<Song> song(new Song());
+    song->m_filePath = filePath;
+    song->m_notes = std::move(notes);
+    song->m_schedule.build(song->m_notes);
+    song->m_tempoMap = tempoMap;
+    song->m_controls = std::move(controls);
+    song->m_seekIndex.build(song->m_notes, song->m_schedule, song->m_controls);
+    song->m_durationMs = durationMs;
+    song->m_density.build(song->m_notes, durationMs);
+    song->m_trackViews.build(song->m_notes);
+    song->m_tracks = std::move(tracks);
+    // Дорожки-каналы формата 0 и дорожки сверх имён MTrk — безымянные
+    const int trackCount = NoteStore::MaxTracks - int(qCountLeadingZeroBits(song->m_notes.presentTracks()));
+    if (song->m_tracks.size() < trackCount)
+        song->m_tracks.resize(trackCount);
+    for (int t = 0; t < song->m_tracks.size(); ++t)
+        song->m_tracks[t].noteCount = 0;
+    const quint8 *noteTracks = song->m_notes.tracks();
+    for (int i = 0; i < song->m_notes.size(); ++i)
+        ++song->m_tracks[noteTracks[i]].noteCount;
+    song->m_format = format;
+    song->m_stats = stats;
+    song->m_complete = complete;
+    return song;
+}
+
+const SongPtr &Song::empty()
+{
+    static const SongPtr song(new Song());
+    return song;
+}
+
+QString Song::title() const
+{
+    if (!m_tracks.isEmpty() && !m_tracks.first().name.isEmpty())
+        return m_tracks.first().name;
+    return QFileInfo(m_filePath).completeBaseName();
+}
@@ -0,0 +1,90 @@
+// Song.h
+#ifndef SONG_H
+#define SONG_H
+
+#include <QString>
+#include <QVector>
+#include <memory>
+#include "ControllerState.h"
+#include "DensityPyramid.h"
+#include "MidiParser.h"
+#include "NoteEventSchedule.h"
+#include "NoteStore.h"
+#include "SeekIndex.h"
+#include "TempoMap.h"
+#include "TrackViews.h"
+
+class Song;
+using SongPtr = std::shared_ptr<const Song>;
+
+// Неизменяемая загруженная песня: ноты, расписание событий, контроллеры,
+// точки перемотки, карта плотности, ноты по дорожкам, карта темпа,
+// дорожки и сведения о файле. Создаётся один раз (парсером или из кэша) и дальше только
+// читается: плеер, секвенсор, ролл и анализ держат один и тот же объект
+// по SongPtr, а не свои копии нот.
+//
+// Замена песни — подмена указателя. Кто успел взять SongPtr, дорабатывает
+// со старой песней целиком; наполовину загруженной песни не видит никто.
+class Song {
+public:
+    // Номер дорожки — NoteStore::track(): MTrk, а в формате 0 — канал
+    struct Track {
+        QString name;       // meta 0x03; пусто, если не задано
+        int noteCount = 0;
+    };
+
+    // Забирает ноты без копирования и строит расписание событий, точки
+    // перемотки, карту плотности и ноты по дорожкам. complete = false — только начало песни (см. SongLoader).
+    static SongPtr create(const QString &filePath, NoteStore &&notes, const TempoMap &tempoMap,
+                          ControlEventList controls, qint64 durationMs, QVector<Track> tracks, int format,
+                          const MidiParseStats &stats, bool complete);
+    // Общая пустая песня: вместо nullptr, чтобы читателям не проверять
+    static const SongPtr &empty();
+
+    Song(const Song &) = delete;
+    Song &operator=(const Song &) = delete;
+
+    const QString &filePath() const { return m_filePath; }
+    QString title() const;   // имя первой дорожки или имя файла
+
+    const NoteStore &notes() const { return m_notes; }
+    const NoteEventSchedule &schedule() const { return m_schedule; }
+    const TempoMap &tempoMap() const { return m_tempoMap; }
+    const ControlEventList &controls() const { return m_controls; }
+    const SeekIndex &seekIndex() const { return m_seekIndex; }
+    const DensityPyramid &density() const { return m_density; }
+    const TrackViews &trackViews() const { return m_trackViews; }
+    // Громкость, педаль и программы каналов в момент positionMs
+    ControllerState controllersAt(quint32 positionMs) const
+    {
+        return m_seekIndex.controllersAt(m_controls, positionMs);
+    }
+    qint64 durationMs() const { return m_durationMs; }
+
+    int format() const { return m_format; }
+    // По номеру дорожки; включает и дорожки без нот
+    const QVector<Track> &tracks() const { return m_tracks; }
+    const MidiParseStats &parseStats() const { return m_stats; }
+
+    bool isEmpty() const { return m_notes.isEmpty(); }
+    bool isComplete() const { return m_complete; }
+
+private:
+    Song() = default;
+
+    QString m_filePath;
+    NoteStore m_notes;
+    NoteEventSchedule m_schedule;
+    TempoMap m_tempoMap;
+    ControlEventList m_controls;
+    SeekIndex m_seekIndex;
+    DensityPyramid m_density;
+    TrackViews m_trackViews;
+    qint64 m_durationMs = 0;
+    QVector<Track> m_tracks;
+    int m_format = 0;
+    MidiParseStats m_stats;
+    bool m_complete = true;
+};
+
+#endif
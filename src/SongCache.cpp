@@ -0,0 +1,427 @@
+#include "SongCache.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace {
+
+constexpr quint32 kMagic = 0x47534E50;       // "PNSG"
+constexpr quint32 kByteOrder = 0x01020304;   // кэш не переносим между архитектурами
+constexpr qint64 kAlign = 64;
+constexpr int kHashBytes = 20;               // SHA-1
+
+enum Section {
+    StartMs, EndMs, Pitch, Velocity, Channel, Track,
+    PitchOffsets, PitchIndex, ChannelOffsets, ChannelIndex,
+    IntervalTree, TempoSegments, Controls, TrackNames,
+    SectionCount
+};
+
+struct SectionEntry {
+    quint64 offset;
+    quint64 bytes;
+};
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    quint32 byteOrder;
+    quint32 headerSize;
+    quint8  sourceHash[kHashBytes];
+    qint64  durationMs;
+    quint64 presentTracks;   // NoteStore::TrackMask
+    qint32  noteCount;
+    qint32  ppq;
+    qint32  smpte;
+    qint32  tempoSegments;
+    qint32  intervalLeafBase;
+    quint32 maxDuration;
+    quint32 lastEnd;
+    quint32 segmentSize;     // sizeof(TempoMap::Segment)
+    qint32  format;
+    qint32  trackCount;
+    quint32 trackNamesBytes; // UTF-8, у каждого имени префикс длины quint32
+    qint32  controlCount;
+    SectionEntry sections[SectionCount];
+};
+
+static_assert(std::is_trivially_copyable<Header>::value, "Header is written as raw bytes");
+static_assert(std::is_trivially_copyable<TempoMap::Segment>::value, "Segments are written as raw bytes");
+static_assert(std::is_trivially_copyable<ControlEvent>::value && sizeof(ControlEvent) == 8,
+              "Control events are written as raw bytes");
+
+// Держит отображение, пока его колонками пользуется хоть один NoteStore
+struct MappedCache {
+    QFile file;
+    uchar *data = nullptr;
+
+    ~MappedCache()
+    {
+        if (data)
+            file.unmap(data);
+    }
+};
+
+qint64 alignUp(qint64 v)
+{
+    return (v + kAlign - 1) & ~(kAlign - 1);
+}
+
+// Ожидаемый размер каждой секции по счётчикам из заголовка
+quint64 expectedBytes(const Header &h, int section)
+{
+    const quint64 n = quint64(h.noteCount);
+    switch (section) {
+    case StartMs: case EndMs:
+    case PitchIndex: case ChannelIndex:
+        return n * sizeof(quint32);
+    case Pitch: case Velocity: case Channel: case Track:
+        return n;
+    case PitchOffsets:
+        return 129 * sizeof(quint32);
+    case ChannelOffsets:
+        return 17 * sizeof(quint32);
+    case IntervalTree:
+        return quint64(2 * h.intervalLeafBase) * sizeof(quint32);
+    case TempoSegments:
+        return quint64(h.tempoSegments) * sizeof(TempoMap::Segment);
+    case Controls:
+        return quint64(h.controlCount) * sizeof(ControlEvent);
+    case TrackNames:
+        return h.trackNamesBytes;
+    }
+    return 0;
+}
+
+QByteArray packTrackNames(const QVector<QString> &names)
+{
+    QByteArray blob;
+    for (const QString &name : names) {
+        const QByteArray utf8 = name.toUtf8();
+        const quint32 length = quint32(utf8.size());
+        blob.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        blob.append(utf8);
+    }
+    return blob;
+}
+
+bool unpackTrackNames(const uchar *blob, quint32 bytes, int count, QVector<QString> &names)
+{
+    QVector<QString> out;
+    out.reserve(count);
+    quint32 pos = 0;
+    for (int i = 0; i < count; ++i) {
+        quint32 length = 0;
+        if (bytes - pos < sizeof(length))
+            return false;
+        std::memcpy(&length, blob + pos, sizeof(length));
+        pos += sizeof(length);
+        if (bytes - pos < length)
+            return false;
+        out.append(QString::fromUtf8(reinterpret_cast<const char *>(blob + pos), length));
+        pos += length;
+    }
+    names = std::move(out);
+    return true;
+}
+
+// Колонки нот: старт не убывает, конец не раньше старта, ключи индексов
+// в своих диапазонах, maxDuration и lastEnd действительно ограничивают ноты,
+// а маска дорожек совпадает с колонкой
+bool validNotes(const NoteStore::Columns &c)
+{
+    quint32 previousStart = 0;
+    NoteStore::TrackMask tracks = 0;
+    for (int i = 0; i < c.count; ++i) {
+        if (c.start[i] < previousStart || c.end[i] < c.start[i]
+            || c.end[i] - c.start[i] > c.maxDuration || c.end[i] > c.lastEnd
+            || c.pitch[i] > 127 || c.channel[i] > 15 || c.track[i] >= NoteStore::MaxTracks)
+            return false;
+        previousStart = c.start[i];
+        tracks |= NoteStore::TrackMask(1) << c.track[i];
+    }
+    return tracks == c.presentTracks;
+}
+
+// Вторичный индекс по ключу: границы не убывают от 0 до count, в корзине
+// ключа k — только ноты с этим ключом, по возрастанию номера
+bool validKeyIndex(const quint32 *offsets, const quint32 *index, const quint8 *keys,
+                   int keyCount, int count)
+{
+    if (offsets[0] != 0 || offsets[keyCount] != quint32(count))
+        return false;
+    for (int k = 0; k < keyCount; ++k) {
+        if (offsets[k] > offsets[k + 1])
+            return false;
+        for (quint32 j = offsets[k]; j < offsets[k + 1]; ++j) {
+            if (index[j] >= quint32(count) || keys[index[j]] != k
+                || (j > offsets[k] && index[j] <= index[j - 1]))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Дерево интервалов: степень двойки, покрывает все блоки нот, и в узлах
+// именно те максимумы концов, что построил бы NoteIntervalIndex::build
+bool validIntervalTree(const NoteStore::Columns &c)
+{
+    const int leafBase = c.intervalLeafBase;
+    const int blockCount = (c.count + NoteIntervalIndex::BlockSize - 1) / NoteIntervalIndex::BlockSize;
+    if (leafBase < 1 || (leafBase & (leafBase - 1)) != 0 || leafBase < blockCount)
+        return false;
+    const quint32 *tree = c.intervalTree;
+    for (int b = 0; b < leafBase; ++b) {
+        quint32 maxEnd = 0;
+        const int first = b * NoteIntervalIndex::BlockSize;
+        const int last = std::min(first + NoteIntervalIndex::BlockSize, c.count);
+        for (int i = first; i < last; ++i)
+            maxEnd = std::max(maxEnd, c.end[i]);
+        if (tree[leafBase + b] != maxEnd)
+            return false;
+    }
+    for (int node = leafBase - 1; node >= 1; --node) {
+        if (tree[node] != std::max(tree[2 * node], tree[2 * node + 1]))
+            return false;
+    }
+    return true;
+}
+
+// Отрезки темпа: первый с тика 0, тики растут, время не убывает
+bool validTempo(const TempoMap::Segment *segments, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const TempoMap::Segment &s = segments[i];
+        if (!std::isfinite(s.usPerTick) || s.usPerTick <= 0.0)
+            return false;
+        if (i == 0 ? s.tick != 0 : (s.tick <= segments[i - 1].tick || s.us < segments[i - 1].us))
+            return false;
+    }
+    return true;
+}
+
+bool validControls(const ControlEvent *events, int count)
+{
+    for (int i = 1; i < count; ++i) {
+        if (events[i].timeMs < events[i - 1].timeMs)
+            return false;
+    }
+    return true;
+}
+
+// Старые кэши: сначала всё, что не открывалось дольше MaxAgeDays, затем
+// самые давние, пока каталог не уложится в MaxTotalBytes. Отображённый
+// кем-то файл на POSIX удаляется спокойно, на Windows просто останется.
+void evictStale(const QString &dirPath, const QString &keepPath)
+{
+    QDir dir(dirPath);
+    const QFileInfoList files = dir.entryInfoList(QStringList() << "*.song", QDir::Files, QDir::Time);
+    const QDateTime oldest = QDateTime::currentDateTime().addDays(-SongCache::MaxAgeDays);
+    qint64 total = 0;
+    // QDir::Time — от новых к старым
+    for (const QFileInfo &info : files) {
+        const bool keep = info.absoluteFilePath() == QFileInfo(keepPath).absoluteFilePath();
+        if (!keep && (info.lastModified() < oldest || total + info.size() > SongCache::MaxTotalBytes)) {
+            QFile::remove(info.absoluteFilePath());
+            continue;
+        }
+        total += info.size();
+    }
+}
+
+} // namespace
+
+QByteArray SongCache::contentHash(const uchar *data, qint64 size)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char *>(data), size),
+                                    QCryptographicHash::Sha1);
+}
+
+QString SongCache::cacheFilePath(const QString &sourcePath)
+{
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/songs";
+    const QByteArray key = QCryptographicHash::hash(QFileInfo(sourcePath).absoluteFilePath().toUtf8(),
+                                                    QCryptographicHash::Sha1);
+    return dir + "/" + QString::fromLatin1(key.toHex()) + ".song";
+}
+
+bool SongCache::load(const QString &sourcePath, const QByteArray &sourceHash,
+                     NoteStore &notes, TempoMap &tempoMap, ControlEventList &controls,
+                     QVector<QString> &trackNames, int &format, qint64 &durationMs)
+{
+    auto cache = std::make_shared<MappedCache>();
+    cache->file.setFileName(cacheFilePath(sourcePath));
+    if (!cache->file.open(QIODevice::ReadOnly))
+        return false;   // обычный промах
+
+    const qint64 size = cache->file.size();
+    if (size < qint64(sizeof(Header)))
+        return false;
+    cache->data = cache->file.map(0, size);
+    if (!cache->data)
+        return false;
+
+    Header h;
+    std::memcpy(&h, cache->data, sizeof(Header));
+    if (h.magic != kMagic || h.version != Version || h.byteOrder != kByteOrder
+        || h.headerSize != sizeof(Header) || h.segmentSize != sizeof(TempoMap::Segment))
+        return false;
+    if (sourceHash.size() != kHashBytes || std::memcmp(h.sourceHash, sourceHash.constData(), kHashBytes) != 0)
+        return false;   // исходник изменился
+    if (h.noteCount < 0 || h.tempoSegments < 1 || h.intervalLeafBase < 0 || h.trackCount < 0
+        || h.controlCount < 0)
+        return false;
+
+    for (int i = 0; i < SectionCount; ++i) {
+        const SectionEntry &e = h.sections[i];
+        if (e.offset % kAlign != 0 || e.bytes != expectedBytes(h, i)
+            || e.offset + e.bytes > quint64(size)) {
+            qWarning() << "SongCache: damaged cache file" << cache->file.fileName();
+            return false;
+        }
+    }
+
+    auto at = [&](int section) { return cache->data + h.sections[section].offset; };
+    auto u32 = [&](int section) { return reinterpret_cast<const quint32 *>(at(section)); };
+
+    NoteStore::Columns c;
+    c.count            = h.noteCount;
+    c.start            = u32(StartMs);
+    c.end              = u32(EndMs);
+    c.pitch            = at(Pitch);
+    c.velocity         = at(Velocity);
+    c.channel          = at(Channel);
+    c.track            = at(Track);
+    c.pitchOffsets     = u32(PitchOffsets);
+    c.pitchIndex       = u32(PitchIndex);
+    c.channelOffsets   = u32(ChannelOffsets);
+    c.channelIndex     = u32(ChannelIndex);
+    c.intervalTree     = u32(IntervalTree);
+    c.intervalLeafBase = h.intervalLeafBase;
+    c.maxDuration      = h.maxDuration;
+    c.lastEnd          = h.lastEnd;
+    c.presentTracks    = h.presentTracks;
+
+    // Дальше индексы читаются без проверок, так что файл проверяется
+    // целиком: обрезанный, испорченный или правленный руками кэш — это
+    // промах и повторный разбор, а не чтение за границами
+    const TempoMap::Segment *segments = reinterpret_cast<const TempoMap::Segment *>(at(TempoSegments));
+    const ControlEvent *cc = reinterpret_cast<const ControlEvent *>(at(Controls));
+    if (!validNotes(c)
+        || !validKeyIndex(c.pitchOffsets, c.pitchIndex, c.pitch, 128, c.count)
+        || !validKeyIndex(c.channelOffsets, c.channelIndex, c.channel, 16, c.count)
+        || !validIntervalTree(c) || !validTempo(segments, h.tempoSegments)
+        || !validControls(cc, h.controlCount)
+        || (h.smpte == 0 && h.ppq <= 0)) {
+        qWarning() << "SongCache: damaged cache file" << cache->file.fileName();
+        return false;
+    }
+
+    QVector<QString> names;
+    if (!unpackTrackNames(at(TrackNames), h.trackNamesBytes, h.trackCount, names))
+        return false;
+
+    // Контроллеров немного — копируем, чтобы не держать их отображение отдельно
+    controls.assign(cc, cc + h.controlCount);
+    trackNames = std::move(names);
+    format = h.format;
+    tempoMap.assign(h.ppq, h.smpte != 0, segments, h.tempoSegments);
+    // Время изменения — метка последнего использования для evictStale
+    cache->file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    notes.adopt(c, std::move(cache));
+    durationMs = h.durationMs;
+    return true;
+}
+
+bool SongCache::store(const QString &sourcePath, const QByteArray &sourceHash,
+                      const NoteStore &notes, const TempoMap &tempoMap,
+                      const ControlEventList &controls, const QVector<QString> &trackNames,
+                      int format, qint64 durationMs)
+{
+    if (sourceHash.size() != kHashBytes)
+        return false;
+
+    const QString path = cacheFilePath(sourcePath);
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        qWarning() << "SongCache: cannot create" << QFileInfo(path).absolutePath();
+        return false;
+    }
+
+    const NoteStore::Columns c = notes.columns();
+    std::vector<TempoMap::Segment> segments;
+    segments.reserve(tempoMap.segmentCount());
+    for (int i = 0; i < tempoMap.segmentCount(); ++i)
+        segments.push_back(tempoMap.segment(i));
+
+    Header h;
+    std::memset(&h, 0, sizeof(Header));
+    h.magic            = kMagic;
+    h.version          = Version;
+    h.byteOrder        = kByteOrder;
+    h.headerSize       = sizeof(Header);
+    std::memcpy(h.sourceHash, sourceHash.constData(), kHashBytes);
+    h.durationMs       = durationMs;
+    h.noteCount        = c.count;
+    h.ppq              = tempoMap.ppq();
+    h.smpte            = tempoMap.isSmpte() ? 1 : 0;
+    h.tempoSegments    = int(segments.size());
+    h.intervalLeafBase = c.intervalLeafBase;
+    h.maxDuration      = c.maxDuration;
+    h.lastEnd          = c.lastEnd;
+    h.presentTracks    = c.presentTracks;
+    h.segmentSize      = sizeof(TempoMap::Segment);
+    const QByteArray names = packTrackNames(trackNames);
+    h.format           = format;
+    h.trackCount       = int(trackNames.size());
+    h.trackNamesBytes  = quint32(names.size());
+    h.controlCount     = int(controls.size());
+
+    static const quint32 emptyOffsets[129] = {};
+    const void *sources[SectionCount] = {
+        c.start, c.end, c.pitch, c.velocity, c.channel, c.track,
+        c.pitchOffsets ? c.pitchOffsets : emptyOffsets, c.pitchIndex,
+        c.channelOffsets ? c.channelOffsets : emptyOffsets, c.channelIndex,
+        c.intervalTree, segments.data(), controls.data(), names.constData()
+    };
+
+    qint64 offset = alignUp(sizeof(Header));
+    for (int i = 0; i < SectionCount; ++i) {
+        h.sections[i].offset = quint64(offset);
+        h.sections[i].bytes  = expectedBytes(h, i);
+        offset = alignUp(offset + qint64(h.sections[i].bytes));
+    }
+
+    // QSaveFile подменяет файл атомарно: уже отображённая старая версия
+    // остаётся целой у тех, кто её держит
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "SongCache: cannot write" << path;
+        return false;
+    }
+
+    static const char padding[kAlign] = {};
+    file.write(reinterpret_cast<const char *>(&h), sizeof(Header));
+    qint64 written = sizeof(Header);
+    for (int i = 0; i < SectionCount; ++i) {
+        file.write(padding, qint64(h.sections[i].offset) - written);
+        if (h.sections[i].bytes > 0)
+            file.write(static_cast<const char *>(sources[i]), qint64(h.sections[i].bytes));
+        written = qint64(h.sections[i].offset + h.sections[i].bytes);
+    }
+
+    if (!file.commit()) {
+        qWarning() << "SongCache: cannot write" << path << file.errorString();
+        return false;
+    }
+    evictStale(QFileInfo(path).absolutePath(), path);
+    return true;
+}
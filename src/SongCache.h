@@ -0,0 +1,43 @@
+// SongCache.h
+#ifndef SONGCACHE_H
+#define SONGCACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "ControllerState.h"
+#include "NoteStore.h"
+#include "TempoMap.h"
+
+// Двоичный кэш разобранных песен в QStandardPaths::CacheLocation.
+//
+// Файл кэша — заголовок и таблица секций, за ними колонки нот, вторичные
+// индексы, дерево интервалов, карта темпа, контроллеры и имена дорожек,
+// каждая секция выровнена на 64 байта. Повторное открытие отображает файл в память и отдаёт NoteStore
+// указатели прямо в отображение: ни разбора, ни копирования.
+//
+// Имя файла кэша — хэш пути к исходнику, а в заголовке лежит хэш его
+// содержимого. Изменился исходник — хэш не совпал, кэш перезаписывается.
+// При загрузке файл проверяется целиком (границы и содержимое индексов,
+// дерево интервалов, карта темпа); после записи из каталога удаляются
+// давно не открывавшиеся кэши и самые старые сверх общего лимита.
+class SongCache {
+public:
+    static constexpr quint32 Version = 5;
+    static constexpr qint64 MaxTotalBytes = qint64(512) << 20;
+    static constexpr int MaxAgeDays = 60;
+
+    static QByteArray contentHash(const uchar *data, qint64 size);
+    static QString cacheFilePath(const QString &sourcePath);
+
+    // false — кэша нет, он устарел или повреждён; выходные данные не меняются
+    static bool load(const QString &sourcePath, const QByteArray &sourceHash,
+                     NoteStore &notes, TempoMap &tempoMap, ControlEventList &controls,
+                     QVector<QString> &trackNames, int &format, qint64 &durationMs);
+    static bool store(const QString &sourcePath, const QByteArray &sourceHash,
+                      const NoteStore &notes, const TempoMap &tempoMap,
+                      const ControlEventList &controls, const QVector<QString> &trackNames,
+                      int format, qint64 durationMs);
+};
+
+#endif
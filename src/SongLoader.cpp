@@ -0,0 +1,139 @@
+#include "SongLoader.h"
+#include "Trace.h"
+#include <QDebug>
+#include <QMetaObject>
+
+SongLoader::SongLoader(QObject *parent)
+    : QObject(parent)
+{
+}
+
+SongLoader::~SongLoader()
+{
+    // Потоки шлют queued-вызовы этому объекту — до удаления их надо дождаться
+    retireWorker();
+    reapWorkers(true);
+}
+
+void SongLoader::load(const QString &filePath)
+{
+    retireWorker();
+    reapWorkers(false);
+    const quint64 generation = ++m_generation;
+    m_loading = true;
+    m_worker = std::make_unique<Worker>();
+    Worker *worker = m_worker.get();
+    worker->thread = std::thread([this, filePath, generation, worker]() {
+        run(filePath, generation, worker->cancel);
+        worker->done.store(true, std::memory_order_release);
+    });
+}
+
+void SongLoader::cancel()
+{
+    if (!m_loading)
+        return;
+    retireWorker();
+    reapWorkers(false);
+    ++m_generation;   // то, что поток успел отправить, уже не нужно
+    m_loading = false;
+    emit canceled();
+}
+
+void SongLoader::retireWorker()
+{
+    if (!m_worker)
+        return;
+    m_worker->cancel.store(true, std::memory_order_relaxed);
+    m_retired.push_back(std::move(m_worker));
+}
+
+void SongLoader::reapWorkers(bool wait)
+{
+    for (auto it = m_retired.begin(); it != m_retired.end();) {
+        Worker &worker = **it;
+        if (!wait && !worker.done.load(std::memory_order_acquire)) {
+            ++it;
+            continue;
+        }
+        worker.thread.join();
+        it = m_retired.erase(it);
+    }
+}
+
+namespace {
+
+QVector<Song::Track> tracksOf(const MidiParser &parser)
+{
+    QVector<Song::Track> tracks;
+    tracks.reserve(parser.getTrackNames().size());
+    for (const QString &name : parser.getTrackNames())
+        tracks.append(Song::Track{ name });
+    return tracks;
+}
+
+} // namespace
+
+template <typename F>
+void SongLoader::post(quint64 generation, F &&f)
+{
+    QMetaObject::invokeMethod(this, [this, generation, f = std::forward<F>(f)]() {
+        if (generation == m_generation.load())
+            f();
+    }, Qt::QueuedConnection);
+}
+
+void SongLoader::run(const QString &filePath, quint64 generation, const std::atomic<bool> &cancel)
+{
+    Trace::setThreadName("song loader");
+    PIANO_TRACE_ZONE("SongLoader::run");
+
+    // Прогресс шлём только при смене процента — очередь GUI не забивается
+    int lastPercent = -1;
+
+    MidiParser parser;
+    MidiParseControl control;
+    control.cancel = &cancel;
+    control.prefixMs = PrefixMs;
+    control.progress = [&](int percent) {
+        if (percent == lastPercent)
+            return;
+        lastPercent = percent;
+        post(generation, [this, percent]() { emit progress(percent); });
+    };
+    control.prefix = [&](NoteStore &&notes, const TempoMap &tempoMap,
+                         const ControlEventList &controls, qint64 durationMs) {
+        if (cancel.load(std::memory_order_relaxed))
+            return;
+        SongPtr song = Song::create(filePath, std::move(notes), tempoMap, controls, durationMs,
+                                    tracksOf(parser), parser.getFormat(), MidiParseStats(), false);
+        post(generation, [this, song]() { emit prefixReady(song); });
+    };
+
+    parser.setControl(&control);
+    const bool ok = parser.parseFile(filePath);
+
+    if (!ok) {
+        if (parser.wasCanceled())
+            return;   // cancel() уже сообщил об отмене
+        post(generation, [this, filePath]() {
+            m_loading = false;
+            emit failed(filePath);
+        });
+        return;
+    }
+
+    // Ноты переезжают из парсера в песню без копирования;
+    // расписание строится здесь же, не в потоке GUI
+    if (cancel.load(std::memory_order_relaxed))
+        return;
+    const MidiParseStats stats = parser.getParseStats();
+    SongPtr song = Song::create(filePath, parser.takeNotes(), parser.getTempoMap(),
+                                parser.getControls(), parser.getDuration(), tracksOf(parser),
+                                parser.getFormat(), stats, true);
+
+    post(generation, [this, song]() {
+        m_loading = false;
+        emit loaded(song);
+    });
+}
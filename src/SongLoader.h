@@ -0,0 +1,64 @@
+// SongLoader.h
+#ifndef SONGLOADER_H
+#define SONGLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Song.h"
+
+// Загружает MIDI-файл в фоновом потоке. Сначала публикует начало песни
+// (первые PrefixMs), чтобы ролл и воспроизведение не ждали хвоста, затем —
+// всю песню. Обе — готовые неизменяемые Song с расписанием событий.
+// Сигналы приходят в потоке владельца; результаты отменённой или
+// заменённой новой загрузки отбрасываются.
+//
+// load() и cancel() не ждут прежний поток: он получает свой флаг отмены,
+// доделывает текущий шаг и выходит сам, а join достаётся следующему
+// вызову, когда поток уже закончил. Ждёт потоки только деструктор.
+class SongLoader : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr qint64 PrefixMs = 15000;
+
+    explicit SongLoader(QObject *parent = nullptr);
+    ~SongLoader();
+
+    void load(const QString &filePath);   // отменяет текущую загрузку
+    void cancel();
+    bool isLoading() const { return m_loading; }
+
+signals:
+    void progress(int percent);
+    void prefixReady(const SongPtr &song);
+    void loaded(const SongPtr &song);
+    void failed(const QString &filePath);
+    void canceled();
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::atomic<bool> cancel{false};
+        std::atomic<bool> done{false};
+    };
+
+    // Отменить текущую загрузку, не дожидаясь потока
+    void retireWorker();
+    // Присоединить закончившиеся потоки; wait — дождаться всех
+    void reapWorkers(bool wait);
+    void run(const QString &filePath, quint64 generation, const std::atomic<bool> &cancel);
+    // Выполнить в потоке владельца, если загрузка ещё актуальна
+    template <typename F>
+    void post(quint64 generation, F &&f);
+
+    std::unique_ptr<Worker> m_worker;
+    std::vector<std::unique_ptr<Worker>> m_retired;
+    std::atomic<quint64> m_generation{0};
+    bool m_loading = false;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "SongOverviewWidget.h"
+#include "Trace.h"
+#include <QElapsedTimer>
+#include <QMouseEvent>
+#include <QPainter>
+#include <algorithm>
+
+namespace {
+
+const QColor kBackground(0x1E, 0x1E, 0x1E);
+const QColor kNoteColor(0, 188, 212);       // #00BCD4
+const QColor kPositionColor(255, 152, 0);   // #FF9800
+
+} // namespace
+
+SongOverviewWidget::SongOverviewWidget(QWidget *parent)
+    : QWidget(parent),
+      m_song(Song::empty())
+{
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+QSize SongOverviewWidget::minimumSizeHint() const
+{
+    return QSize(200, 32);
+}
+
+QSize SongOverviewWidget::sizeHint() const
+{
+    return QSize(800, 40);
+}
+
+void SongOverviewWidget::setSong(SongPtr song)
+{
+    m_song = song ? std::move(song) : Song::empty();
+    m_image = QImage();
+    update();
+}
+
+void SongOverviewWidget::setPosition(qint64 ms)
+{
+    if (ms == m_positionMs)
+        return;
+    // Перерисовываем только полоски старой и новой позиции
+    const int oldX = xForTime(m_positionMs);
+    m_positionMs = ms;
+    const int newX = xForTime(m_positionMs);
+    if (oldX != newX) {
+        update(oldX - 1, 0, 3, height());
+        update(newX - 1, 0, 3, height());
+    }
+}
+
+void SongOverviewWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    m_image = QImage();
+}
+
+int SongOverviewWidget::xForTime(qint64 ms) const
+{
+    const qint64 duration = m_song->durationMs();
+    if (duration <= 0)
+        return 0;
+    return int(qBound<qint64>(0, ms, duration) * (width() - 1) / duration);
+}
+
+void SongOverviewWidget::renderImage()
+{
+    PIANO_TRACE_ZONE("SongOverviewWidget::renderImage");
+    const qreal dpr = devicePixelRatioF();
+    const QSize deviceSize = size() * dpr;
+    m_image = QImage(deviceSize, QImage::Format_RGB32);
+    m_image.setDevicePixelRatio(dpr);
+    m_image.fill(kBackground);
+
+    const DensityPyramid &density = m_song->density();
+    const qint64 duration = m_song->durationMs();
+    if (density.isEmpty() || duration <= 0 || deviceSize.width() <= 0)
+        return;
+
+    // Самый грубый уровень, у которого корзин хватает на каждый столбец;
+    // столбец — максимум по попавшим в него корзинам
+    const int columns = deviceSize.width();
+    const int level = density.levelForBinMs(double(duration) / columns);
+    const int binCount = density.binCount(level);
+    const qint64 binMs = density.binMs(level);
+
+    std::vector<int> count(PitchCount);
+    std::vector<int> velocity(PitchCount);
+    for (int x = 0; x < columns; ++x) {
+        const int first = int(qint64(x) * duration / columns / binMs);
+        const int last = std::max(first, int((qint64(x + 1) * duration / columns - 1) / binMs));
+        std::fill(count.begin(), count.end(), 0);
+        std::fill(velocity.begin(), velocity.end(), 0);
+        for (int b = first; b <= last && b < binCount; ++b) {
+            const DensityPyramid::Cell *cells = density.bin(level, b);
+            for (int i = 0; i < PitchCount; ++i) {
+                count[i] = std::max(count[i], int(cells[FirstPitch + i].count));
+                velocity[i] = std::max(velocity[i], int(cells[FirstPitch + i].maxVelocity));
+            }
+        }
+
+        // Высокие ноты сверху; строка изображения — доля диапазона высот
+        for (int y = 0; y < deviceSize.height(); ++y) {
+            const int i = PitchCount - 1 - y * PitchCount / deviceSize.height();
+            if (count[i] == 0)
+                continue;
+            // Непрозрачность — по числу нот, яркость — по самой громкой
+            const int a = std::min(255, 96 + 40 * count[i]);
+            const int bright = 128 + velocity[i];
+            auto mix = [a, bright](int bg, int fg) { return bg + (fg * bright / 255 - bg) * a / 255; };
+            const QRgb rgb = qRgb(mix(kBackground.red(), kNoteColor.red()),
+                                  mix(kBackground.green(), kNoteColor.green()),
+                                  mix(kBackground.blue(), kNoteColor.blue()));
+            reinterpret_cast<QRgb *>(m_image.scanLine(y))[x] = rgb;
+        }
+    }
+}
+
+void SongOverviewWidget::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    PIANO_TRACE_ZONE("SongOverviewWidget::paintEvent");
+    QElapsedTimer timer;
+    timer.start();
+
+    if (m_image.isNull())
+        renderImage();
+
+    QPainter p(this);
+    p.drawImage(0, 0, m_image);
+    if (!m_song->isEmpty()) {
+        const int x = xForTime(m_positionMs);
+        p.fillRect(x - 1, 0, 2, height(), kPositionColor);
+    }
+    m_lastPaintNs = timer.nsecsElapsed();
+}
+
+void SongOverviewWidget::seekTo(int x)
+{
+    const qint64 duration = m_song->durationMs();
+    if (duration <= 0 || width() <= 1)
+        return;
+    emit seekRequested(qBound<qint64>(0, qint64(x) * duration / (width() - 1), duration));
+}
+
+void SongOverviewWidget::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return QWidget::mousePressEvent(event);
+    seekTo(event->position().toPoint().x());
+}
+
+void SongOverviewWidget::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() & Qt::LeftButton)
+        seekTo(event->position().toPoint().x());
+}
@@ -0,0 +1,51 @@
+// SongOverviewWidget.h
+#ifndef SONGOVERVIEWWIDGET_H
+#define SONGOVERVIEWWIDGET_H
+
+#include <QImage>
+#include <QWidget>
+#include "Song.h"
+
+// Обзор всей песни полосой под слайдером позиции: время по горизонтали,
+// высота по вертикали, яркость — плотность нот. Картинка строится по
+// карте плотности (DensityPyramid) один раз на песню и размер; кадр —
+// один drawImage и линия позиции. Щелчок или протяжка — перемотка.
+class SongOverviewWidget : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SongOverviewWidget(QWidget *parent = nullptr);
+
+    void setSong(SongPtr song);
+    // Длительность последней отрисовки, нс
+    qint64 lastPaintNs() const { return m_lastPaintNs; }
+
+public slots:
+    void setPosition(qint64 ms);
+
+signals:
+    void seekRequested(qint64 ms);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    QSize minimumSizeHint() const override;
+    QSize sizeHint() const override;
+
+private:
+    static constexpr int FirstPitch = 21;    // диапазон клавиатуры
+    static constexpr int PitchCount = 88;
+
+    void renderImage();
+    int xForTime(qint64 ms) const;
+    void seekTo(int x);
+
+    SongPtr m_song;   // никогда не nullptr
+    QImage m_image;   // пустая — перестроить при отрисовке
+    qint64 m_positionMs = 0;
+    qint64 m_lastPaintNs = 0;
+};
+
+#endif
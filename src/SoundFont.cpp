@@ -0,0 +1,414 @@
+#include "SoundFont.h"
+#include "NoteStore.h"
+#include <QFileInfo>
+#include <QByteArray>
+#include <QDebug>
+#include <QtEndian>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Генераторы SF2, которые нас интересуют
+enum Generator {
+    GenStartAddrsOffset      = 0,
+    GenEndAddrsOffset        = 1,
+    GenStartloopAddrsOffset  = 2,
+    GenEndloopAddrsOffset    = 3,
+    GenStartAddrsCoarse      = 4,
+    GenEndAddrsCoarse        = 12,
+    GenPan                   = 17,
+    GenAttackVolEnv          = 34,
+    GenDecayVolEnv           = 36,
+    GenSustainVolEnv         = 37,
+    GenReleaseVolEnv         = 38,
+    GenInstrument            = 41,
+    GenKeyRange              = 43,
+    GenVelRange              = 44,
+    GenStartloopAddrsCoarse  = 45,
+    GenInitialAttenuation    = 48,
+    GenEndloopAddrsCoarse    = 50,
+    GenCoarseTune            = 51,
+    GenFineTune              = 52,
+    GenSampleId              = 53,
+    GenSampleModes           = 54,
+    GenOverridingRootKey     = 58,
+    GenCount                 = 61
+};
+
+quint16 le16(const uchar *p) { return quint16(p[0] | (p[1] << 8)); }
+quint32 le32(const uchar *p) { return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24); }
+
+bool idIs(const uchar *p, const char *id)
+{
+    return p[0] == uchar(id[0]) && p[1] == uchar(id[1]) && p[2] == uchar(id[2]) && p[3] == uchar(id[3]);
+}
+
+struct Chunk {
+    const uchar *data = nullptr;
+    quint32 size = 0;
+};
+
+// Набор генераторов одной зоны: значение + признак «задан»
+struct GenSet {
+    std::array<qint16, GenCount> value{};
+    std::array<bool, GenCount> set{};
+
+    void apply(quint16 oper, qint16 amount)
+    {
+        if (oper < GenCount) {
+            value[oper] = amount;
+            set[oper] = true;
+        }
+    }
+    qint16 get(int oper, qint16 fallback) const { return set[oper] ? value[oper] : fallback; }
+    quint8 rangeLo(int oper) const { return set[oper] ? quint8(value[oper] & 0xFF) : 0; }
+    quint8 rangeHi(int oper) const { return set[oper] ? quint8((quint16(value[oper]) >> 8) & 0xFF) : 127; }
+};
+
+float timecentsToSec(int tc) { return std::exp2(float(tc) / 1200.0f); }
+float centibelsToGain(int cb) { return std::pow(10.0f, -float(cb) / 200.0f); }
+
+// Генераторы зон [bagFirst, bagLast): глобальная зона (без terminal-генератора)
+// распространяется на остальные
+template <typename F>
+void forEachZoneGens(const Chunk &bags, const Chunk &gens, int bagFirst, int bagLast,
+                     int terminalGen, F &&f)
+{
+    GenSet global;
+    for (int b = bagFirst; b < bagLast; ++b) {
+        const int genFirst = le16(bags.data + 4 * b);
+        const int genLast  = le16(bags.data + 4 * (b + 1));
+
+        GenSet zone = global;
+        bool hasTerminal = false;
+        for (int g = genFirst; g < genLast && quint32(4 * g + 4) <= gens.size; ++g) {
+            const quint16 oper = le16(gens.data + 4 * g);
+            const qint16 amount = qint16(le16(gens.data + 4 * g + 2));
+            zone.apply(oper, amount);
+            hasTerminal |= oper == terminalGen;
+        }
+
+        if (hasTerminal)
+            f(zone);
+        else if (b == bagFirst)
+            global = zone;   // глобальная зона бывает только первой
+    }
+}
+
+} // namespace
+
+SoundFont::SoundFont() {}
+
+SoundFont::~SoundFont()
+{
+    stopPrefetch();
+    if (m_data)
+        m_file.unmap(const_cast<uchar *>(m_data));
+}
+
+bool SoundFont::load(const QString &filePath, QString *error)
+{
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (error) *error = "cannot open " + filePath;
+        return false;
+    }
+
+    m_mappedSize = m_file.size();
+    m_data = m_mappedSize > 12 ? m_file.map(0, m_mappedSize) : nullptr;
+    if (!m_data) {
+        if (error) *error = "cannot map " + filePath;
+        return false;
+    }
+
+    m_fileName = QFileInfo(filePath).fileName();
+    return parse(error);
+}
+
+bool SoundFont::parse(QString *error)
+{
+    if (!idIs(m_data, "RIFF") || !idIs(m_data + 8, "sfbk")) {
+        if (error) *error = "not a SoundFont 2 file";
+        return false;
+    }
+
+    const uchar *end = m_data + qMin<qint64>(m_mappedSize, qint64(8) + le32(m_data + 4));
+    Chunk smpl, phdr, pbag, pgen, inst, ibag, igen, shdr;
+
+    // Верхний уровень: LIST sdta / LIST pdta
+    for (const uchar *p = m_data + 12; end - p >= 12; ) {
+        const quint32 size = le32(p + 4);
+        const uchar *body = p + 8;
+        const uchar *next = (quint64(end - body) < size) ? end : body + size + (size & 1);
+
+        if (idIs(p, "LIST")) {
+            const bool sdta = idIs(body, "sdta");
+            const bool pdta = idIs(body, "pdta");
+            const uchar *listEnd = qMin(next, end);
+            for (const uchar *q = body + 4; listEnd - q >= 8; ) {
+                Chunk c;
+                c.size = le32(q + 4);
+                c.data = q + 8;
+                if (quint64(listEnd - c.data) < c.size)
+                    c.size = quint32(listEnd - c.data);
+
+                if (sdta && idIs(q, "smpl")) smpl = c;
+                if (pdta) {
+                    if (idIs(q, "phdr")) phdr = c;
+                    else if (idIs(q, "pbag")) pbag = c;
+                    else if (idIs(q, "pgen")) pgen = c;
+                    else if (idIs(q, "inst")) inst = c;
+                    else if (idIs(q, "ibag")) ibag = c;
+                    else if (idIs(q, "igen")) igen = c;
+                    else if (idIs(q, "shdr")) shdr = c;
+                }
+                q = c.data + c.size + (c.size & 1);
+            }
+        }
+        p = next;
+    }
+
+    if (!smpl.data || !phdr.data || !pbag.data || !pgen.data
+        || !inst.data || !ibag.data || !igen.data || !shdr.data) {
+        if (error) *error = "missing sdta/pdta chunks";
+        return false;
+    }
+
+    // Отсчёты 16 бит little-endian. Обычно читаем прямо из отображения, но
+    // чанк в кривом файле может начинаться с нечётного смещения, а qint16
+    // по такому адресу — неопределённое поведение (и SIGBUS на части ARM).
+    // Тогда, как и на big-endian, отсчёты один раз копируются в свой буфер.
+    m_sampleCount = smpl.size / 2;
+    m_sampleCopy.clear();
+    const bool aligned = reinterpret_cast<quintptr>(smpl.data) % alignof(qint16) == 0;
+    if (aligned && Q_BYTE_ORDER == Q_LITTLE_ENDIAN) {
+        m_samples = reinterpret_cast<const qint16 *>(smpl.data);
+    } else {
+        qWarning() << "SoundFont:" << m_fileName << "- отсчёты не выровнены, копируем"
+                   << qint64(m_sampleCount) * 2 / 1024 << "KB";
+        m_sampleCopy.resize(m_sampleCount);
+        std::memcpy(m_sampleCopy.data(), smpl.data, size_t(m_sampleCount) * 2);
+        if (Q_BYTE_ORDER != Q_LITTLE_ENDIAN)
+            qFromLittleEndian<qint16>(m_sampleCopy.data(), m_sampleCount, m_sampleCopy.data());
+        m_samples = m_sampleCopy.data();
+    }
+
+    const int presetRecords = int(phdr.size / 38);
+    const int instRecords   = int(inst.size / 22);
+    const int sampleRecords = int(shdr.size / 46);
+    const int pbagCount     = int(pbag.size / 4);
+    const int ibagCount     = int(ibag.size / 4);
+    if (presetRecords < 2 || instRecords < 2 || sampleRecords < 1) {
+        if (error) *error = "empty preset/instrument tables";
+        return false;
+    }
+
+    m_presets.clear();
+    m_zones.clear();
+    m_keyOffsets.clear();
+    m_keyZones.clear();
+
+    // Последняя запись phdr/inst — терминатор EOP/EOI
+    for (int pi = 0; pi + 1 < presetRecords; ++pi) {
+        const uchar *ph = phdr.data + 38 * pi;
+
+        Preset preset;
+        preset.name = QString::fromLatin1(reinterpret_cast<const char *>(ph),
+                                          qstrnlen(reinterpret_cast<const char *>(ph), 20));
+        preset.program = le16(ph + 20);
+        preset.bank    = le16(ph + 22);
+
+        const int bagFirst = le16(ph + 24);
+        const int bagLast  = qMin<int>(le16(ph + 38 + 24), pbagCount - 1);
+        const size_t zonesBefore = m_zones.size();
+
+        forEachZoneGens(pbag, pgen, bagFirst, bagLast, GenInstrument, [&](const GenSet &pz) {
+            const int instIndex = pz.value[GenInstrument];
+            if (instIndex < 0 || instIndex + 1 >= instRecords)
+                return;
+            const uchar *ih = inst.data + 22 * instIndex;
+            const int ibagFirst = le16(ih + 20);
+            const int ibagLast  = qMin<int>(le16(ih + 22 + 20), ibagCount - 1);
+
+            forEachZoneGens(ibag, igen, ibagFirst, ibagLast, GenSampleId, [&](const GenSet &iz) {
+                const int sampleIndex = quint16(iz.value[GenSampleId]);
+                if (sampleIndex >= sampleRecords)
+                    return;
+                const uchar *sh = shdr.data + 46 * sampleIndex;
+                if (le16(sh + 44) & 0x8000)   // ROM-сэмплы не поддерживаем
+                    return;
+
+                Zone z;
+                z.keyLo = qMax(pz.rangeLo(GenKeyRange), iz.rangeLo(GenKeyRange));
+                z.keyHi = qMin(pz.rangeHi(GenKeyRange), iz.rangeHi(GenKeyRange));
+                z.velLo = qMax(pz.rangeLo(GenVelRange), iz.rangeLo(GenVelRange));
+                z.velHi = qMin(pz.rangeHi(GenVelRange), iz.rangeHi(GenVelRange));
+                if (z.keyLo > z.keyHi || z.velLo > z.velHi || z.keyHi > 127)
+                    return;
+
+                const qint64 start = qint64(le32(sh + 20))
+                                   + iz.get(GenStartAddrsOffset, 0) + 32768 * iz.get(GenStartAddrsCoarse, 0);
+                const qint64 stop  = qint64(le32(sh + 24))
+                                   + iz.get(GenEndAddrsOffset, 0) + 32768 * iz.get(GenEndAddrsCoarse, 0);
+                const qint64 loopStart = qint64(le32(sh + 28))
+                                   + iz.get(GenStartloopAddrsOffset, 0) + 32768 * iz.get(GenStartloopAddrsCoarse, 0);
+                const qint64 loopEnd = qint64(le32(sh + 32))
+                                   + iz.get(GenEndloopAddrsOffset, 0) + 32768 * iz.get(GenEndloopAddrsCoarse, 0);
+                if (start < 0 || stop <= start + 1 || stop > qint64(m_sampleCount))
+                    return;
+
+                z.start = quint32(start);
+                z.end   = quint32(stop);
+                z.sampleRate = qMax<quint32>(le32(sh + 36), 1);
+
+                const int modes = iz.get(GenSampleModes, 0) & 3;
+                z.loop = (modes == 1 || modes == 3)
+                      && loopStart >= start && loopEnd <= stop && loopEnd > loopStart + 1;
+                z.loopStart = z.loop ? quint32(loopStart) : z.start;
+                z.loopEnd   = z.loop ? quint32(loopEnd) : z.end;
+
+                const int originalPitch = sh[40];
+                z.rootKey = iz.get(GenOverridingRootKey, -1) >= 0
+                          ? iz.get(GenOverridingRootKey, 60)
+                          : qint16(originalPitch <= 127 ? originalPitch : 60);
+
+                // Генераторы пресета складываются с генераторами инструмента
+                z.tuneCents = float(100 * (iz.get(GenCoarseTune, 0) + pz.get(GenCoarseTune, 0))
+                                    + iz.get(GenFineTune, 0) + pz.get(GenFineTune, 0)
+                                    + qint8(sh[41]));
+                z.gain = centibelsToGain(qMax(0, iz.get(GenInitialAttenuation, 0)
+                                                 + pz.get(GenInitialAttenuation, 0)));
+                z.pan = qBound(-1.0f, float(iz.get(GenPan, 0) + pz.get(GenPan, 0)) / 500.0f, 1.0f);
+                z.attackSec  = timecentsToSec(iz.get(GenAttackVolEnv, -12000) + pz.get(GenAttackVolEnv, 0));
+                z.decaySec   = timecentsToSec(iz.get(GenDecayVolEnv, -12000) + pz.get(GenDecayVolEnv, 0));
+                z.releaseSec = timecentsToSec(iz.get(GenReleaseVolEnv, -12000) + pz.get(GenReleaseVolEnv, 0));
+                z.sustainLevel = centibelsToGain(qBound(0, iz.get(GenSustainVolEnv, 0)
+                                                           + pz.get(GenSustainVolEnv, 0), 1440));
+
+                m_zones.push_back(z);
+            });
+        });
+
+        // Таблица «клавиша → зоны» для этого пресета
+        preset.keyTable = quint32(m_keyOffsets.size());
+        for (int key = 0; key < 128; ++key) {
+            m_keyOffsets.push_back(quint32(m_keyZones.size()));
+            for (size_t zi = zonesBefore; zi < m_zones.size(); ++zi) {
+                if (key >= m_zones[zi].keyLo && key <= m_zones[zi].keyHi)
+                    m_keyZones.push_back(quint32(zi));
+            }
+        }
+        m_keyOffsets.push_back(quint32(m_keyZones.size()));
+
+        m_presets.push_back(preset);
+    }
+
+    qDebug() << "SoundFont:" << m_fileName
+             << "presets:" << m_presets.size()
+             << "zones:" << m_zones.size()
+             << "sample MB:" << double(m_sampleCount) * 2.0 / 1.0e6;
+    return !m_presets.empty();
+}
+
+int SoundFont::findPreset(int bank, int program) const
+{
+    for (int i = 0; i < int(m_presets.size()); ++i) {
+        if (m_presets[i].bank == bank && m_presets[i].program == program)
+            return i;
+    }
+    return -1;
+}
+
+void SoundFont::stopPrefetch()
+{
+    m_prefetchCancel.store(true, std::memory_order_relaxed);
+    if (m_prefetchThread.joinable())
+        m_prefetchThread.join();
+    m_prefetchCancel.store(false, std::memory_order_relaxed);
+}
+
+void SoundFont::prefetchForNotes(int presetIndex, const NoteStore &notes)
+{
+    stopPrefetch();
+    m_prefetched.store(0, std::memory_order_relaxed);
+    if (presetIndex < 0 || presetIndex >= presetCount())
+        return;
+
+    // Какие пары (клавиша, громкость) реально встречаются в песне
+    std::vector<bool> used(128 * 128, false);
+    const quint8 *pitches = notes.pitches();
+    const quint8 *velocities = notes.velocities();
+    for (int i = 0; i < notes.size(); ++i)
+        used[pitches[i] * 128 + velocities[i]] = true;
+
+    std::vector<bool> zoneUsed(m_zones.size(), false);
+    for (int key = 0; key < 128; ++key) {
+        for (int vel = 1; vel < 128; ++vel) {
+            if (!used[key * 128 + vel])
+                continue;
+            forEachZone(presetIndex, key, vel, [&](const Zone &z) {
+                zoneUsed[size_t(&z - m_zones.data())] = true;
+            });
+        }
+    }
+
+    // Диапазоны байт отсчётов, слитые по перекрытию
+    std::vector<Range> ranges;
+    for (size_t zi = 0; zi < m_zones.size(); ++zi) {
+        if (zoneUsed[zi])
+            ranges.push_back({ m_zones[zi].start * 2, m_zones[zi].end * 2 });
+    }
+    std::sort(ranges.begin(), ranges.end(),
+              [](const Range &a, const Range &b) { return a.first < b.first; });
+    std::vector<Range> merged;
+    for (const Range &r : ranges) {
+        if (!merged.empty() && r.first <= merged.back().last)
+            merged.back().last = qMax(merged.back().last, r.last);
+        else
+            merged.push_back(r);
+    }
+
+    const uchar *base = reinterpret_cast<const uchar *>(m_samples);
+    m_prefetchThread = std::thread([this, base, merged]() {
+        const quint32 page = 4096;
+        unsigned sink = 0;
+        for (const Range &r : merged) {
+            for (quint32 off = r.first; off < r.last; off += page) {
+                if (m_prefetchCancel.load(std::memory_order_relaxed))
+                    return;
+                sink += static_cast<const volatile uchar *>(base)[off];   // page fault здесь
+                m_prefetched.fetch_add(qMin(page, r.last - off), std::memory_order_relaxed);
+            }
+        }
+        Q_UNUSED(sink);
+    });
+}
+
+qint64 SoundFont::residentSampleBytes() const
+{
+#ifdef Q_OS_LINUX
+    if (!m_samples || m_sampleCount == 0)
+        return 0;
+    const long page = sysconf(_SC_PAGESIZE);
+    const quintptr first = reinterpret_cast<quintptr>(m_samples) & ~quintptr(page - 1);
+    const quintptr last = reinterpret_cast<quintptr>(m_samples) + quintptr(m_sampleCount) * 2;
+    const size_t length = size_t(last - first);
+    std::vector<unsigned char> pages((length + size_t(page) - 1) / size_t(page));
+    if (mincore(reinterpret_cast<void *>(first), length, pages.data()) != 0)
+        return prefetchedBytes();
+    qint64 resident = 0;
+    for (unsigned char p : pages)
+        resident += (p & 1) ? page : 0;
+    return resident;
+#else
+    return prefetchedBytes();
+#endif
+}
@@ -0,0 +1,110 @@
+// SoundFont.h
+#ifndef SOUNDFONT_H
+#define SOUNDFONT_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+class NoteStore;
+
+// Банк SoundFont 2, отображённый в память. Иерархия пресет → инструмент →
+// зона при загрузке сворачивается в плоский массив зон с готовыми
+// параметрами и таблицу «клавиша → зоны» на каждый пресет. Сами отсчёты
+// не копируются: голоса читают их прямо из отображения, а страницы ОС
+// подгружает лениво (или заранее — prefetchForNotes). Исключение — чанк
+// smpl с нечётного смещения: его отсчёты копируются в выровненный буфер.
+class SoundFont {
+public:
+    struct Zone {
+        quint8  keyLo = 0, keyHi = 127;
+        quint8  velLo = 0, velHi = 127;
+        quint32 start = 0, end = 0;           // в отсчётах от начала smpl
+        quint32 loopStart = 0, loopEnd = 0;
+        quint32 sampleRate = 44100;
+        qint16  rootKey = 60;
+        float   tuneCents = 0.0f;
+        bool    loop = false;
+        float   gain = 1.0f;                  // из initialAttenuation
+        float   pan = 0.0f;                   // -1 .. 1
+        float   attackSec = 0.001f;
+        float   decaySec = 1.0f;
+        float   sustainLevel = 1.0f;
+        float   releaseSec = 0.1f;
+    };
+
+    struct Preset {
+        QString name;
+        quint16 bank = 0;
+        quint16 program = 0;
+        quint32 keyTable = 0;   // смещение 129 границ в m_keyOffsets
+    };
+
+    SoundFont();
+    ~SoundFont();
+
+    bool load(const QString &filePath, QString *error = nullptr);
+
+    const QString &fileName() const { return m_fileName; }
+    int presetCount() const { return int(m_presets.size()); }
+    const Preset &preset(int i) const { return m_presets[i]; }
+    int findPreset(int bank, int program) const;   // -1, если нет
+
+    const qint16 *samples() const { return m_samples; }
+    quint32 sampleCount() const { return m_sampleCount; }
+
+    // Зоны пресета, покрывающие key и velocity. Без аллокаций.
+    template <typename F>
+    void forEachZone(int presetIndex, int key, int velocity, F &&f) const;
+
+    // Подкачивает страницы отсчётов только тех зон, что нужны нотам песни.
+    // Работает в фоновом потоке; предыдущая подкачка отменяется.
+    void prefetchForNotes(int presetIndex, const NoteStore &notes);
+
+    qint64 mappedBytes() const { return m_mappedSize; }
+    qint64 prefetchedBytes() const { return m_prefetched.load(std::memory_order_relaxed); }
+    // Сколько страниц отсчётов реально в RAM (Linux — mincore, иначе оценка)
+    qint64 residentSampleBytes() const;
+
+private:
+    struct Range { quint32 first, last; };
+
+    bool parse(QString *error);
+    void stopPrefetch();
+
+    QFile m_file;
+    QString m_fileName;
+    const uchar *m_data = nullptr;
+    qint64 m_mappedSize = 0;
+
+    const qint16 *m_samples = nullptr;   // в отображении или в m_sampleCopy
+    quint32 m_sampleCount = 0;
+    std::vector<qint16> m_sampleCopy;    // только если smpl не выровнен
+
+    std::vector<Preset>  m_presets;
+    std::vector<Zone>    m_zones;
+    std::vector<quint32> m_keyOffsets;   // на пресет: 129 границ в m_keyZones
+    std::vector<quint32> m_keyZones;     // индексы зон, сгруппированные по клавише
+
+    std::thread m_prefetchThread;
+    std::atomic<bool> m_prefetchCancel{false};
+    std::atomic<qint64> m_prefetched{0};
+};
+
+template <typename F>
+void SoundFont::forEachZone(int presetIndex, int key, int velocity, F &&f) const
+{
+    if (presetIndex < 0 || presetIndex >= int(m_presets.size()) || key < 0 || key > 127)
+        return;
+    const quint32 *offsets = m_keyOffsets.data() + m_presets[presetIndex].keyTable;
+    for (quint32 i = offsets[key]; i < offsets[key + 1]; ++i) {
+        const Zone &z = m_zones[m_keyZones[i]];
+        if (velocity >= z.velLo && velocity <= z.velHi)
+            f(z);
+    }
+}
+
+#endif
@@ -0,0 +1,108 @@
+// SpscRing.h
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Кольцевой буфер «один писатель — один читатель» без блокировок.
+// Ёмкость округляется вверх до степени двойки; память выделяется
+// только в конструкторе, push/pop не аллоцируют и не ждут.
+// Неудачные push (буфер полон) считаются — overflowCount().
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+            size <<= 1;
+        m_buffer.resize(size);
+        m_mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    // Поток-писатель. false — буфер полон, значение не записано.
+    bool push(const T &value)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tailCache > m_mask) {
+            m_tailCache = m_tail.load(std::memory_order_acquire);
+            if (head - m_tailCache > m_mask) {
+                m_overflows.store(m_overflows.load(std::memory_order_relaxed) + 1,
+                                  std::memory_order_relaxed);
+                return false;
+            }
+        }
+        m_buffer[head & m_mask] = value;
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Поток-читатель. false — буфер пуст.
+    bool pop(T &value)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache) {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+                return false;
+        }
+        value = m_buffer[tail & m_mask];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Поток-читатель: первый элемент без извлечения. nullptr — пусто.
+    // Указатель живёт до следующего pop().
+    const T *peek()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_headCache) {
+            m_headCache = m_head.load(std::memory_order_acquire);
+            if (tail == m_headCache)
+                return nullptr;
+        }
+        return &m_buffer[tail & m_mask];
+    }
+
+    // Сквозные номера: сколько всего записано / прочитано. Позволяют
+    // читателю отбросить всё, что было записано до какого-то момента.
+    size_t pushedCount() const { return m_head.load(std::memory_order_acquire); }
+    size_t poppedCount() const { return m_tail.load(std::memory_order_acquire); }
+
+    // Поток-читатель: выбросить элементы с номерами меньше upTo
+    void discardUntil(size_t upTo)
+    {
+        T dummy;
+        while (poppedCount() < upTo && pop(dummy)) {}
+    }
+
+    // Приблизительно (из любого потока)
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+    quint64 overflowCount() const { return m_overflows.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<T> m_buffer;
+    size_t m_mask = 0;
+
+    // Индексы писателя и читателя — на разных кэш-линиях; каждый поток
+    // держит свою копию чужого индекса, чтобы реже трогать общую линию.
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_tailCache = 0;
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_headCache = 0;
+
+    std::atomic<quint64> m_overflows{0};   // пишет только писатель
+};
+
+#endif
@@ -0,0 +1,606 @@
+#include "SynthEngine.h"
+#include "Metrics.h"
+#include "VoiceMixer.h"
+#include "SoundFont.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+constexpr float kTwoPi = 6.28318530718f;
+constexpr float kMasterGain = 0.25f;
+constexpr float kSilence = 1.0e-4f;
+constexpr float kDampSec = 0.015f;   // быстрое глушение при стопе/перемотке
+// SF2 задаёт decay/release как время спада на 100 дБ: tau = t / ln(10^5)
+constexpr float kSf2TimeToTau = 1.0f / 11.5129f;
+
+// Громкость канала: квадратичная кривая (GM), 1.0 — при умолчаниях CC7 = 100, CC11 = 127
+float channelGain(const ChannelState &c)
+{
+    const float g = float(c.volume) / 100.0f * float(c.expression) / 127.0f;
+    return g * g;
+}
+
+// GM-программы для инструментов из cbInstruments
+constexpr int kGmPrograms[SynthEngine::InstrumentCount] = { 0, 1, 4, 6, 8 };
+
+qint64 steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Спектры инструментов: амплитуда h-й гармоники (h >= 1)
+float harmonicAmplitude(int instrument, int h)
+{
+    switch (instrument) {
+    case SynthEngine::GrandPiano:
+        return std::pow(float(h), -1.6f) * (h % 7 == 0 ? 0.4f : 1.0f);
+    case SynthEngine::BrightPiano:
+        return std::pow(float(h), -1.15f) * (h % 7 == 0 ? 0.5f : 1.0f);
+    case SynthEngine::ElectricPiano:
+        // тёплая основа и «колокольчик» на высоких гармониках
+        if (h == 1) return 1.0f;
+        if (h == 2) return 0.3f;
+        if (h == 3) return 0.08f;
+        if (h == 14) return 0.12f;
+        return 0.0f;
+    case SynthEngine::Harpsichord:
+        // почти пила, чётные гармоники приглушены (щипок у края струны)
+        return (h % 2 == 0 ? 0.55f : 1.0f) / float(h);
+    case SynthEngine::Celesta:
+        if (h == 1) return 1.0f;
+        if (h == 4) return 0.25f;
+        if (h == 10) return 0.08f;
+        return 0.0f;
+    default:
+        return h == 1 ? 1.0f : 0.0f;
+    }
+}
+
+} // namespace
+
+SynthEngine::SynthEngine(int sampleRate)
+    : m_sampleRate(sampleRate),
+      m_kernels(&mixKernels()),
+      m_events(4096),
+      m_liveEvents(256),
+      m_inputEvents(256)
+{
+    m_channelGain.fill(1.0f);
+    buildInstruments();
+}
+
+void SynthEngine::setSampleRate(int sampleRate)
+{
+    if (sampleRate > 0)
+        m_sampleRate = sampleRate;
+}
+
+void SynthEngine::buildInstruments()
+{
+    //                  attack  decay  sustain release gain
+    const float params[InstrumentCount][5] = {
+        { 0.002f, 2.6f, 0.0f,  0.25f, 1.0f },   // Grand Piano
+        { 0.001f, 2.0f, 0.0f,  0.20f, 0.9f },   // Bright Piano
+        { 0.002f, 3.2f, 0.15f, 0.30f, 1.0f },   // Electric Piano
+        { 0.001f, 1.4f, 0.0f,  0.08f, 0.8f },   // Harpsichord
+        { 0.001f, 1.1f, 0.0f,  0.45f, 1.0f },   // Celesta
+    };
+
+    for (int inst = 0; inst < InstrumentCount; ++inst) {
+        InstrumentModel &m = m_instruments[inst];
+        m.attackSec    = params[inst][0];
+        m.decaySec     = params[inst][1];
+        m.sustainLevel = params[inst][2];
+        m.releaseSec   = params[inst][3];
+        m.gain         = params[inst][4];
+
+        for (int level = 0; level < TableLevels; ++level) {
+            const int harmonics = 1 << level;
+            std::vector<float> &t = m.tables[level];
+            t.assign(TableSize + 1, 0.0f);
+
+            for (int h = 1; h <= harmonics; ++h) {
+                const float a = harmonicAmplitude(inst, h);
+                if (a == 0.0f)
+                    continue;
+                for (int i = 0; i < TableSize; ++i)
+                    t[i] += a * std::sin(kTwoPi * float(h) * float(i) / float(TableSize));
+            }
+
+            float peak = 0.0f;
+            for (int i = 0; i < TableSize; ++i)
+                peak = std::max(peak, std::fabs(t[i]));
+            if (peak > 0.0f) {
+                for (int i = 0; i < TableSize; ++i)
+                    t[i] /= peak;
+            }
+            t[TableSize] = t[0];   // защитный отсчёт для интерполяции
+        }
+    }
+}
+
+bool SynthEngine::pushEvent(const MidiEvent &event)
+{
+    if (m_events.push(event))
+        return true;
+    const bool noteOff = event.type == MidiEvent::NoteOff
+                         || (event.type == MidiEvent::NoteOn && event.data2 == 0);
+    if (noteOff) {
+        // Порядок важен: граница — раньше бита, см. releaseDroppedOffs
+        const int key = event.channel * 128 + event.data1;
+        m_droppedOffUpTo.store(m_events.pushedCount());
+        m_droppedOffs[size_t(key >> 6)].fetch_or(quint64(1) << (key & 63));
+        m_droppedOffRequests.fetch_add(1);
+    }
+    return false;
+}
+
+bool SynthEngine::noteOn(int pitch, int velocity)
+{
+    return pushEvent(MidiEvent::noteOn(0, pitch, velocity));
+}
+
+bool SynthEngine::noteOff(int pitch)
+{
+    return pushEvent(MidiEvent::noteOff(0, pitch));
+}
+
+bool SynthEngine::liveNoteOn(int pitch, int velocity)
+{
+    return m_liveEvents.push(MidiEvent::noteOn(0, pitch, velocity));
+}
+
+bool SynthEngine::liveNoteOff(int pitch)
+{
+    return m_liveEvents.push(MidiEvent::noteOff(0, pitch));
+}
+
+bool SynthEngine::inputEvent(const MidiEvent &event)
+{
+    return m_inputEvents.push(event);
+}
+
+void SynthEngine::allNotesOff()
+{
+    // Всё, что секвенсор успел записать до этого вызова, относится к старой
+    // позиции воспроизведения: аудио-поток выбросит это, не проигрывая
+    m_allOffUpTo.store(m_events.pushedCount(), std::memory_order_relaxed);
+    m_allOffRequests.fetch_add(1, std::memory_order_release);
+}
+
+void SynthEngine::setInstrument(int instrument)
+{
+    if (instrument >= 0 && instrument < InstrumentCount)
+        m_instrument.store(instrument, std::memory_order_relaxed);
+}
+
+void SynthEngine::setSoundFont(std::shared_ptr<const SoundFont> font)
+{
+    // Удаляем банки, которые аудио-поток уже точно не видит: после подмены
+    // нужен один render() со старым указателем (мог идти в момент подмены)
+    // и ещё один, который заглушит его голоса
+    const quint64 rendered = m_renderCount.load(std::memory_order_acquire);
+    m_retiredBanks.erase(std::remove_if(m_retiredBanks.begin(), m_retiredBanks.end(),
+                                        [rendered](const RetiredBank &r) { return rendered >= r.safeAfter; }),
+                         m_retiredBanks.end());
+
+    std::unique_ptr<SamplerBank> bank;
+    if (font) {
+        bank = std::make_unique<SamplerBank>();
+        bank->font = std::move(font);
+        int fallback = bank->font->findPreset(0, 0);
+        if (fallback < 0)
+            fallback = 0;
+        for (int inst = 0; inst < InstrumentCount; ++inst) {
+            const int preset = bank->font->findPreset(0, kGmPrograms[inst]);
+            bank->presets[inst] = preset >= 0 ? preset : fallback;
+        }
+    }
+
+    m_firstSoundUs.store(-1, std::memory_order_relaxed);
+    m_bank.store(bank.get(), std::memory_order_release);
+    if (m_currentBank)
+        m_retiredBanks.push_back({ std::move(m_currentBank),
+                                   m_renderCount.load(std::memory_order_acquire) + 2 });
+    m_currentBank = std::move(bank);
+}
+
+std::shared_ptr<const SoundFont> SynthEngine::soundFont() const
+{
+    return m_currentBank ? m_currentBank->font : nullptr;
+}
+
+int SynthEngine::soundFontPreset(int instrument) const
+{
+    if (!m_currentBank || instrument < 0 || instrument >= InstrumentCount)
+        return -1;
+    return m_currentBank->presets[instrument];
+}
+
+void SynthEngine::applyCommands()
+{
+    const SamplerBank *bank = m_bank.load(std::memory_order_acquire);
+    if (bank != m_bankSeen) {
+        // Голоса старого банка читают его отсчёты — глушим сразу
+        for (Voice &v : m_voices) {
+            if (v.samples)
+                v.stage = Stage::Off;
+        }
+        m_bankSeen = bank;
+        m_firstSoundPending = bank != nullptr;
+    }
+
+    const quint32 allOff = m_allOffRequests.load(std::memory_order_acquire);
+    if (allOff != m_allOffSeen) {
+        m_allOffSeen = allOff;
+        m_events.discardUntil(m_allOffUpTo.load(std::memory_order_relaxed));
+        for (Voice &v : m_voices) {
+            if (v.stage != Stage::Off)
+                v.stage = Stage::Damp;
+        }
+    }
+    releaseDroppedOffs();
+
+    // Живая игра — сразу, без привязки к отсчёту
+    MidiEvent live;
+    while (m_liveEvents.pop(live))
+        applyEvent(live);
+    while (m_inputEvents.pop(live))
+        applyEvent(live);
+}
+
+void SynthEngine::releaseDroppedOffs()
+{
+    const quint32 requests = m_droppedOffRequests.load();
+    if (requests == m_droppedOffSeen || m_events.poppedCount() < m_droppedOffUpTo.load())
+        return;
+
+    std::array<quint64, 16 * 128 / 64> keys;
+    for (size_t w = 0; w < keys.size(); ++w)
+        keys[w] = m_droppedOffs[w].exchange(0);
+    // Граница могла сдвинуться, пока забирали биты: бит нового сброса
+    // виден — значит, видна и его граница. Не дочитали до неё — вернуть
+    // биты и подождать.
+    if (m_events.poppedCount() < m_droppedOffUpTo.load()) {
+        for (size_t w = 0; w < keys.size(); ++w) {
+            if (keys[w])
+                m_droppedOffs[w].fetch_or(keys[w]);
+        }
+        return;
+    }
+    m_droppedOffSeen = requests;
+    for (size_t w = 0; w < keys.size(); ++w) {
+        for (quint64 bits = keys[w]; bits != 0; bits &= bits - 1) {
+            const int key = int(w * 64) + int(qCountTrailingZeroBits(bits));
+            keyUp(key & 127, key >> 7);
+        }
+    }
+}
+
+void SynthEngine::applyEvent(const MidiEvent &event)
+{
+    switch (event.type) {
+    case MidiEvent::NoteOn:
+        if (event.data2 > 0) {
+            startVoice(event.data1, event.data2, event.channel);
+            break;
+        }
+        keyUp(event.data1, event.channel);   // note-on с velocity 0 — это note-off
+        break;
+    case MidiEvent::NoteOff:
+        keyUp(event.data1, event.channel);
+        break;
+    case MidiEvent::Control:
+        applyControl(event.channel, event.data1, event.data2);
+        break;
+    case MidiEvent::Program:
+        m_controllers.channels[event.channel].apply(ControlEvent::Program, event.data1);
+        break;
+    }
+}
+
+void SynthEngine::applyControl(int channel, int controller, int value)
+{
+    if (controller == 120 || controller == 123) {   // All Sound/Notes Off
+        for (Voice &v : m_voices) {
+            if (v.stage == Stage::Attack || v.stage == Stage::Decay)
+                v.stage = Stage::Release;
+        }
+        return;
+    }
+
+    ChannelState &c = m_controllers.channels[channel];
+    const bool wasSustained = c.sustainOn();
+    c.apply(controller, value);
+    m_channelGain[channel] = channelGain(c);
+    if (wasSustained && !c.sustainOn())
+        releaseHeld(channel);
+}
+
+int SynthEngine::eventOffset(const MidiEvent &event, int frames) const
+{
+    // Опоздавшие и «немедленные» события — в начало блока,
+    // события после конца блока ждут следующего render()
+    const qint64 deltaNs = event.timeNs - m_frameTimeNs;
+    if (deltaNs <= 0)
+        return 0;
+    const qint64 offset = deltaNs * m_sampleRate / 1000000000;
+    return offset < frames ? int(offset) : frames;
+}
+
+int SynthEngine::pickVoice()
+{
+    int quietest = -1;
+    int oldest = 0;
+    for (int i = 0; i < MaxVoices; ++i) {
+        const Voice &v = m_voices[i];
+        if (v.stage == Stage::Off)
+            return i;
+        if ((v.stage == Stage::Release || v.stage == Stage::Damp)
+            && (quietest < 0 || v.level < m_voices[quietest].level))
+            quietest = i;
+        if (v.age < m_voices[oldest].age)
+            oldest = i;
+    }
+    return quietest >= 0 ? quietest : oldest;
+}
+
+void SynthEngine::startVoice(int pitch, int velocity, int channel)
+{
+    const int inst = m_instrument.load(std::memory_order_relaxed);
+    const InstrumentModel &model = m_instruments[inst];
+
+    // Повторный удар глушит предыдущий голос той же клавиши того же канала
+    releasePitch(pitch, channel);
+
+    if (m_bankSeen) {
+        startSamplerVoices(*m_bankSeen, inst, pitch, velocity, channel);
+        return;
+    }
+
+    Voice &v = m_voices[pickVoice()];
+
+    const float freq = 440.0f * std::exp2((float(pitch) - 69.0f) / 12.0f);
+    const int allowed = int(float(m_sampleRate) * 0.45f / freq);
+    int level = 0;
+    while (level + 1 < TableLevels && (1 << (level + 1)) <= allowed)
+        ++level;
+
+    const float pan = (float(pitch) - 64.0f) / 64.0f * 0.35f;   // низкие слева
+    const float angle = (pan + 1.0f) * (kTwoPi / 8.0f);
+
+    v.stage        = Stage::Attack;
+    v.pitch        = quint8(pitch);
+    v.instrument   = quint8(inst);
+    v.channel      = quint8(channel);
+    v.held         = false;
+    v.table        = model.tables[level].data();
+    v.phase        = 0.0f;
+    v.phaseInc     = freq * float(TableSize) / float(m_sampleRate);
+    v.samples      = nullptr;
+    v.level        = 0.0f;
+    v.velocityGain = float(velocity) / 127.0f;
+    v.attackSec    = model.attackSec;
+    v.decayTau     = model.decaySec * std::exp2(-(float(pitch) - 60.0f) / 24.0f);
+    v.sustainLevel = model.sustainLevel;
+    v.releaseTau   = model.releaseSec;
+    v.gain         = model.gain;
+    v.panL         = std::cos(angle);
+    v.panR         = std::sin(angle);
+    v.age          = ++m_voiceCounter;
+}
+
+void SynthEngine::startSamplerVoices(const SamplerBank &bank, int inst, int pitch, int velocity,
+                                     int channel)
+{
+    const SoundFont &font = *bank.font;
+    // Слои и стерео-пары — отдельные голоса, по одному на зону
+    font.forEachZone(bank.presets[inst], pitch, velocity, [&](const SoundFont::Zone &z) {
+        Voice &v = m_voices[pickVoice()];
+
+        const float angle = (z.pan + 1.0f) * (kTwoPi / 8.0f);
+        const float cents = float(pitch - z.rootKey) * 100.0f + z.tuneCents;
+
+        v.stage        = Stage::Attack;
+        v.pitch        = quint8(pitch);
+        v.instrument   = quint8(inst);
+        v.channel      = quint8(channel);
+        v.held         = false;
+        v.table        = nullptr;
+        v.samples      = font.samples();
+        v.samplePos    = double(z.start);
+        v.sampleInc    = std::exp2(double(cents) / 1200.0) * double(z.sampleRate) / double(m_sampleRate);
+        v.sampleEnd    = z.end;
+        v.loop         = z.loop;
+        v.loopStart    = z.loopStart;
+        v.loopEnd      = z.loop ? z.loopEnd : z.end - 1;
+        v.level        = 0.0f;
+        // SF2: громкость по velocity — вогнутая кривая
+        v.velocityGain = float(velocity * velocity) / (127.0f * 127.0f);
+        v.attackSec    = std::max(z.attackSec, 0.001f);
+        v.decayTau     = std::max(z.decaySec * kSf2TimeToTau, 0.001f);
+        v.sustainLevel = z.sustainLevel;
+        v.releaseTau   = std::max(z.releaseSec * kSf2TimeToTau, 0.005f);
+        v.gain         = z.gain;
+        v.panL         = std::cos(angle);
+        v.panR         = std::sin(angle);
+        v.age          = ++m_voiceCounter;
+
+        if (m_firstSoundPending) {
+            m_firstSoundPending = false;
+            m_firstSoundArmed = true;
+        }
+    });
+}
+
+void SynthEngine::releasePitch(int pitch, int channel)
+{
+    for (Voice &v : m_voices) {
+        if ((v.stage == Stage::Attack || v.stage == Stage::Decay) && v.pitch == pitch && v.channel == channel)
+            v.stage = Stage::Release;
+    }
+}
+
+void SynthEngine::keyUp(int pitch, int channel)
+{
+    // Та же высота на другом канале — другая клавиша (другая рука, другой инструмент)
+    for (Voice &v : m_voices) {
+        if ((v.stage != Stage::Attack && v.stage != Stage::Decay) || v.pitch != pitch || v.channel != channel)
+            continue;
+        if (m_controllers.channels[v.channel].sustainOn())
+            v.held = true;
+        else
+            v.stage = Stage::Release;
+    }
+}
+
+void SynthEngine::releaseHeld(int channel)
+{
+    for (Voice &v : m_voices) {
+        if (v.held && v.channel == channel && (v.stage == Stage::Attack || v.stage == Stage::Decay))
+            v.stage = Stage::Release;
+        if (v.channel == channel)
+            v.held = false;
+    }
+}
+
+int SynthEngine::renderOscillator(Voice &v, int n)
+{
+    if (!v.samples) {
+        // Волновая таблица: линейная интерполяция
+        float phase = v.phase;
+        const float inc = v.phaseInc;
+        const float *t = v.table;
+        for (int i = 0; i < n; ++i) {
+            const int idx = int(phase);
+            const float frac = phase - float(idx);
+            m_osc[i] = t[idx] + frac * (t[idx + 1] - t[idx]);
+            phase += inc;
+            if (phase >= float(TableSize))
+                phase -= float(TableSize);
+        }
+        v.phase = phase;
+        return n;
+    }
+
+    // Сэмпл: линейная интерполяция по отсчётам прямо из отображения файла
+    const qint16 *s = v.samples;
+    const double loopLength = double(v.loopEnd - v.loopStart);
+    double pos = v.samplePos;
+    int i = 0;
+    for (; i < n; ++i) {
+        if (pos >= double(v.loopEnd)) {
+            if (!v.loop)
+                break;
+            pos -= loopLength;
+        }
+        const quint32 idx = quint32(pos);
+        const quint32 next = idx + 1 < v.sampleEnd ? idx + 1 : idx;
+        const float frac = float(pos - double(idx));
+        const float a = float(s[idx]);
+        m_osc[i] = (a + frac * (float(s[next]) - a)) * (1.0f / 32768.0f);
+        pos += v.sampleInc;
+    }
+    v.samplePos = pos;
+    std::fill(m_osc.begin() + i, m_osc.begin() + n, 0.0f);
+    return i;
+}
+
+void SynthEngine::renderVoice(Voice &v, int n)
+{
+    const int produced = renderOscillator(v, n);
+
+    // Огибающая: значение на конце под-блока, внутри — линейный ramp
+    const float dt = float(n) / float(m_sampleRate);
+    const float l0 = v.level;
+    float l1 = l0;
+    switch (v.stage) {
+    case Stage::Attack:
+        l1 = l0 + dt / v.attackSec;
+        if (l1 >= 1.0f) {
+            l1 = 1.0f;
+            v.stage = Stage::Decay;
+        }
+        break;
+    case Stage::Decay:
+        l1 = v.sustainLevel + (l0 - v.sustainLevel) * std::exp(-dt / v.decayTau);
+        break;
+    case Stage::Release:
+        l1 = l0 * std::exp(-dt / v.releaseTau);
+        break;
+    case Stage::Damp:
+        l1 = l0 * std::exp(-dt / kDampSec);
+        break;
+    case Stage::Off:
+        return;
+    }
+
+    const float gain = v.velocityGain * v.gain * m_channelGain[v.channel];
+    m_kernels->mixRamp(m_osc.data(), m_mixL.data(), m_mixR.data(), n,
+                       l0 * gain, (l1 - l0) * gain / float(n), v.panL, v.panR);
+
+    v.level = l1;
+    if ((v.stage != Stage::Attack && l1 < kSilence) || produced < n)
+        v.stage = Stage::Off;   // затухла или кончился сэмпл без петли
+}
+
+void SynthEngine::render(float *out, int frames)
+{
+    applyCommands();
+
+    // Часы рендера: steady_clock первого отсчёта блока. Между вызовами
+    // идут по счётчику отсчётов (рендер опережает воспроизведение на
+    // буфер), к стене притягиваются после опустошения или при уходе вперёд.
+    const qint64 nowNs = steadyNowNs();
+    const qint64 maxAheadNs = 4 * qMax<qint64>(m_lookaheadUs.load(std::memory_order_relaxed), 10000) * 1000;
+    if (m_frameTimeNs < nowNs || m_frameTimeNs > nowNs + maxAheadNs)
+        m_frameTimeNs = nowNs;
+
+    const MidiEvent *next = m_events.peek();
+    int nextOffset = next ? eventOffset(*next, frames) : frames;
+
+    int done = 0;
+    while (done < frames) {
+        // События, чей отсчёт наступил, — до рендера этого отрезка
+        while (next && nextOffset <= done) {
+            applyEvent(*next);
+            MidiEvent consumed;
+            m_events.pop(consumed);
+            releaseDroppedOffs();
+            next = m_events.peek();
+            nextOffset = next ? eventOffset(*next, frames) : frames;
+        }
+
+        // Отрезок кончается на под-блоке или на следующем событии
+        const int n = std::min({ SubBlock, frames - done, nextOffset - done });
+        std::fill_n(m_mixL.data(), n, 0.0f);
+        std::fill_n(m_mixR.data(), n, 0.0f);
+
+        for (Voice &v : m_voices) {
+            if (v.stage != Stage::Off)
+                renderVoice(v, n);
+        }
+
+        m_kernels->interleave(m_mixL.data(), m_mixR.data(), out + 2 * done, n, kMasterGain);
+        done += n;
+    }
+
+    m_frameTimeNs += qint64(frames) * 1000000000 / m_sampleRate;
+
+    int active = 0;
+    for (const Voice &v : m_voices)
+        active += v.stage != Stage::Off;
+    m_activeVoices.store(active, std::memory_order_relaxed);
+    Metrics::set(Metrics::ActiveVoices, active);
+    Metrics::set(Metrics::AudioQueueDepth, qint64(m_events.pushedCount() - m_events.poppedCount()));
+    Metrics::record(Metrics::AudioRenderUs, (steadyNowNs() - nowNs) / 1000);
+
+    if (m_firstSoundArmed) {
+        m_firstSoundArmed = false;
+        m_firstSoundUs.store((steadyNowNs() - nowNs) / 1000, std::memory_order_relaxed);
+    }
+    m_renderCount.fetch_add(1, std::memory_order_release);
+}
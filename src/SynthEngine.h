@@ -0,0 +1,211 @@
+// SynthEngine.h
+#ifndef SYNTHENGINE_H
+#define SYNTHENGINE_H
+
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "ControllerState.h"
+#include "MidiEvent.h"
+
+struct MixKernels;
+class SoundFont;
+
+// Программный синтезатор инструментов из cbInstruments.
+// Модель голоса: волновая таблица с ограниченным по полосе набором
+// гармоник + ADSR-огибающая, считаемая раз в под-блок и линейно
+// интерполируемая внутри него (векторное ядро VoiceMixer).
+//
+// render() вызывается из аудио-колбэка: не аллоцирует и не берёт
+// блокировок. Вся память (таблицы, пул голосов, буферы) выделяется
+// в конструкторе. Без QAudioSink тот же render() — офлайн-рендер.
+//
+// Если загружен SoundFont, инструменты играются сэмплами из него
+// (GM-программы 0, 1, 4, 6, 8). Банк подменяется атомарным указателем;
+// старый освобождается, только когда аудио-поток гарантированно его
+// больше не видит.
+//
+// Контроллеры каналов: громкость и expression масштабируют голоса канала,
+// педаль (CC64) задерживает отпускание до её снятия. Программы только
+// запоминаются — инструмент выбирает пользователь.
+class SynthEngine {
+public:
+    enum Instrument {
+        GrandPiano,
+        BrightPiano,
+        ElectricPiano,
+        Harpsichord,
+        Celesta,
+        InstrumentCount
+    };
+
+    static constexpr int MaxVoices = 64;
+    static constexpr int SubBlock  = 64;   // шаг огибающей, отсчётов
+
+    explicit SynthEngine(int sampleRate = 48000);
+
+    // До начала воспроизведения
+    void setSampleRate(int sampleRate);
+    int sampleRate() const { return m_sampleRate; }
+
+    // Единственный писатель — поток секвенсора. Событие применяется на
+    // том отсчёте блока, который соответствует его timeNs; поэтому
+    // секвенсор отдаёт события заранее, на lookaheadUs(). Не влезший
+    // в кольцо note-off не теряется: клавиша отпускается, когда аудио-поток
+    // дочитает всё, что было записано до него, — иначе нота зависла бы.
+    bool pushEvent(const MidiEvent &event);
+    bool noteOn(int pitch, int velocity);    // немедленно (timeNs = 0)
+    bool noteOff(int pitch);
+
+    // Живая игра мышью: отдельное кольцо, потому что у кольца секвенсора
+    // может быть только один писатель. Единственный писатель — GUI-поток;
+    // применяется в начале ближайшего блока.
+    bool liveNoteOn(int pitch, int velocity);
+    bool liveNoteOff(int pitch);
+    // MIDI-клавиатура ученика: своё кольцо, единственный писатель — поток
+    // ввода, так что нажатие звучит, не дожидаясь цикла GUI. Ноты и
+    // контроллеры (педаль) — на своём канале; применяется так же, в
+    // начале ближайшего блока.
+    bool inputEvent(const MidiEvent &event);
+
+    // Упреждение, с которым стоит присылать события (задаёт AudioOutput)
+    void setLookaheadUs(qint64 us) { m_lookaheadUs.store(us, std::memory_order_relaxed); }
+    qint64 lookaheadUs() const { return m_lookaheadUs.load(std::memory_order_relaxed); }
+    quint64 droppedEvents() const
+    {
+        return m_events.overflowCount() + m_liveEvents.overflowCount() + m_inputEvents.overflowCount();
+    }
+
+    // Из любого потока
+    void allNotesOff();
+    void setInstrument(int instrument);
+    int instrument() const { return m_instrument.load(std::memory_order_relaxed); }
+    int activeVoices() const { return m_activeVoices.load(std::memory_order_relaxed); }
+
+    // GUI-поток. nullptr — вернуться к встроенным моделям.
+    void setSoundFont(std::shared_ptr<const SoundFont> font);
+    std::shared_ptr<const SoundFont> soundFont() const;
+    int soundFontPreset(int instrument) const;   // -1 без банка
+    // Первая нота сэмплера после смены банка: от подхвата команды до
+    // готового блока (включая page fault'ы по отсчётам), мкс; -1 — ещё нет
+    qint64 firstSoundLatencyUs() const { return m_firstSoundUs.load(std::memory_order_relaxed); }
+
+    // Аудио-поток: interleaved stereo float
+    void render(float *out, int frames);
+
+private:
+    static constexpr int TableSize   = 2048;
+    static constexpr int TableLevels = 7;   // 1, 2, 4 ... 64 гармоники
+
+    enum class Stage : quint8 { Off, Attack, Decay, Release, Damp };
+
+    struct SamplerBank {
+        std::shared_ptr<const SoundFont> font;
+        std::array<int, InstrumentCount> presets;
+    };
+
+    struct RetiredBank {
+        std::unique_ptr<SamplerBank> bank;
+        quint64 safeAfter;   // значение m_renderCount, после которого можно удалить
+    };
+
+    struct InstrumentModel {
+        float attackSec;
+        float decaySec;     // постоянная времени спада у C4
+        float sustainLevel;
+        float releaseSec;
+        float gain;
+        std::array<std::vector<float>, TableLevels> tables;   // TableSize + 1
+    };
+
+    struct Voice {
+        Stage stage = Stage::Off;
+        quint8 pitch = 0;
+        quint8 instrument = 0;
+        quint8 channel = 0;
+        bool held = false;   // клавиша отпущена, голос держит педаль
+        const float *table = nullptr;
+        float phase = 0.0f;
+        float phaseInc = 0.0f;
+        // Сэмплерный голос (samples != nullptr): позиция в отсчётах пула
+        const qint16 *samples = nullptr;
+        double samplePos = 0.0;
+        double sampleInc = 0.0;
+        quint32 sampleEnd = 0;
+        quint32 loopStart = 0;
+        quint32 loopEnd = 0;
+        bool loop = false;
+        float level = 0.0f;
+        float velocityGain = 0.0f;
+        float attackSec = 0.001f;
+        float decayTau = 1.0f;
+        float sustainLevel = 0.0f;
+        float releaseTau = 0.1f;
+        float gain = 1.0f;
+        float panL = 0.7f;
+        float panR = 0.7f;
+        quint32 age = 0;
+    };
+
+    void buildInstruments();
+    void applyCommands();
+    void releaseDroppedOffs();
+    void applyEvent(const MidiEvent &event);
+    int  eventOffset(const MidiEvent &event, int frames) const;
+    void applyControl(int channel, int controller, int value);
+    void startVoice(int pitch, int velocity, int channel);
+    void startSamplerVoices(const SamplerBank &bank, int inst, int pitch, int velocity, int channel);
+    void releasePitch(int pitch, int channel);   // без оглядки на педаль
+    void keyUp(int pitch, int channel);          // note-off: под педалью голос остаётся
+    void releaseHeld(int channel);
+    int  pickVoice();
+    void renderVoice(Voice &v, int n);
+    int  renderOscillator(Voice &v, int n);
+
+    int m_sampleRate;
+    const MixKernels *m_kernels;
+    std::array<InstrumentModel, InstrumentCount> m_instruments;
+    std::array<Voice, MaxVoices> m_voices;
+    quint32 m_voiceCounter = 0;
+
+    MidiEventRing m_events;
+    MidiEventRing m_liveEvents;
+    MidiEventRing m_inputEvents;
+    std::atomic<qint64> m_lookaheadUs{0};
+    qint64 m_frameTimeNs = 0;   // аудио-поток: steady_clock следующего отсчёта
+    std::atomic<int> m_instrument{GrandPiano};
+    std::atomic<quint32> m_allOffRequests{0};
+    std::atomic<size_t> m_allOffUpTo{0};   // события до этого номера устарели
+    quint32 m_allOffSeen = 0;
+    // Note-off, не влезшие в m_events: бит на пару (канал, высота).
+    // Пишет поток секвенсора, забирает аудио-поток, когда прочитает
+    // m_events до m_droppedOffUpTo, — раньше в кольце ещё может лежать
+    // note-on той же ноты.
+    std::array<std::atomic<quint64>, 16 * 128 / 64> m_droppedOffs{};
+    std::atomic<size_t> m_droppedOffUpTo{0};
+    std::atomic<quint32> m_droppedOffRequests{0};
+    quint32 m_droppedOffSeen = 0;   // аудио-поток
+    std::atomic<int> m_activeVoices{0};
+
+    // Аудио-поток: контроллеры каналов и готовый множитель громкости
+    ControllerState m_controllers;
+    std::array<float, 16> m_channelGain;
+
+    // Банк сэмплов: пишет GUI, читает аудио-поток
+    std::atomic<const SamplerBank *> m_bank{nullptr};
+    std::unique_ptr<SamplerBank> m_currentBank;          // GUI-поток
+    std::vector<RetiredBank> m_retiredBanks;             // GUI-поток
+    std::atomic<quint64> m_renderCount{0};
+    const SamplerBank *m_bankSeen = nullptr;             // аудио-поток
+    bool m_firstSoundPending = false;                    // аудио-поток
+    bool m_firstSoundArmed = false;                      // аудио-поток
+    std::atomic<qint64> m_firstSoundUs{-1};
+
+    alignas(32) std::array<float, SubBlock> m_osc;
+    alignas(32) std::array<float, SubBlock> m_mixL;
+    alignas(32) std::array<float, SubBlock> m_mixR;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "TempoMap.h"
+#include <algorithm>
+#include <cmath>
+
+void TempoMap::reset(int ppq)
+{
+    m_ppq = ppq > 0 ? ppq : 480;
+    m_smpte = false;
+    m_segments.clear();
+
+    Segment s;
+    s.usPerQuarter = DefaultUsPerQuarter;
+    s.usPerTick = double(DefaultUsPerQuarter) / m_ppq;
+    m_segments.push_back(s);
+}
+
+void TempoMap::resetSmpte(double ticksPerSecond)
+{
+    m_ppq = 0;
+    m_smpte = true;
+    m_segments.clear();
+
+    Segment s;
+    s.usPerTick = 1.0e6 / ticksPerSecond;
+    m_segments.push_back(s);
+}
+
+void TempoMap::assign(int ppq, bool smpte, const Segment *segments, int count)
+{
+    if (count <= 0) {
+        reset(ppq);
+        return;
+    }
+    m_ppq = ppq;
+    m_smpte = smpte;
+    m_segments.assign(segments, segments + count);
+}
+
+void TempoMap::addTempo(quint32 tick, quint32 usPerQuarter)
+{
+    if (m_smpte)
+        return;   // в SMPTE-файлах meta 0x51 не влияет на время
+    if (usPerQuarter == 0)
+        usPerQuarter = DefaultUsPerQuarter;
+
+    Segment &last = m_segments.back();
+    if (last.usPerQuarter == usPerQuarter)
+        return;   // тот же темп — отрезок продолжается
+
+    Segment s;
+    s.tick = qMax(tick, last.tick);
+    s.us = last.us + qint64(std::llround(double(s.tick - last.tick) * last.usPerTick));
+    s.usPerQuarter = usPerQuarter;
+    s.usPerTick = double(usPerQuarter) / m_ppq;
+
+    if (s.tick == last.tick)
+        last = s;   // два темпа на одном тике — действует последний
+    else
+        m_segments.push_back(s);
+}
+
+const TempoMap::Segment &TempoMap::segmentForTick(quint32 tick) const
+{
+    // Парсер спрашивает тики по возрастанию — чаще всего это последний отрезок
+    if (tick >= m_segments.back().tick)
+        return m_segments.back();
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), tick,
+                               [](quint32 t, const Segment &s) { return t < s.tick; });
+    return *(it - 1);
+}
+
+const TempoMap::Segment &TempoMap::segmentForUs(qint64 us) const
+{
+    if (us >= m_segments.back().us)
+        return m_segments.back();
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), us,
+                               [](qint64 t, const Segment &s) { return t < s.us; });
+    return it == m_segments.begin() ? *it : *(it - 1);
+}
+
+qint64 TempoMap::tickToUs(quint32 tick) const
+{
+    const Segment &s = segmentForTick(tick);
+    return s.us + qint64(std::llround(double(tick - s.tick) * s.usPerTick));
+}
+
+quint32 TempoMap::usToTick(qint64 us) const
+{
+    if (us <= 0)
+        return 0;
+    const Segment &s = segmentForUs(us);
+    // Ближайший тик: обратный к округлённому tickToUs без потерь
+    return s.tick + quint32(std::floor(double(us - s.us) / s.usPerTick + 0.5));
+}
+
+double TempoMap::bpmAtTick(quint32 tick) const
+{
+    return bpmOf(segmentForTick(tick));
+}
+
+double TempoMap::bpmAtUs(qint64 us) const
+{
+    return bpmOf(segmentForUs(us));
+}
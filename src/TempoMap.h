@@ -0,0 +1,59 @@
+// TempoMap.h
+#ifndef TEMPOMAP_H
+#define TEMPOMAP_H
+
+#include <QtGlobal>
+#include <vector>
+
+// Карта темпа песни: отрезки постоянного темпа, отсортированные по тику.
+// Каждый отрезок хранит свой стартовый тик и уже посчитанное время начала
+// в микросекундах, поэтому перевод тик → µs и µs → тик — бинарный поиск
+// отрезка плюс одно умножение, O(log n) в числе смен темпа.
+//
+// Для SMPTE-деления темп фиксирован: один отрезок, BPM не определён (0).
+class TempoMap {
+public:
+    struct Segment {
+        quint32 tick = 0;
+        qint64  us = 0;              // время начала отрезка
+        double  usPerTick = 0.0;
+        quint32 usPerQuarter = 0;    // 0 для SMPTE
+    };
+
+    static constexpr quint32 DefaultUsPerQuarter = 500000;   // 120 BPM
+
+    TempoMap() { reset(480); }
+
+    // Сбрасывает карту к одному отрезку 120 BPM
+    void reset(int ppq);
+    void resetSmpte(double ticksPerSecond);
+    // Готовая таблица отрезков (из кэша песни)
+    void assign(int ppq, bool smpte, const Segment *segments, int count);
+
+    // Смена темпа с тика tick. Тики должны идти по неубыванию
+    // (так их выдаёт слияние дорожек); повтор тика заменяет отрезок.
+    void addTempo(quint32 tick, quint32 usPerQuarter);
+
+    qint64  tickToUs(quint32 tick) const;
+    quint32 usToTick(qint64 us) const;   // ближайший тик
+
+    double bpmAtTick(quint32 tick) const;
+    double bpmAtUs(qint64 us) const;
+    double initialBpm() const { return bpmOf(m_segments.front()); }
+
+    int ppq() const { return m_ppq; }
+    bool isSmpte() const { return m_smpte; }
+    int segmentCount() const { return int(m_segments.size()); }
+    const Segment &segment(int i) const { return m_segments[i]; }
+
+private:
+    static double bpmOf(const Segment &s) { return s.usPerQuarter ? 60.0e6 / s.usPerQuarter : 0.0; }
+    const Segment &segmentForTick(quint32 tick) const;
+    const Segment &segmentForUs(qint64 us) const;
+
+    std::vector<Segment> m_segments;   // никогда не пуст
+    int m_ppq = 480;
+    bool m_smpte = false;
+};
+
+#endif
@@ -0,0 +1,286 @@
+#include "Trace.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::s_enabled{false};
+
+namespace {
+
+struct ZoneRecord {
+    const char *name;
+    qint64 startNs;
+    qint64 durationNs;
+};
+
+// Слот кольца. Снимок читает слоты, пока поток их переписывает, — поля
+// атомарные (relaxed: на x86 и ARM это обычные загрузки и сохранения),
+// а целостность прочитанного проверяется по written
+struct ZoneSlot {
+    std::atomic<const char *> name{nullptr};
+    std::atomic<qint64> startNs{0};
+    std::atomic<qint64> durationNs{0};
+};
+
+// Кольцо одного потока. written растёт монотонно: слот — written % RingCapacity,
+// запись публикуется release-сохранением нового written.
+struct ThreadRing {
+    std::array<ZoneSlot, Trace::RingCapacity> zones;
+    std::atomic<quint64> written{0};
+    std::atomic<const char *> name{nullptr};
+    int tid = 0;
+    bool owned = true;   // false — поток завершился, кольцо можно отдать новому
+};
+
+// Кольца живут до конца процесса: зоны завершившегося потока остаются в
+// трассе, пока его кольцо не понадобится новому потоку (SongLoader
+// заводит поток на каждую загрузку — без повторного использования
+// память росла бы с каждым открытым файлом).
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadRing>> rings;
+    int nextTid = 1;
+};
+
+Registry &registry()
+{
+    // Намеренно не разрушается: потоки могут писать зоны после выхода из main
+    static Registry *instance = new Registry;
+    return *instance;
+}
+
+// Зоны, начатые раньше, в трассу не попадают (см. Trace::clear)
+std::atomic<qint64> g_clearedNs{0};
+
+// Отдаёт кольцо обратно реестру при завершении потока
+struct RingHandle {
+    ThreadRing *ring = nullptr;
+    ~RingHandle()
+    {
+        if (!ring)
+            return;
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        ring->owned = false;
+    }
+};
+
+thread_local RingHandle t_ring;
+
+// Кольцо для вызывающего потока: свободное из реестра или новое
+ThreadRing *acquireRing()
+{
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    ThreadRing *ring = nullptr;
+    for (const std::unique_ptr<ThreadRing> &candidate : reg.rings) {
+        if (!candidate->owned) {
+            ring = candidate.get();
+            break;
+        }
+    }
+    if (!ring) {
+        reg.rings.push_back(std::make_unique<ThreadRing>());
+        ring = reg.rings.back().get();
+    }
+    // Новый tid: зоны прежнего владельца не приписываются новому потоку
+    ring->written.store(0, std::memory_order_relaxed);
+    ring->tid = reg.nextTid++;
+    ring->owned = true;
+    return ring;
+}
+
+struct RingSnapshot {
+    int tid;
+    const char *name;
+    std::vector<ZoneRecord> zones;
+};
+
+// Копия кольца, которое его поток, возможно, пишет прямо сейчас: после
+// копирования перечитываем written и отбрасываем слоты, которые могли
+// быть затёрты за это время
+RingSnapshot snapshot(const ThreadRing &ring)
+{
+    RingSnapshot snap{ ring.tid, ring.name.load(std::memory_order_relaxed), {} };
+    const quint64 capacity = Trace::RingCapacity;
+    const quint64 end = ring.written.load(std::memory_order_acquire);
+    const quint64 begin = end > capacity ? end - capacity : 0;
+    snap.zones.reserve(size_t(end - begin));
+    for (quint64 i = begin; i < end; ++i) {
+        const ZoneSlot &slot = ring.zones[i % capacity];
+        snap.zones.push_back(ZoneRecord{ slot.name.load(std::memory_order_relaxed),
+                                         slot.startNs.load(std::memory_order_relaxed),
+                                         slot.durationNs.load(std::memory_order_relaxed) });
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const quint64 after = ring.written.load(std::memory_order_relaxed);
+    // Слот записи after (ещё не опубликованной) — это слот after - capacity
+    const quint64 firstIntact = after + 1 > capacity ? after + 1 - capacity : 0;
+    if (firstIntact > begin)
+        snap.zones.erase(snap.zones.begin(),
+                         snap.zones.begin() + qMin<qint64>(qint64(firstIntact - begin), qint64(snap.zones.size())));
+
+    const qint64 clearedNs = g_clearedNs.load(std::memory_order_relaxed);
+    snap.zones.erase(std::remove_if(snap.zones.begin(), snap.zones.end(),
+                                    [clearedNs](const ZoneRecord &zone) { return zone.startNs < clearedNs; }),
+                     snap.zones.end());
+    return snap;
+}
+
+void appendJsonString(QByteArray &out, const char *text)
+{
+    out.append('"');
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            out.append('\\');
+        if (quint8(*c) >= 0x20)
+            out.append(*c);
+    }
+    out.append('"');
+}
+
+} // namespace
+
+void Trace::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Trace::clear()
+{
+    // Кольца не трогаем — их пишут свои потоки; старые зоны отсекаются
+    // по времени при снимке
+    g_clearedNs.store(nowNs(), std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(const char *name)
+{
+    // Кольцо — здесь, при старте потока, а не в первой зоне: аудио-поток
+    // не должен ни выделять память, ни ждать мьютекс реестра
+    if (!t_ring.ring)
+        t_ring.ring = acquireRing();
+    t_ring.ring->name.store(name, std::memory_order_relaxed);
+}
+
+void Trace::reserveRing()
+{
+    Registry &reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const std::unique_ptr<ThreadRing> &ring : reg.rings) {
+        if (!ring->owned)
+            return;
+    }
+    reg.rings.push_back(std::make_unique<ThreadRing>());
+    reg.rings.back()->owned = false;
+}
+
+QString Trace::startFromEnvironment()
+{
+    const QString filePath = qEnvironmentVariable("PIANO_TRACE");
+    if (!filePath.isEmpty())
+        setEnabled(true);
+    return filePath;
+}
+
+qint64 Trace::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char *name, qint64 startNs, qint64 endNs)
+{
+    // Поток без имени кольца не получил — его зоны не пишутся
+    if (!t_ring.ring)
+        return;
+    ThreadRing &ring = *t_ring.ring;
+    const quint64 n = ring.written.load(std::memory_order_relaxed);
+    // Пара к acquire-барьеру снимка: кто увидел новые поля слота, тот
+    // увидит и written >= n и отбросит слот как затёртый
+    std::atomic_thread_fence(std::memory_order_release);
+    ZoneSlot &slot = ring.zones[n % RingCapacity];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.startNs.store(startNs, std::memory_order_relaxed);
+    slot.durationNs.store(endNs - startNs, std::memory_order_relaxed);
+    ring.written.store(n + 1, std::memory_order_release);
+}
+
+bool Trace::writeChromeJson(const QString &filePath)
+{
+    std::vector<RingSnapshot> snapshots;
+    {
+        Registry &reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        snapshots.reserve(reg.rings.size());
+        for (const std::unique_ptr<ThreadRing> &ring : reg.rings)
+            snapshots.push_back(snapshot(*ring));
+    }
+
+    // Время в трассе — микросекунды от самой ранней зоны
+    qint64 originNs = 0;
+    bool haveOrigin = false;
+    size_t zoneCount = 0;
+    for (const RingSnapshot &snap : snapshots) {
+        for (const ZoneRecord &zone : snap.zones) {
+            originNs = haveOrigin ? qMin(originNs, zone.startNs) : zone.startNs;
+            haveOrigin = true;
+        }
+        zoneCount += snap.zones.size();
+    }
+
+    QByteArray out;
+    out.reserve(qsizetype(zoneCount) * 96 + 256);
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    auto beginEvent = [&]() {
+        if (!first)
+            out.append(",\n");
+        first = false;
+    };
+    for (const RingSnapshot &snap : snapshots) {
+        if (snap.zones.empty())
+            continue;
+        const QByteArray tid = QByteArray::number(snap.tid);
+        beginEvent();
+        out.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":");
+        out.append(tid);
+        out.append(",\"args\":{\"name\":");
+        if (snap.name)
+            appendJsonString(out, snap.name);
+        else
+            appendJsonString(out, QByteArray("thread " + tid).constData());
+        out.append("}}");
+
+        for (const ZoneRecord &zone : snap.zones) {
+            beginEvent();
+            out.append("{\"name\":");
+            appendJsonString(out, zone.name);
+            out.append(",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            out.append(tid);
+            out.append(",\"ts\":");
+            out.append(QByteArray::number(double(zone.startNs - originNs) / 1000.0, 'f', 3));
+            out.append(",\"dur\":");
+            out.append(QByteArray::number(double(zone.durationNs) / 1000.0, 'f', 3));
+            out.append('}');
+        }
+    }
+    out.append("\n]}\n");
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Trace: cannot write" << filePath;
+        return false;
+    }
+    file.write(out);
+    if (!file.commit()) {
+        qWarning() << "Trace: cannot write" << filePath << file.errorString();
+        return false;
+    }
+    qDebug() << "Trace:" << zoneCount << "zones written to" << filePath;
+    return true;
+}
@@ -0,0 +1,82 @@
+// Trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Трассировка горячих путей в формате Chrome trace-event (открывается в
+// chrome://tracing и ui.perfetto.dev). Зона — RAII-объект
+// PIANO_TRACE_ZONE("Имя"): на выходе из области пишет имя, начало и
+// длительность в кольцо своего потока. Кольцо пишет только его поток:
+// ни блокировок, ни аллокаций на горячем пути, старые зоны затираются
+// новыми. Кольцо поток получает в setThreadName — зоны потоков, которые
+// его не вызывали, не пишутся. Пока запись выключена, зона стоит одну
+// relaxed-загрузку флага; с PIANO_TRACE_DISABLED зоны не компилируются вовсе.
+//
+// Имя зоны и потока — строковый литерал: хранится только указатель.
+class Trace {
+public:
+    static constexpr int RingCapacity = 1 << 16;   // последних зон на поток
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+    // Забыть всё записанное до этого момента
+    static void clear();
+
+    // Имя потока в трассе и его кольцо (RingCapacity зон, ~1.5 МБ); вызывает
+    // сам поток при старте, до первой зоны. Повторный вызов только меняет имя.
+    static void setThreadName(const char *name);
+    // Свободное кольцо про запас для потока, который заводит чужой код
+    // (аудио): его setThreadName не будет выделять память
+    static void reserveRing();
+
+    // PIANO_TRACE=<файл>: включает запись с запуска. Возвращает файл,
+    // в который сбросить трассу при выходе, или пустую строку.
+    static QString startFromEnvironment();
+
+    // Снимок всех колец; писать можно на ходу. false — файл не записан
+    // (qWarning с причиной).
+    static bool writeChromeJson(const QString &filePath);
+
+    // steady_clock, нс от его эпохи — те же часы, что у MidiEvent::timeNs
+    static qint64 nowNs();
+    static void record(const char *name, qint64 startNs, qint64 endNs);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class TraceZone {
+public:
+    explicit TraceZone(const char *name)
+        : m_name(name)
+        , m_startNs(Trace::isEnabled() ? Trace::nowNs() : 0)
+    {
+    }
+    ~TraceZone()
+    {
+        // 0 — запись была выключена на входе в зону
+        if (m_startNs)
+            Trace::record(m_name, m_startNs, Trace::nowNs());
+    }
+
+    TraceZone(const TraceZone &) = delete;
+    TraceZone &operator=(const TraceZone &) = delete;
+
+private:
+    const char *m_name;
+    qint64 m_startNs;
+};
+
+#define PIANO_TRACE_CONCAT_(a, b) a##b
+#define PIANO_TRACE_CONCAT(a, b) PIANO_TRACE_CONCAT_(a, b)
+
+#ifdef PIANO_TRACE_DISABLED
+#define PIANO_TRACE_ZONE(name) do {} while (false)
+#else
+#define PIANO_TRACE_ZONE(name) TraceZone PIANO_TRACE_CONCAT(traceZone_, __LINE__)(name)
+#endif
+
+#endif
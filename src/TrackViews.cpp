@@ -0,0 +1,57 @@
+#include "TrackViews.h"
+
+void TrackViews::build(const NoteStore &notes)
+{
+    m_present = notes.presentTracks();
+    m_start.clear();
+    m_end.clear();
+    m_ids.clear();
+    for (View &view : m_views)
+        view = View();
+
+    // Одна дорожка (или ни одной) — хватает самого NoteStore
+    if (qPopulationCount(m_present) < 2)
+        return;
+
+    // Раскладка подсчётом по колонке дорожек: ноты уже по возрастанию
+    // старта, и внутри дорожки порядок сохраняется
+    const int count = notes.size();
+    const quint8 *tracks = notes.tracks();
+    for (int i = 0; i < count; ++i)
+        ++m_views[tracks[i]].count;
+    int first = 0;
+    std::array<int, NoteStore::MaxTracks> cursor;
+    for (int track = 0; track < NoteStore::MaxTracks; ++track) {
+        m_views[track].first = first;
+        cursor[track] = first;
+        first += m_views[track].count;
+    }
+
+    m_start.resize(size_t(count));
+    m_end.resize(size_t(count));
+    m_ids.resize(size_t(count));
+    for (int i = 0; i < count; ++i) {
+        const int k = cursor[tracks[i]]++;
+        m_start[k] = notes.startTime(i);
+        m_end[k] = notes.endTime(i);
+        m_ids[k] = quint32(i);
+    }
+    for (View &view : m_views)
+        view.intervals.build(m_end.data() + view.first, view.count);
+}
+
+void TrackViews::overlapping(const NoteStore &notes, TrackMask mask,
+                             quint32 t0Ms, quint32 t1Ms, std::vector<quint32> &out) const
+{
+    out.clear();
+    forEachOverlapping(notes, mask, t0Ms, t1Ms, [&out](quint32 i) { out.push_back(i); });
+}
+
+qint64 TrackViews::memoryUsage() const
+{
+    qint64 bytes = qint64(m_start.capacity() + m_end.capacity() + m_ids.capacity())
+                 * sizeof(quint32);
+    for (const View &view : m_views)
+        bytes += view.intervals.memoryUsage();
+    return bytes;
+}
@@ -0,0 +1,76 @@
+// TrackViews.h
+#ifndef TRACKVIEWS_H
+#define TRACKVIEWS_H
+
+#include <QtGlobal>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "NoteIntervalIndex.h"
+#include "NoteStore.h"
+
+// Ноты каждой дорожки отдельно: свои колонки старта и конца, номера нот
+// в NoteStore (по возрастанию старта) и свой индекс интервалов. Строятся один раз
+// при создании песни. Запрос с маской дорожек обходит только включённые
+// дорожки, а не все ноты окна с проверкой каждой, поэтому выключенная
+// рука ничего не стоит кадру. Включены все дорожки — запрос идёт прямо
+// в NoteStore.
+//
+// У песни из одной дорожки отдельных колонок нет: маска либо пропускает
+// её целиком, либо не пропускает ничего.
+class TrackViews {
+public:
+    using TrackMask = NoteStore::TrackMask;
+
+    void build(const NoteStore &notes);
+
+    // Дорожки, в которых есть ноты
+    TrackMask presentTracks() const { return m_present; }
+    // mask пропускает все дорожки с нотами
+    bool coversAll(TrackMask mask) const { return (mask & m_present) == m_present; }
+
+    // Вызывает f(index) для нот включённых в mask дорожек, пересекающих
+    // [t0Ms, t1Ms). По возрастанию старта внутри дорожки; дорожки — по номеру.
+    template <typename F>
+    void forEachOverlapping(const NoteStore &notes, TrackMask mask,
+                            quint32 t0Ms, quint32 t1Ms, F &&f) const;
+    void overlapping(const NoteStore &notes, TrackMask mask,
+                     quint32 t0Ms, quint32 t1Ms, std::vector<quint32> &out) const;
+
+    qint64 memoryUsage() const;
+
+private:
+    struct View {
+        int first = 0;   // начало дорожки в m_start / m_end
+        int count = 0;
+        NoteIntervalIndex intervals;
+    };
+
+    TrackMask m_present = 0;
+    std::vector<quint32> m_start;   // колонки всех дорожек подряд
+    std::vector<quint32> m_end;
+    std::vector<quint32> m_ids;     // номера нот в NoteStore
+    std::array<View, NoteStore::MaxTracks> m_views;
+};
+
+template <typename F>
+void TrackViews::forEachOverlapping(const NoteStore &notes, TrackMask mask,
+                                    quint32 t0Ms, quint32 t1Ms, F &&f) const
+{
+    if (coversAll(mask)) {
+        notes.forEachOverlapping(t0Ms, t1Ms, f);
+        return;
+    }
+    for (TrackMask bits = mask & m_present; bits != 0; bits &= bits - 1) {
+        const int track = int(qCountTrailingZeroBits(bits));
+        const View &view = m_views[track];
+        const quint32 *start = m_start.data() + view.first;
+        const int limit = int(std::lower_bound(start, start + view.count, t1Ms) - start);
+        const quint32 *ids = m_ids.data() + view.first;
+        view.intervals.forEachOverlapping(m_end.data() + view.first, limit, t0Ms,
+                                          [&](int k) { f(ids[k]); });
+    }
+}
+
+#endif
@@ -0,0 +1,153 @@
+#include "VoiceMixer.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define VOICEMIXER_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define VOICEMIXER_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace {
+
+// --- Скалярный путь ---
+
+void mixRampScalar(const float *src, float *left, float *right, int n,
+                   float gain, float gainStep, float panL, float panR)
+{
+    for (int i = 0; i < n; ++i) {
+        const float s = src[i] * (gain + float(i) * gainStep);
+        left[i]  += s * panL;
+        right[i] += s * panR;
+    }
+}
+
+void interleaveScalar(const float *left, const float *right, float *out, int n, float gain)
+{
+    for (int i = 0; i < n; ++i) {
+        out[2 * i]     = std::clamp(left[i] * gain, -1.0f, 1.0f);
+        out[2 * i + 1] = std::clamp(right[i] * gain, -1.0f, 1.0f);
+    }
+}
+
+#ifdef VOICEMIXER_X86
+
+// --- SSE2: по 4 отсчёта ---
+
+void mixRampSse2(const float *src, float *left, float *right, int n,
+                 float gain, float gainStep, float panL, float panR)
+{
+    __m128 g = _mm_add_ps(_mm_set1_ps(gain),
+                          _mm_mul_ps(_mm_set1_ps(gainStep), _mm_setr_ps(0.f, 1.f, 2.f, 3.f)));
+    const __m128 step = _mm_set1_ps(gainStep * 4.0f);
+    const __m128 pl = _mm_set1_ps(panL);
+    const __m128 pr = _mm_set1_ps(panR);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 s = _mm_mul_ps(_mm_loadu_ps(src + i), g);
+        _mm_storeu_ps(left + i,  _mm_add_ps(_mm_loadu_ps(left + i),  _mm_mul_ps(s, pl)));
+        _mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(s, pr)));
+        g = _mm_add_ps(g, step);
+    }
+    if (i < n)
+        mixRampScalar(src + i, left + i, right + i, n - i, gain + float(i) * gainStep, gainStep, panL, panR);
+}
+
+void interleaveSse2(const float *left, const float *right, float *out, int n, float gain)
+{
+    const __m128 g = _mm_set1_ps(gain);
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    const __m128 hi = _mm_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128 l = _mm_min_ps(hi, _mm_max_ps(lo, _mm_mul_ps(_mm_loadu_ps(left + i), g)));
+        const __m128 r = _mm_min_ps(hi, _mm_max_ps(lo, _mm_mul_ps(_mm_loadu_ps(right + i), g)));
+        _mm_storeu_ps(out + 2 * i,     _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+    if (i < n)
+        interleaveScalar(left + i, right + i, out + 2 * i, n - i, gain);
+}
+
+#endif // VOICEMIXER_X86
+
+#ifdef VOICEMIXER_AVX2
+
+// --- AVX2: по 8 отсчётов; включается только после проверки CPU ---
+
+__attribute__((target("avx2,fma")))
+void mixRampAvx2(const float *src, float *left, float *right, int n,
+                 float gain, float gainStep, float panL, float panR)
+{
+    __m256 g = _mm256_fmadd_ps(_mm256_set1_ps(gainStep),
+                               _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f),
+                               _mm256_set1_ps(gain));
+    const __m256 step = _mm256_set1_ps(gainStep * 8.0f);
+    const __m256 pl = _mm256_set1_ps(panL);
+    const __m256 pr = _mm256_set1_ps(panR);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 s = _mm256_mul_ps(_mm256_loadu_ps(src + i), g);
+        _mm256_storeu_ps(left + i,  _mm256_fmadd_ps(s, pl, _mm256_loadu_ps(left + i)));
+        _mm256_storeu_ps(right + i, _mm256_fmadd_ps(s, pr, _mm256_loadu_ps(right + i)));
+        g = _mm256_add_ps(g, step);
+    }
+    if (i < n)
+        mixRampScalar(src + i, left + i, right + i, n - i, gain + float(i) * gainStep, gainStep, panL, panR);
+}
+
+__attribute__((target("avx2")))
+void interleaveAvx2(const float *left, const float *right, float *out, int n, float gain)
+{
+    const __m256 g = _mm256_set1_ps(gain);
+    const __m256 lo = _mm256_set1_ps(-1.0f);
+    const __m256 hi = _mm256_set1_ps(1.0f);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 l = _mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_mul_ps(_mm256_loadu_ps(left + i), g)));
+        const __m256 r = _mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_mul_ps(_mm256_loadu_ps(right + i), g)));
+        // unpack работает внутри 128-битных половин — переставляем их
+        const __m256 a = _mm256_unpacklo_ps(l, r);   // l0 r0 l1 r1 | l4 r4 l5 r5
+        const __m256 b = _mm256_unpackhi_ps(l, r);   // l2 r2 l3 r3 | l6 r6 l7 r7
+        _mm256_storeu_ps(out + 2 * i,     _mm256_permute2f128_ps(a, b, 0x20));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(a, b, 0x31));
+    }
+    if (i < n)
+        interleaveScalar(left + i, right + i, out + 2 * i, n - i, gain);
+}
+
+#endif // VOICEMIXER_AVX2
+
+MixKernels selectKernels()
+{
+#ifdef VOICEMIXER_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return { mixRampAvx2, interleaveAvx2, "avx2" };
+#endif
+#ifdef VOICEMIXER_X86
+    return { mixRampSse2, interleaveSse2, "sse2" };
+#else
+    return { mixRampScalar, interleaveScalar, "scalar" };
+#endif
+}
+
+} // namespace
+
+const MixKernels &mixKernels()
+{
+    static const MixKernels kernels = selectKernels();
+    return kernels;
+}
+
+const MixKernels &scalarMixKernels()
+{
+    static const MixKernels kernels = { mixRampScalar, interleaveScalar, "scalar" };
+    return kernels;
+}
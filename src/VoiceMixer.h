@@ -0,0 +1,23 @@
+// VoiceMixer.h
+#ifndef VOICEMIXER_H
+#define VOICEMIXER_H
+
+// Векторные ядра микшера голосов. Реализация выбирается один раз при
+// первом обращении: AVX2 (если процессор умеет), SSE2, либо скалярная.
+struct MixKernels {
+    // left/right += src[i] * (gain + i * gainStep) * pan
+    void (*mixRamp)(const float *src, float *left, float *right, int n,
+                    float gain, float gainStep, float panL, float panR);
+
+    // out[2i] = clamp(left[i] * gain), out[2i+1] = clamp(right[i] * gain)
+    void (*interleave)(const float *left, const float *right, float *out, int n, float gain);
+
+    const char *name;
+};
+
+const MixKernels &mixKernels();
+
+// Для сравнения путей в бенчмарках
+const MixKernels &scalarMixKernels();
+
+#endif
@@ -1,8 +1,12 @@
 #include <QApplication>
 #include "MainWindow.h"
+#include "Trace.h"
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+    Trace::setThreadName("gui");
+    // PIANO_TRACE=<файл>: трасса пишется с запуска и сохраняется при выходе
+    const QString traceFile = Trace::startFromEnvironment();
     
     app.setApplicationName("Piano Platform");
     app.setApplicationVersion("1.0.0");
@@ -11,5 +15,8 @@ int main(int argc, char *argv[]) {
     MainWindow window;
     window.show();
     
-    return app.exec();
+    const int result = app.exec();
+    if (!traceFile.isEmpty())
+        Trace::writeChromeJson(traceFile);
+    return result;
 }